@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/leaf/handle_errors.hpp"
+#include "checksum.hpp"
+#include "common.hpp"
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "file_handler.hpp"
+#include "svgys/error.hpp"
+#include "svgys/program_options.hpp"
+
+namespace cc::tar::bench {
+using namespace svgys::error;
+namespace fs = std::filesystem;
+
+// Seed of every corpus, so runs on different builds archive the same bytes
+static constexpr std::uint64_t CORPUS_SEED = 54;
+
+static constexpr std::uint64_t KIB = 1 << 10;
+static constexpr std::uint64_t MIB = 1 << 20;
+
+/**
+ * @brief Set of input files, with paths relative to the corpus directory
+ */
+struct Corpus {
+  std::string name;
+  fs::path root;
+  std::vector<std::string> files{};
+  std::vector<std::string> directories{};
+  std::uint64_t bytes{0};
+};
+
+struct Measurement {
+  std::string benchmark;
+  std::string corpus;
+  std::uint32_t jobs;
+  double seconds;
+  std::uint64_t bytes;
+  std::uint64_t members;
+};
+
+/**
+ * @brief Writes the files of a corpus with contents from a seeded generator
+ */
+class CorpusWriter {
+public:
+  CorpusWriter(std::string const &name, fs::path const &workDirectory)
+      : mCorpus{.name = name, .root = workDirectory / name} {
+    fs::remove_all(mCorpus.root);
+    fs::create_directories(mCorpus.root);
+  }
+
+  void AddDirectory(std::string const &path) {
+    fs::create_directories(mCorpus.root / path);
+    mCorpus.directories.push_back(path);
+  }
+
+  void AddFile(std::string const &path, std::uint64_t size) {
+    std::ofstream file(mCorpus.root / path, std::ios::binary);
+    std::vector<std::uint64_t> chunk(64 * KIB / sizeof(std::uint64_t));
+    for (std::uint64_t written = 0; written < size;) {
+      std::generate(chunk.begin(), chunk.end(), std::ref(mRandom));
+      auto chunkSize = std::min<std::uint64_t>(size - written, 64 * KIB);
+      file.write(reinterpret_cast<const char *>(chunk.data()),
+                 static_cast<std::streamsize>(chunkSize));
+      written += chunkSize;
+    }
+    mCorpus.files.push_back(path);
+    mCorpus.bytes += size;
+  }
+
+  [[nodiscard]] std::uint64_t Uniform(std::uint64_t min, std::uint64_t max) {
+    return std::uniform_int_distribution<std::uint64_t>(min, max)(mRandom);
+  }
+
+  [[nodiscard]] Corpus Finish() { return std::move(mCorpus); }
+
+private:
+  Corpus mCorpus;
+  std::mt19937_64 mRandom{CORPUS_SEED};
+};
+
+static std::string Numbered(std::string const &prefix, std::uint64_t number) {
+  std::ostringstream name{};
+  name << prefix << std::setw(5) << std::setfill('0') << number;
+  return name.str();
+}
+
+/**
+ * @brief Many files of at most 1 KiB, a thousand per directory
+ */
+static Corpus TinyFiles(fs::path const &workDirectory, std::uint64_t scale) {
+  CorpusWriter writer("tiny", workDirectory);
+  auto count = 200 * scale;
+  for (std::uint64_t index = 0; index < count; index++) {
+    auto directory = Numbered("d", index / 1000);
+    if (index % 1000 == 0)
+      writer.AddDirectory(directory);
+    writer.AddFile(directory + "/" + Numbered("f", index),
+                   writer.Uniform(0, KIB));
+  }
+  return writer.Finish();
+}
+
+/**
+ * @brief A few files of hundreds of megabytes
+ */
+static Corpus HugeFiles(fs::path const &workDirectory, std::uint64_t scale) {
+  CorpusWriter writer("huge", workDirectory);
+  for (std::uint64_t index = 0; index < 2; index++)
+    writer.AddFile(Numbered("huge", index), 128 * MIB * scale / 100);
+  return writer.Finish();
+}
+
+/**
+ * @brief A chain of nested directories with a few small files on each level
+ */
+static Corpus DeepTree(fs::path const &workDirectory, std::uint64_t scale) {
+  CorpusWriter writer("deep", workDirectory);
+  std::string directory{};
+  for (std::uint64_t level = 0; level < 64; level++) {
+    directory += (level ? "/" : "") + Numbered("l", level);
+    writer.AddDirectory(directory);
+    for (std::uint64_t index = 0; index < std::max<std::uint64_t>(scale / 10, 1);
+         index++)
+      writer.AddFile(directory + "/" + Numbered("f", index),
+                     writer.Uniform(0, 16 * KIB));
+  }
+  return writer.Finish();
+}
+
+/**
+ * @brief Sizes spread evenly on a logarithmic scale from 1 byte to 4 MiB
+ */
+static Corpus MixedSizes(fs::path const &workDirectory, std::uint64_t scale) {
+  CorpusWriter writer("mixed", workDirectory);
+  auto count = 5 * scale;
+  for (std::uint64_t index = 0; index < count; index++) {
+    auto exponent = static_cast<double>(writer.Uniform(0, 22000)) / 1000.0;
+    writer.AddFile(Numbered("m", index),
+                   static_cast<std::uint64_t>(std::exp2(exponent)));
+  }
+  return writer.Finish();
+}
+
+/**
+ * @brief Time the fastest of several runs of an operation
+ */
+static Result<double> Time(std::uint32_t repetitions,
+                           std::function<Status()> const &prepare,
+                           std::function<Status()> const &operation) {
+  auto best = std::chrono::duration<double>::max();
+  for (std::uint32_t run = 0; run < repetitions; run++) {
+    BOOST_LEAF_CHECK(prepare());
+    auto start = std::chrono::steady_clock::now();
+    BOOST_LEAF_CHECK(operation());
+    best = std::min<std::chrono::duration<double>>(
+        best, std::chrono::steady_clock::now() - start);
+  }
+  return {best.count()};
+}
+
+static Status NoPreparation() { return Success(); }
+
+/**
+ * @brief Measure archive creation, listing and extraction of a corpus
+ */
+static Status BenchmarkCorpus(Corpus const &corpus,
+                              fs::path const &workDirectory,
+                              std::uint32_t jobs, std::uint32_t repetitions,
+                              std::vector<Measurement> &measurements) {
+  auto tarFilePath = (workDirectory / (corpus.name + ".tar")).string();
+  auto outputDirectory = workDirectory / (corpus.name + "-extracted");
+  auto members = corpus.files.size();
+
+  // Extraction does not create directories, so the tree is laid out up front
+  auto prepareExtract = [&]() -> Status {
+    fs::remove_all(outputDirectory);
+    for (auto const &directory : corpus.directories)
+      fs::create_directories(outputDirectory / directory);
+    fs::create_directories(outputDirectory);
+    fs::current_path(outputDirectory);
+    return Success();
+  };
+  auto enterCorpus = [&]() -> Status {
+    fs::current_path(corpus.root);
+    return Success();
+  };
+
+  std::vector<std::uint32_t> jobCounts{1};
+  if (jobs > 1)
+    jobCounts.push_back(jobs);
+
+  for (auto jobCount : jobCounts) {
+    FileHandler handler(tarFilePath, {.jobs = jobCount});
+
+    BOOST_LEAF_AUTO(compress, Time(repetitions, enterCorpus, [&]() {
+                      return handler.Compress(corpus.files);
+                    }));
+    measurements.push_back(
+        {"compress", corpus.name, jobCount, compress, corpus.bytes, members});
+
+    BOOST_LEAF_AUTO(list, Time(repetitions, NoPreparation, [&]() -> Status {
+                      BOOST_LEAF_AUTO(reader, handler.ReadContents());
+                      for (auto &member : reader)
+                        BOOST_LEAF_CHECK(member);
+                      return Success();
+                    }));
+    measurements.push_back(
+        {"list", corpus.name, jobCount, list, corpus.bytes, members});
+
+    BOOST_LEAF_AUTO(extract, Time(repetitions, prepareExtract,
+                                  [&]() { return handler.Extract(); }));
+    measurements.push_back(
+        {"extract", corpus.name, jobCount, extract, corpus.bytes, members});
+  }
+
+  fs::current_path(workDirectory);
+  fs::remove_all(outputDirectory);
+  fs::remove(tarFilePath);
+  return Success();
+}
+
+/**
+ * @brief Measure the header routines on an in-memory run of headers
+ */
+static Status BenchmarkHeaders(std::uint64_t scale, std::uint32_t repetitions,
+                               std::vector<Measurement> &measurements) {
+  auto count = 1000 * scale;
+  std::vector<char> blocks(count * detail::BLOCK_SIZE_B);
+  auto bytes = blocks.size();
+  auto blockAt = [&](std::uint64_t index) {
+    return std::span<char>(blocks).subspan(index * detail::BLOCK_SIZE_B,
+                                           detail::BLOCK_SIZE_B);
+  };
+
+  BOOST_LEAF_AUTO(serialise, Time(repetitions, NoPreparation, [&]() -> Status {
+                    common::ObjectHeader header{.fileMode = 0644};
+                    for (std::uint64_t index = 0; index < count; index++) {
+                      header.fileName = Numbered("header", index);
+                      header.fileSize = index;
+                      BOOST_LEAF_CHECK(
+                          detail::SerialiseHeader(header, blockAt(index)));
+                    }
+                    return Success();
+                  }));
+  measurements.push_back({"serialise-header", "headers", 1, serialise, bytes,
+                          count});
+
+  BOOST_LEAF_AUTO(parse, Time(repetitions, NoPreparation, [&]() -> Status {
+                    for (std::uint64_t index = 0; index < count; index++)
+                      BOOST_LEAF_CHECK(detail::ParseHeader(blockAt(index)));
+                    return Success();
+                  }));
+  measurements.push_back({"parse-header", "headers", 1, parse, bytes, count});
+
+  BOOST_LEAF_AUTO(checksum, Time(repetitions, NoPreparation, [&]() -> Status {
+                    if (detail::FindInvalidChecksum(blocks) != count)
+                      return NewError(error::InvalidChecksum{});
+                    return Success();
+                  }));
+  measurements.push_back(
+      {"verify-checksums", "headers", 1, checksum, bytes, count});
+  return Success();
+}
+
+static void WriteJson(std::ostream &os, std::uint64_t scale,
+                      std::uint32_t repetitions,
+                      std::vector<Measurement> const &measurements) {
+  os << std::fixed << std::setprecision(6);
+  os << "{\n  \"scale\": " << scale << ",\n  \"repetitions\": " << repetitions
+     << ",\n  \"results\": [";
+  for (std::size_t index = 0; index < measurements.size(); index++) {
+    auto const &result = measurements[index];
+    auto seconds = std::max(result.seconds, 1e-9);
+    os << (index ? "," : "") << "\n    {\"benchmark\": \"" << result.benchmark
+       << "\", \"corpus\": \"" << result.corpus
+       << "\", \"jobs\": " << result.jobs << ", \"seconds\": " << seconds
+       << ", \"bytes\": " << result.bytes
+       << ", \"members\": " << result.members
+       << ", \"mb_per_s\": " << result.bytes / seconds / 1e6
+       << ", \"members_per_s\": " << result.members / seconds << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+extern "C" int main(int argc, const char *argv[]) {
+  using namespace svgys::program_options;
+
+  OptionsParser parser{};
+  parser.AddOptions()("help", "show man page")(
+      "scale", "<percent>", "corpus size relative to the default, 100")(
+      "jobs", "<count>", "worker threads of the parallel runs, 4")(
+      "repetitions", "<count>", "runs per benchmark, the fastest counts, 3")(
+      "workdir", "<directory>", "where corpora are generated")(
+      "output", "<filepath>", "write the JSON results to a file");
+
+  return boost::leaf::try_handle_all(
+      [&]() -> Result<int> {
+        BOOST_LEAF_AUTO(options, parser.Parse(argc, argv));
+        if (options.Contains("help")) {
+          std::cout << "Usage:\n";
+          std::cout << parser.Description();
+          return 0;
+        }
+
+        auto intOption = [&](std::string const &flag,
+                             int fallback) -> Result<std::uint32_t> {
+          if (!options.Contains(flag))
+            return {static_cast<std::uint32_t>(fallback)};
+          BOOST_LEAF_AUTO(value, options.AtAs<int>(flag));
+          if (value < 1)
+            return NewError(svgys::program_options::error::InvalidArgs{});
+          return {static_cast<std::uint32_t>(value)};
+        };
+        BOOST_LEAF_AUTO(scale, intOption("scale", 100));
+        BOOST_LEAF_AUTO(jobs, intOption("jobs", 4));
+        BOOST_LEAF_AUTO(repetitions, intOption("repetitions", 3));
+
+        auto workDirectory = fs::temp_directory_path() / "cc-tar-bench";
+        if (options.Contains("workdir")) {
+          BOOST_LEAF_AUTO(path, options.AtAs<std::string>("workdir"));
+          workDirectory = fs::absolute(path);
+        }
+        fs::create_directories(workDirectory);
+
+        std::vector<Measurement> measurements{};
+        for (auto generate : {TinyFiles, HugeFiles, DeepTree, MixedSizes}) {
+          auto corpus = generate(workDirectory, scale);
+          std::cerr << "Benchmarking corpus " << corpus.name << " ("
+                    << corpus.files.size() << " files, " << corpus.bytes
+                    << "B)\n";
+          BOOST_LEAF_CHECK(BenchmarkCorpus(corpus, workDirectory, jobs,
+                                           repetitions, measurements));
+          fs::remove_all(corpus.root);
+        }
+        BOOST_LEAF_CHECK(BenchmarkHeaders(scale, repetitions, measurements));
+
+        if (options.Contains("output")) {
+          BOOST_LEAF_AUTO(outputPath, options.AtAs<std::string>("output"));
+          std::ofstream output(outputPath);
+          WriteJson(output, scale, repetitions, measurements);
+        } else {
+          WriteJson(std::cout, scale, repetitions, measurements);
+        }
+        return 0;
+      },
+      [&](svgys::program_options::error::InvalidFlag) -> int {
+        std::cerr << "Invalid flag was passed!\nUsage:\n"
+                  << parser.Description();
+        return error::InvalidProgramArgs::CODE;
+      },
+      [&](svgys::program_options::error::InvalidArgs) -> int {
+        std::cerr << "Invalid argument(s) were passed!\nUsage:\n"
+                  << parser.Description();
+        return error::InvalidProgramArgs::CODE;
+      },
+      [](error::InvalidStream err) -> int {
+        std::cerr << "Benchmark failed on " << err.fileName << "!\n";
+        return error::InvalidStream::CODE;
+      },
+      []() -> int {
+        std::cerr << "Benchmark failed!\n";
+        return error::UnexpectedError::CODE;
+      });
+}
+
+} // namespace cc::tar::bench
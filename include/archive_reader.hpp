@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "common.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar {
+using namespace svgys::error;
+
+/**
+ * @brief Lazy range over the member headers of an archive
+ *
+ * Headers are read one at a time while iterating and member data is skipped,
+ * so memory use does not grow with the number of members. An up to date
+ * sidecar index is read instead of the archive, in which case only the name,
+ * size and mode of the members are filled in.
+ *
+ * Every element is a result, a failure ends the range after being yielded:
+ * @code
+ * for (auto &member : reader) {
+ *   BOOST_LEAF_AUTO(header, member);
+ *   ...
+ * }
+ * @endcode
+ */
+class ArchiveReader {
+  struct State;
+
+public:
+  /**
+   * @brief Single pass iterator, advancing it reads the next header
+   */
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Result<common::ObjectHeader>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type *;
+    using reference = value_type &;
+
+    Iterator() = default;
+    explicit Iterator(ArchiveReader *reader) : mReader(reader) {}
+
+    [[nodiscard]] reference operator*() const;
+    [[nodiscard]] pointer operator->() const { return &**this; }
+
+    Iterator &operator++();
+    void operator++(int) { ++*this; }
+
+    [[nodiscard]] bool operator==(Iterator const &) const = default;
+
+  private:
+    ArchiveReader *mReader{nullptr};
+  };
+
+  ArchiveReader(ArchiveReader &&) noexcept;
+  ArchiveReader &operator=(ArchiveReader &&) noexcept;
+  ~ArchiveReader();
+
+  /**
+   * @brief Open the archive at the provided path without reading any header
+   */
+  [[nodiscard]] static Result<ArchiveReader>
+  Open(std::string const &tarFilePath) noexcept;
+
+  /**
+   * @brief Iterator at the current member, reading the first header on the
+   * first call
+   */
+  [[nodiscard]] Iterator begin();
+
+  [[nodiscard]] Iterator end() { return {}; }
+
+private:
+  explicit ArchiveReader(std::unique_ptr<State> state);
+
+  void Advance();
+
+  std::unique_ptr<State> mState;
+};
+
+} // namespace cc::tar
@@ -17,7 +17,7 @@ using FILE_SIZE = helpers::Field<124, 12, helpers::Octal_t>;
 
 using LAST_MODIFIED = helpers::Field<136, 12, helpers::Octal_t>;
 
-using CHECKSUM = helpers::Field<148, 12, helpers::Octal_t>;
+using CHECKSUM = helpers::Field<148, 8, helpers::Octal_t>;
 
 /**
  * @brief Set of values for \ref LINK_INDICATOR
@@ -26,6 +26,15 @@ enum class LinkIndicator : char {
   NORMAL_FILE = '0',
   HARD_LINK = '1',
   SYMBOLIC_LINK = '2',
+  DIRECTORY = '5',
+  // Vendor specific, marks a path removed since the previous incremental
+  // archive, other tar programs extract it as an empty file
+  DELETED = 'R',
+  // Extension headers, their data holds values for the member that follows
+  PAX_HEADER = 'x',
+  PAX_GLOBAL_HEADER = 'g',
+  GNU_LONG_NAME = 'L',
+  GNU_LONG_LINK = 'K',
 };
 
 using LINK_INDICATOR =
@@ -42,9 +51,15 @@ struct ObjectHeader {
 
   std::uint64_t userID;
   std::uint64_t groupID;
+  // Seconds since the epoch, zero for archives that do not record it
+  std::uint64_t lastModified;
 
   LinkIndicator linkIndicator;
   std::string linkedFileName;
+
+  // Size of the file restored from a sparse member, whose data holds a map of
+  // the data extents followed by their contents. Zero for other members
+  std::uint64_t sparseSize;
 };
 
 } // namespace cc::tar::common
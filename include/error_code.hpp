@@ -40,6 +40,11 @@ struct InvalidChecksum {
   static constexpr int CODE = -7;
 };
 
+struct MemberNotFound {
+  static constexpr int CODE = -8;
+  std::string fileName;
+};
+
 struct UnexpectedError {
   static constexpr int CODE = -99;
 };
@@ -4,29 +4,133 @@
 #include <string>
 #include <vector>
 
+#include "archive_reader.hpp"
 #include "common.hpp"
+#include "header_table.hpp"
+#include "member_reader.hpp"
 #include "svgys/error.hpp"
 
 namespace cc::tar {
 using namespace svgys::error;
 
+// Largest number of blocks per record, 4 MiB records as in bsdtar
+static constexpr std::uint32_t MAX_BLOCKING_FACTOR = 8192;
+
+/**
+ * @brief Tuning options shared by all archive operations
+ */
+struct HandlerOptions {
+  // Number of worker threads, a single job keeps every operation sequential
+  std::uint32_t jobs = 1;
+  // Write a sidecar index next to archives created by FileHandler::Compress
+  bool buildIndex = false;
+  // Keep the writes of extracted files in flight on io_uring when the kernel
+  // supports it, otherwise every file is written with blocking calls
+  bool asyncIo = true;
+  // Number of 512 byte blocks per record, created archives are padded to a
+  // whole record and written in multiples of it. At most
+  // \ref MAX_BLOCKING_FACTOR
+  std::uint32_t blockingFactor = 20;
+  // Add the contents of directories in a depth first walk ordered by name,
+  // instead of as the directories are read. Only sorted archives are
+  // reproducible, otherwise the order may change between runs
+  bool sortEntries = false;
+  // Snapshot file of an incremental backup, FileHandler::Compress leaves out
+  // files unchanged since the snapshot was taken and records the new state in
+  // it. Empty to archive every file
+  std::string snapshotPath{};
+};
+
 class FileHandler {
 public:
-  FileHandler(std::string tarFilePath) : mTarFilePath(tarFilePath) {}
+  FileHandler(std::string tarFilePath, HandlerOptions options = {})
+      : mTarFilePath(tarFilePath), mOptions(options) {}
 
   [[nodiscard]] bool IsValid() noexcept;
 
-  [[nodiscard]] Result<std::vector<common::ObjectHeader>>
-  ListContents() noexcept;
+  /**
+   * @brief Lazily read the members of the archive, one header at a time
+   */
+  [[nodiscard]] Result<ArchiveReader> ReadContents() noexcept;
+
+  /**
+   * @brief Open the archive for reading the data of members by name, in
+   * place and from any number of threads
+   */
+  [[nodiscard]] Result<MemberReader> OpenMembers() noexcept;
+
+  /**
+   * @brief List the members of the archive
+   *
+   * An up to date sidecar index is used instead of scanning the archive, in
+   * which case only the name, size and mode of the members are filled in.
+   * The headers are kept in a column store, prefer \ref ReadContents when
+   * they do not have to be held at once.
+   */
+  [[nodiscard]] Result<common::HeaderTable> ListContents() noexcept;
 
-  [[nodiscard]] Status Extract() noexcept;
+  /**
+   * @brief Extract the members matching the provided names or glob patterns,
+   * or all members if none are provided
+   *
+   * Members that are not selected are skipped without reading their data.
+   * A name matching several members extracts the last one, as tar does, and
+   * when only names are requested an up to date sidecar index is used to
+   * locate them without a scan.
+   */
+  [[nodiscard]] Status Extract(std::vector<std::string> patterns = {}) noexcept;
 
+  /**
+   * @brief Check the headers, padding and end-of-archive marker of the
+   * archive without extracting anything
+   *
+   * Headers are located in a scan that hops over the member data, the checks
+   * are then split over the worker threads by archive range.
+   */
+  [[nodiscard]] Status Verify() noexcept;
+
+  /**
+   * @brief Write the sidecar index of an existing archive
+   */
+  [[nodiscard]] Status BuildIndex() noexcept;
+
+  /**
+   * @brief Create the archive from the provided files and directories
+   *
+   * Directories are added recursively, each followed by its contents. They
+   * are read on a pool of worker threads while members are written.
+   *
+   * With a snapshot file in the options, only files whose device, inode, size
+   * or modification time changed since the previous run are archived, along
+   * with all directories. The archive starts with a deletion marker for every
+   * path that disappeared or changed between file and directory, so the walk
+   * completes before the first member is written. A missing snapshot file
+   * starts a full backup.
+   */
   [[nodiscard]] Status Compress(std::vector<std::string> filePaths) noexcept;
 
+  /**
+   * @brief Add files and directories to the end of an existing uncompressed
+   * archive, as tar -r does, creating it if it does not exist
+   *
+   * Only the headers are read to find the end-of-archive marker, which the
+   * new members overwrite in place, so the cost does not grow with the data
+   * already archived.
+   */
+  [[nodiscard]] Status Append(std::vector<std::string> filePaths) noexcept;
+
+  /**
+   * @brief Like \ref Append, but leave out files the archive holds with the
+   * same or a later modification time, as tar -u does
+   */
+  [[nodiscard]] Status Update(std::vector<std::string> filePaths) noexcept;
+
 private:
-  static constexpr std::uint64_t CHUNK_SIZE_B = 512;
+  [[nodiscard]] Status AddMembers(std::vector<std::string> filePaths,
+                                  bool update) noexcept;
 
   std::string mTarFilePath;
+  HandlerOptions mOptions;
 };
 
 } // namespace cc::tar
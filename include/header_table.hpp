@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+
+namespace cc::tar::common {
+
+/**
+ * @brief Non-owning row of a \ref HeaderTable, names point into the table's
+ * name pool
+ */
+struct HeaderRow {
+  std::string_view fileName;
+  std::uint64_t fileSize;
+  std::uint64_t fileMode;
+
+  std::uint64_t userID;
+  std::uint64_t groupID;
+
+  LinkIndicator linkIndicator;
+  std::string_view linkedFileName;
+
+  [[nodiscard]] ObjectHeader ToHeader() const {
+    return {.fileName = std::string(fileName),
+            .fileSize = fileSize,
+            .fileMode = fileMode,
+            .userID = userID,
+            .groupID = groupID,
+            .linkIndicator = linkIndicator,
+            .linkedFileName = std::string(linkedFileName)};
+  }
+};
+
+/**
+ * @brief Column store of member headers for large listings
+ *
+ * All names are appended to a single pool and every numeric field lives in
+ * its own column, so adding a member does not allocate on its own and memory
+ * use is close to the size of the names plus a fixed amount per member.
+ * Views returned by the table are invalidated by adding members.
+ */
+class HeaderTable {
+public:
+  /**
+   * @brief Random access iterator yielding rows by value
+   */
+  class Iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = HeaderRow;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = HeaderRow;
+
+    Iterator() = default;
+    Iterator(HeaderTable const *table, std::size_t index)
+        : mTable(table), mIndex(index) {}
+
+    [[nodiscard]] reference operator*() const { return (*mTable)[mIndex]; }
+    [[nodiscard]] reference operator[](difference_type offset) const {
+      return *(*this + offset);
+    }
+
+    Iterator &operator++() { return *this += 1; }
+    Iterator operator++(int) {
+      auto previous = *this;
+      ++*this;
+      return previous;
+    }
+    Iterator &operator--() { return *this -= 1; }
+    Iterator operator--(int) {
+      auto previous = *this;
+      --*this;
+      return previous;
+    }
+    Iterator &operator+=(difference_type offset) {
+      mIndex += offset;
+      return *this;
+    }
+    Iterator &operator-=(difference_type offset) {
+      mIndex -= offset;
+      return *this;
+    }
+
+    [[nodiscard]] friend Iterator operator+(Iterator it,
+                                            difference_type offset) {
+      return it += offset;
+    }
+    [[nodiscard]] friend Iterator operator+(difference_type offset,
+                                            Iterator it) {
+      return it += offset;
+    }
+    [[nodiscard]] friend Iterator operator-(Iterator it,
+                                            difference_type offset) {
+      return it -= offset;
+    }
+    [[nodiscard]] friend difference_type operator-(Iterator const &a,
+                                                   Iterator const &b) {
+      return static_cast<difference_type>(a.mIndex) -
+             static_cast<difference_type>(b.mIndex);
+    }
+
+    [[nodiscard]] bool operator==(Iterator const &other) const {
+      return mIndex == other.mIndex;
+    }
+    [[nodiscard]] auto operator<=>(Iterator const &other) const {
+      return mIndex <=> other.mIndex;
+    }
+
+  private:
+    HeaderTable const *mTable{nullptr};
+    std::size_t mIndex{0};
+  };
+
+  /**
+   * @brief Reserve room for a number of members and bytes of names
+   */
+  void Reserve(std::size_t members, std::size_t nameBytes);
+
+  void Add(HeaderRow const &row);
+
+  void Add(ObjectHeader const &header);
+
+  /**
+   * @brief Order the members by name, members sharing a name keep their
+   * archive order
+   */
+  void SortByName();
+
+  [[nodiscard]] HeaderRow operator[](std::size_t index) const;
+
+  [[nodiscard]] std::size_t Size() const { return mFileSizes.size(); }
+
+  [[nodiscard]] bool Empty() const { return mFileSizes.empty(); }
+
+  /**
+   * @brief Heap memory reserved by the table
+   */
+  [[nodiscard]] std::size_t Capacity() const;
+
+  [[nodiscard]] Iterator begin() const { return {this, 0}; }
+
+  [[nodiscard]] Iterator end() const { return {this, Size()}; }
+
+private:
+  /**
+   * @brief Location of a name in the name pool
+   */
+  struct NameRef {
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  [[nodiscard]] NameRef Intern(std::string_view name);
+
+  [[nodiscard]] std::string_view NameOf(NameRef const &ref) const {
+    return {mNames.data() + ref.offset, ref.size};
+  }
+
+  std::vector<char> mNames{};
+  std::vector<NameRef> mFileNames{};
+  std::vector<std::uint64_t> mFileSizes{};
+  std::vector<std::uint64_t> mFileModes{};
+  std::vector<std::uint64_t> mUserIDs{};
+  std::vector<std::uint64_t> mGroupIDs{};
+  std::vector<LinkIndicator> mLinkIndicators{};
+  std::vector<NameRef> mLinkedFileNames{};
+};
+
+} // namespace cc::tar::common
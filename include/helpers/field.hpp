@@ -7,12 +7,14 @@ namespace cc::tar::helpers {
 using namespace svgys::error;
 
 template <typename T>
-concept FieldValueType = requires(std::span<char> span) {
+concept FieldValueType = requires(std::span<char> span,
+                                  std::span<const char> constSpan) {
   typename T::value_type;
   {
     T::Serialise(std::declval<typename T::value_type>(), span)
   } -> std::same_as<Status>;
-  { T::Parse(span) } -> std::same_as<Result<typename T::value_type>>;
+  { T::Parse(constSpan) } -> std::same_as<Result<typename T::value_type>>;
+  { T::View(constSpan) } -> std::same_as<typename T::view_type>;
 };
 
 template <typename T>
@@ -43,11 +45,27 @@ struct Field {
  * @returns the value of the field if valid, 'NewError{}' otherwise
  */
 template <FieldType Field>
-[[nodiscard]] Result<typename Field::value_type> Read(std::span<char> buffer) {
-  std::span<char> fieldBuffer(&buffer[Field::offset], Field::size);
+[[nodiscard]] Result<typename Field::value_type>
+Read(std::span<const char> buffer) {
+  std::span<const char> fieldBuffer(&buffer[Field::offset], Field::size);
   return Field::field_type::Parse(fieldBuffer);
 }
 
+/**
+ * @brief Decode the specified field without copying it out of the tar object
+ * header buffer
+ * @tparam Field the field of which the value should be viewed
+ * @param buffer the buffer that contains the tar object header
+ * @returns a view into the buffer for string fields, the decoded value
+ * otherwise
+ */
+template <FieldType Field>
+[[nodiscard]] typename Field::field_type::view_type
+View(std::span<const char> buffer) {
+  std::span<const char> fieldBuffer(&buffer[Field::offset], Field::size);
+  return Field::field_type::View(fieldBuffer);
+}
+
 /**
  * @brief Write the provided value to the specified field of the tar object
  * header buffer
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <charconv>
 #include <cstdint>
+#include <limits>
 #include <span>
 #include <string>
+#include <string_view>
 
 #include "error_code.hpp"
 #include "svgys/error.hpp"
@@ -13,6 +16,7 @@ using namespace svgys::error;
 
 struct String_t {
   using value_type = std::string;
+  using view_type = std::string_view;
 
   static Status Serialise(value_type value, std::span<char> buffer) {
     if (value.size() + 1 > buffer.size())
@@ -21,24 +25,52 @@ struct String_t {
     return Success();
   }
 
-  static Result<value_type> Parse(std::span<char> buffer) {
-    return {{buffer.data()}};
+  static Result<value_type> Parse(std::span<const char> buffer) {
+    return {value_type(View(buffer))};
+  }
+
+  static view_type View(std::span<const char> buffer) {
+    // Names that fill the whole field are not null-terminated
+    auto end = std::find(buffer.begin(), buffer.end(), '\0');
+    return {buffer.data(), static_cast<std::size_t>(end - buffer.begin())};
   }
 };
 
+/**
+ * @brief Numeric field, written in octal with a terminating null character
+ * when the value fits and in the base-256 encoding of GNU tar otherwise
+ *
+ * Base-256 values set the high bit of the first byte and store the number big
+ * endian in the remaining bytes, so 12 byte fields hold any 64 bit size.
+ */
 struct Octal_t {
   using value_type = std::uint64_t;
+  using view_type = Result<value_type>;
+
+  static constexpr unsigned char BASE_256_FLAG = 0x80;
 
   static Status Serialise(value_type value, std::span<char> buffer) {
-    auto [ptr, ec] =
-        std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, 8);
-    if (ec != std::errc()) {
-      return NewError(error::InvalidConversion{});
+    // The last byte is kept for the terminator
+    auto [ptr, ec] = std::to_chars(
+        buffer.data(), buffer.data() + buffer.size() - 1, value, 8);
+    if (ec == std::errc())
+      return Success();
+
+    std::fill(buffer.begin(), buffer.end(), '\0');
+    for (auto it = buffer.rbegin(); it != buffer.rend() - 1; ++it) {
+      *it = static_cast<char>(value & 0xff);
+      value >>= 8;
     }
+    if (value != 0)
+      return NewError(error::InvalidConversion{});
+    buffer[0] = static_cast<char>(BASE_256_FLAG);
     return Success();
   }
 
-  static Result<value_type> Parse(std::span<char> buffer) {
+  static Result<value_type> Parse(std::span<const char> buffer) {
+    if (static_cast<unsigned char>(buffer[0]) & BASE_256_FLAG)
+      return ParseBase256(buffer);
+
     value_type result{};
     auto [ptr, ec] = std::from_chars(buffer.data(),
                                      buffer.data() + buffer.size(), result, 8);
@@ -47,6 +79,24 @@ struct Octal_t {
     }
     return {result};
   }
+
+  static view_type View(std::span<const char> buffer) { return Parse(buffer); }
+
+private:
+  static Result<value_type> ParseBase256(std::span<const char> buffer) {
+    // Negative numbers, flagged by the second highest bit, are not valid here
+    auto first = static_cast<unsigned char>(buffer[0]);
+    if (first & 0x40)
+      return NewError(error::InvalidConversion{});
+
+    value_type result = first & 0x3f;
+    for (auto byte : buffer.subspan(1)) {
+      if (result > (std::numeric_limits<value_type>::max() >> 8))
+        return NewError(error::InvalidConversion{});
+      result = result << 8 | static_cast<unsigned char>(byte);
+    }
+    return {result};
+  }
 };
 
 template <typename T>
@@ -57,15 +107,19 @@ concept EnumClassConvertibleToCharType =
 template <EnumClassConvertibleToCharType T>
 struct EnumClass_t {
   using value_type = T;
+  using view_type = T;
 
   static Status Serialise(value_type value, std::span<char> buffer) {
     buffer[0] = static_cast<char>(value);
     return Success();
   }
 
-  static Result<value_type> Parse(std::span<char> buffer) {
-    value_type result = static_cast<value_type>(buffer[0]);
-    return {result};
+  static Result<value_type> Parse(std::span<const char> buffer) {
+    return {View(buffer)};
+  }
+
+  static view_type View(std::span<const char> buffer) {
+    return static_cast<value_type>(buffer[0]);
   }
 };
 
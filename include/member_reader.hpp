@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "svgys/error.hpp"
+
+namespace cc::tar {
+using namespace svgys::error;
+
+/**
+ * @brief Random access to the data of archive members by name, without
+ * extracting them
+ *
+ * The archive is opened once and its members are located through an up to
+ * date sidecar index, or with a single scan over the headers otherwise. Only
+ * archives that support random access can be opened, which are uncompressed
+ * archives in a regular file and zstd archives with a seek table.
+ *
+ * Lookups and reads do not change the reader, so a single reader can serve
+ * members to any number of threads at once. Names resolve to the last member
+ * with that name, as extraction would leave it. Links, directories and
+ * deletion markers have no data.
+ */
+class MemberReader {
+  struct State;
+
+public:
+  /**
+   * @brief Read position over the data of a single member
+   *
+   * Data is copied out of the archive on demand, holes of sparse members read
+   * as zeros. A stream must not outlive the reader it was opened from, and
+   * each stream is used by one thread at a time, although any number of them
+   * may read the same member.
+   */
+  class Stream {
+  public:
+    [[nodiscard]] std::uint64_t Size() const { return mSize; }
+
+    [[nodiscard]] std::uint64_t Offset() const { return mOffset; }
+
+    /**
+     * @brief Move the read position, offsets past the end are clamped to it
+     */
+    void Seek(std::uint64_t offset) { mOffset = std::min(offset, mSize); }
+
+    /**
+     * @brief Read from the current position and move past the bytes read
+     * @returns the number of bytes read, 0 at the end of the member
+     */
+    [[nodiscard]] Result<std::size_t> Read(std::span<char> buffer);
+
+    /**
+     * @brief Read from an offset of the member, leaving the position as is
+     * @returns the number of bytes read, less than the buffer size only at
+     * the end of the member
+     */
+    [[nodiscard]] Result<std::size_t> ReadAt(std::uint64_t offset,
+                                             std::span<char> buffer) const;
+
+  private:
+    friend class MemberReader;
+
+    // Part of the member data stored in one piece in the archive
+    struct Extent {
+      std::uint64_t offset;
+      std::uint64_t size;
+      std::uint64_t archiveOffset;
+    };
+
+    Stream(State const *state, std::uint64_t size, std::vector<Extent> extents)
+        : mState(state), mSize(size), mExtents(std::move(extents)) {}
+
+    State const *mState;
+    std::uint64_t mSize;
+    std::uint64_t mOffset{0};
+    std::vector<Extent> mExtents;
+  };
+
+  MemberReader(MemberReader &&) noexcept;
+  MemberReader &operator=(MemberReader &&) noexcept;
+  ~MemberReader();
+
+  /**
+   * @brief Open the archive at the provided path and locate its members
+   */
+  [[nodiscard]] static Result<MemberReader>
+  Open(std::string const &tarFilePath) noexcept;
+
+  [[nodiscard]] bool Contains(std::string_view fileName) const noexcept;
+
+  /**
+   * @brief View the data of a member in place, valid for the lifetime of the
+   * reader
+   *
+   * Only members stored in one piece in a memory mapped archive can be
+   * viewed, use \ref OpenMember for compressed archives and sparse members.
+   */
+  [[nodiscard]] Result<std::span<const char>>
+  View(std::string_view fileName) const noexcept;
+
+  /**
+   * @brief Open a stream over the data of a member, which works for members
+   * of any size and for every archive the reader can open
+   */
+  [[nodiscard]] Result<Stream>
+  OpenMember(std::string_view fileName) const noexcept;
+
+private:
+  explicit MemberReader(std::unique_ptr<State> state);
+
+  std::unique_ptr<State> mState;
+};
+
+} // namespace cc::tar
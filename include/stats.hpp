@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+namespace cc::tar::stats {
+
+/**
+ * @brief Phases whose time is measured, each excluding the time of the phases
+ * nested inside it
+ *
+ * Apart from the header phases, every timed call is a system call or a short
+ * loop of the same system call.
+ */
+enum class Phase : std::size_t {
+  HEADER_PARSE,
+  HEADER_SERIALISE,
+  CHECKSUM,
+  // Reads and writes of the archive file. Reads of a memory mapped archive
+  // happen in page faults and are only counted in bytes. Copies inside the
+  // kernel are timed as I/O of the file they write to.
+  ARCHIVE_IO,
+  // Reads of archived and writes of extracted files
+  FILE_IO,
+  FILE_OPEN,
+  FILE_CLOSE,
+  // Directory listings, stat calls and creating directories and links
+  METADATA,
+};
+static constexpr std::size_t PHASE_COUNT = 8;
+
+enum class Counter : std::size_t {
+  // Headers parsed from and written to archives, apart from extended headers
+  MEMBERS_READ,
+  MEMBERS_WRITTEN,
+  ARCHIVE_BYTES_READ,
+  ARCHIVE_BYTES_WRITTEN,
+  FILE_BYTES_READ,
+  FILE_BYTES_WRITTEN,
+};
+static constexpr std::size_t COUNTER_COUNT = 6;
+
+/**
+ * @brief Totals of all threads since statistics were enabled
+ */
+struct Report {
+  std::array<std::uint64_t, PHASE_COUNT> nanoseconds{};
+  std::array<std::uint64_t, PHASE_COUNT> calls{};
+  std::array<std::uint64_t, COUNTER_COUNT> counters{};
+  std::uint64_t elapsedNanoseconds{0};
+
+  [[nodiscard]] std::uint64_t Time(Phase phase) const {
+    return nanoseconds[static_cast<std::size_t>(phase)];
+  }
+
+  [[nodiscard]] std::uint64_t Calls(Phase phase) const {
+    return calls[static_cast<std::size_t>(phase)];
+  }
+
+  [[nodiscard]] std::uint64_t Count(Counter counter) const {
+    return counters[static_cast<std::size_t>(counter)];
+  }
+
+  /**
+   * @brief Number of timed calls of the phases made of system calls
+   */
+  [[nodiscard]] std::uint64_t SystemCalls() const;
+
+  /**
+   * @brief Archive bytes read and written per second of elapsed time
+   */
+  [[nodiscard]] double ArchiveThroughput() const;
+
+  void WriteText(std::ostream &os) const;
+
+  void WriteJson(std::ostream &os) const;
+};
+
+/**
+ * @brief Start collecting statistics, which costs a clock read per timed call
+ * from then on
+ */
+void Enable();
+
+[[nodiscard]] bool Enabled();
+
+/**
+ * @brief Merge the counters of all threads, including those that exited
+ */
+[[nodiscard]] Report Collect();
+
+/**
+ * @brief Print a line of progress to a stream at a fixed interval, for as
+ * long as the printer exists
+ */
+class ProgressPrinter {
+public:
+  ProgressPrinter(std::ostream &os, std::chrono::milliseconds interval);
+  ProgressPrinter(ProgressPrinter const &) = delete;
+  ProgressPrinter &operator=(ProgressPrinter const &) = delete;
+  ~ProgressPrinter();
+
+private:
+  void Run();
+
+  std::ostream &mStream;
+  std::chrono::milliseconds mInterval;
+  std::mutex mMutex{};
+  std::condition_variable mStopped{};
+  bool mStopping{false};
+  std::thread mThread{};
+};
+
+} // namespace cc::tar::stats
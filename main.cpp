@@ -1,16 +1,21 @@
+#include <chrono>
 #include <iostream>
+#include <optional>
 
 #include "boost/leaf/error.hpp"
 #include "boost/leaf/handle_errors.hpp"
 #include "error_code.hpp"
 #include "file_handler.hpp"
+#include "stats.hpp"
 #include "svgys/error.hpp"
 #include "svgys/program_options.hpp"
 
 namespace cc::tar {
 
 std::ostream &operator<<(std::ostream &os, const common::ObjectHeader &header) {
-  os << header.fileName << " " << header.fileSize << "B" << std::endl;
+  // Sparse members are listed with the size of the restored file
+  auto size = header.sparseSize > 0 ? header.sparseSize : header.fileSize;
+  os << header.fileName << " " << size << "B\n";
   return os;
 }
 
@@ -21,22 +26,85 @@ extern "C" int main(int argc, const char *argv[]) {
   parser.AddOptions()("help", "show man page")("list", "<tar_filepath>",
                                                "show contents of tar archive")(
       "create", "<tar_filepath> [filepaths...]",
-      "create tar archive")("extract", "<tar_filepath>", "extract tar archive");
+      "create tar archive")("append", "<tar_filepath> [filepaths...]",
+                            "add files to the end of a tar archive")(
+      "update", "<tar_filepath> [filepaths...]",
+      "add files newer than their copy in a tar archive")(
+      "extract", "<tar_filepath> [members...]",
+      "extract tar archive or the matching members")(
+      "jobs", "<count>", "number of worker threads to use")(
+      "index", "write a sidecar index when creating a tar archive")(
+      "build-index", "<tar_filepath>",
+      "write the sidecar index of an existing tar archive")(
+      "verify", "<tar_filepath>",
+      "check the headers and structure of a tar archive without extracting")(
+      "blocking-io", "write extracted files without io_uring")(
+      "blocking-factor", "<count>",
+      "number of 512 byte blocks per record of a created archive, 20 and "
+      "at most 8192")(
+      "sort",
+      "add directory contents to a created archive ordered by name, so the "
+      "archive does not depend on directory order or thread timing")(
+      "listed-incremental", "<snapshot_filepath>",
+      "create an archive of the changes since the snapshot and update it")(
+      "stats", "[text|json]",
+      "print time per phase, byte counts and system calls to stderr")(
+      "progress", "<seconds>", "print progress to stderr at this interval");
 
   return boost::leaf::try_handle_all(
       [&]() -> Result<int> {
         BOOST_LEAF_AUTO(options, parser.Parse(argc, argv));
 
+        HandlerOptions handlerOptions{};
+        if (options.Contains("jobs")) {
+          BOOST_LEAF_AUTO(jobs, options.AtAs<int>("jobs"));
+          if (jobs < 1)
+            return NewError(svgys::program_options::error::InvalidArgs{});
+          handlerOptions.jobs = static_cast<std::uint32_t>(jobs);
+        }
+        handlerOptions.buildIndex = options.Contains("index");
+        handlerOptions.asyncIo = !options.Contains("blocking-io");
+        handlerOptions.sortEntries = options.Contains("sort");
+        if (options.Contains("listed-incremental")) {
+          BOOST_LEAF_ASSIGN(handlerOptions.snapshotPath,
+                            options.AtAs<std::string>("listed-incremental"));
+        }
+        if (options.Contains("blocking-factor")) {
+          BOOST_LEAF_AUTO(factor, options.AtAs<int>("blocking-factor"));
+          if (factor < 1 || factor > static_cast<int>(MAX_BLOCKING_FACTOR))
+            return NewError(svgys::program_options::error::InvalidArgs{});
+          handlerOptions.blockingFactor = static_cast<std::uint32_t>(factor);
+        }
+
+        std::optional<std::string> statsFormat{};
+        if (options.Contains("stats")) {
+          BOOST_LEAF_AUTO(format,
+                          options.AtAs<std::vector<std::string>>("stats"));
+          statsFormat = format.empty() ? "text" : format[0];
+          if (format.size() > 1 ||
+              (statsFormat != "text" && statsFormat != "json"))
+            return NewError(svgys::program_options::error::InvalidArgs{});
+          stats::Enable();
+        }
+        std::optional<stats::ProgressPrinter> progress{};
+        if (options.Contains("progress")) {
+          BOOST_LEAF_AUTO(seconds, options.AtAs<int>("progress"));
+          if (seconds < 1)
+            return NewError(svgys::program_options::error::InvalidArgs{});
+          progress.emplace(std::cerr, std::chrono::seconds(seconds));
+        }
+
         if (options.Contains("help")) {
           std::cout << "Usage:\n";
           std::cout << parser.Description();
         } else if (options.Contains("list")) {
           BOOST_LEAF_AUTO(fileName, options.AtAs<std::string>("list"));
 
-          FileHandler handler(fileName);
-          BOOST_LEAF_AUTO(contents, handler.ListContents());
-          for (auto const &content : contents) {
-            std::cout << content;
+          FileHandler handler(fileName, handlerOptions);
+          BOOST_LEAF_AUTO(contents, handler.ReadContents());
+          for (auto &content : contents) {
+            BOOST_LEAF_CHECK(content);
+            std::cout << content.value();
           }
           std::cout << std::endl;
         } else if (options.Contains("create")) {
@@ -45,57 +113,98 @@ extern "C" int main(int argc, const char *argv[]) {
           if (files.size() < 2)
             return NewError(svgys::program_options::error::InvalidArgs{});
 
-          FileHandler handler(files[0]);
+          FileHandler handler(files[0], handlerOptions);
           BOOST_LEAF_CHECK(handler.Compress({files.begin() + 1, files.end()}));
+        } else if (options.Contains("append") || options.Contains("update")) {
+          auto update = options.Contains("update");
+          BOOST_LEAF_AUTO(files, options.AtAs<std::vector<std::string>>(
+                                     update ? "update" : "append"));
+          if (files.size() < 2)
+            return NewError(svgys::program_options::error::InvalidArgs{});
+
+          FileHandler handler(files[0], handlerOptions);
+          std::vector<std::string> filePaths(files.begin() + 1, files.end());
+          if (update) {
+            BOOST_LEAF_CHECK(handler.Update(std::move(filePaths)));
+          } else {
+            BOOST_LEAF_CHECK(handler.Append(std::move(filePaths)));
+          }
         } else if (options.Contains("extract")) {
-          BOOST_LEAF_AUTO(tarFileName, options.AtAs<std::string>("extract"));
+          BOOST_LEAF_AUTO(files,
+                          options.AtAs<std::vector<std::string>>("extract"));
+          if (files.empty())
+            return NewError(svgys::program_options::error::InvalidArgs{});
 
-          FileHandler handler(tarFileName);
-          BOOST_LEAF_CHECK(handler.Extract());
+          FileHandler handler(files[0], handlerOptions);
+          BOOST_LEAF_CHECK(handler.Extract({files.begin() + 1, files.end()}));
+        } else if (options.Contains("build-index")) {
+          BOOST_LEAF_AUTO(tarFileName,
+                          options.AtAs<std::string>("build-index"));
+
+          FileHandler handler(tarFileName, handlerOptions);
+          BOOST_LEAF_CHECK(handler.BuildIndex());
+        } else if (options.Contains("verify")) {
+          BOOST_LEAF_AUTO(tarFileName, options.AtAs<std::string>("verify"));
+
+          FileHandler handler(tarFileName, handlerOptions);
+          BOOST_LEAF_CHECK(handler.Verify());
         } else {
           std::cout << "No arguments provided!\n";
           std::cout << "Usage:\n";
           std::cout << parser.Description();
         }
+
+        progress.reset();
+        if (statsFormat) {
+          auto report = stats::Collect();
+          if (statsFormat == "json")
+            report.WriteJson(std::cerr);
+          else
+            report.WriteText(std::cerr);
+        }
         return 0;
       },
       [&](svgys::program_options::error::InvalidFlag err) -> int {
-        std::cout << "Invalid flag was passed!\n";
-        std::cout << "Usage:\n";
-        std::cout << parser.Description();
+        std::cerr << "Invalid flag was passed!\n";
+        std::cerr << "Usage:\n";
+        std::cerr << parser.Description();
         return error::InvalidProgramArgs::CODE;
       },
       [&](svgys::program_options::error::InvalidArgs err) -> int {
-        std::cout << "Invalid argument(s) were passed!\n";
-        std::cout << "Usage:\n";
-        std::cout << parser.Description();
+        std::cerr << "Invalid argument(s) were passed!\n";
+        std::cerr << "Usage:\n";
+        std::cerr << parser.Description();
         return error::InvalidProgramArgs::CODE;
       },
       [](error::InvalidFile err) -> int {
-        std::cout << err.fileName << " is not a valid file or file path!\n";
+        std::cerr << err.fileName << " is not a valid file or file path!\n";
         return error::InvalidFile::CODE;
       },
       [](error::InvalidStream err) -> int {
-        std::cout << "Unexpected error occured while "
+        std::cerr << "Unexpected error occured while "
                   << ((err.type == error::StreamType::INPUT) ? "reading from"
                                                              : "writing to")
                   << err.fileName << "! Verify the file path is correct!\n";
         return error::InvalidStream::CODE;
       },
       [](error::InvalidContents err) -> int {
-        std::cout << "tar ball contains invalid file paths!\n";
+        std::cerr << "tar ball contains invalid file paths!\n";
         return error::InvalidContents::CODE;
       },
       [](error::InvalidConversion err) -> int {
-        std::cout << "tar ball is damaged or has invalid contents!\n";
+        std::cerr << "tar ball is damaged or has invalid contents!\n";
         return error::InvalidContents::CODE;
       },
       [](error::InvalidChecksum err) -> int {
-        std::cout << "tar ball is damaged: invalid checksum!\n";
+        std::cerr << "tar ball is damaged: invalid checksum!\n";
         return error::InvalidContents::CODE;
       },
+      [](error::MemberNotFound err) -> int {
+        std::cerr << err.fileName << " was not found in the tar ball!\n";
+        return error::MemberNotFound::CODE;
+      },
       []() -> int {
-        std::cout << "Unexpected error occured!\n";
+        std::cerr << "Unexpected error occured!\n";
         return error::UnexpectedError::CODE;
       });
 }
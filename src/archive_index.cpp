@@ -0,0 +1,194 @@
+#include "archive_index.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "compression.hpp"
+#include "detail.hpp"
+#include "error_code.hpp"
+
+namespace cc::tar::detail {
+
+static constexpr std::array<char, 8> INDEX_MAGIC = {'C', 'C', 'T', 'A',
+                                                    'R', 'I', 'D', 'X'};
+static constexpr std::uint32_t INDEX_VERSION = 1;
+
+struct IndexFileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+  ArchiveStamp stamp;
+  std::uint64_t recordCount;
+  std::uint64_t namesSize;
+};
+
+Result<ArchiveStamp> ReadArchiveStamp(std::string const &path) {
+  struct stat fileInfo;
+  if (stat(path.c_str(), &fileInfo) != 0)
+    return NewError(error::InvalidFile{path});
+
+  return {ArchiveStamp{
+      .size = static_cast<std::uint64_t>(fileInfo.st_size),
+      .modifiedSeconds = static_cast<std::uint64_t>(fileInfo.st_mtim.tv_sec),
+      .modifiedNanoseconds =
+          static_cast<std::uint64_t>(fileInfo.st_mtim.tv_nsec)}};
+}
+
+void ArchiveIndex::Add(common::ObjectHeader const &header,
+                       std::uint64_t headerOffset) {
+  Add(header.fileName, header.fileSize, header.fileMode, headerOffset,
+      header.sparseSize > 0);
+}
+
+void ArchiveIndex::Add(std::string_view fileName, std::uint64_t fileSize,
+                       std::uint64_t fileMode, std::uint64_t headerOffset,
+                       bool sparse) {
+  mRecords.push_back({.nameOffset = mNames.size(),
+                      .nameSize = static_cast<std::uint32_t>(fileName.size()),
+                      .flags = sparse ? SPARSE_FLAG : 0,
+                      .headerOffset = headerOffset,
+                      .fileSize = fileSize,
+                      .fileMode = fileMode});
+  mNames.append(fileName);
+}
+
+void ArchiveIndex::Sort() {
+  std::sort(mRecords.begin(), mRecords.end(),
+            [this](Record const &a, Record const &b) {
+              auto order = NameOf(a).compare(NameOf(b));
+              return order < 0 ||
+                     (order == 0 && a.headerOffset < b.headerOffset);
+            });
+}
+
+std::optional<IndexEntry> ArchiveIndex::Find(std::string_view fileName) const {
+  // Upper bound, so duplicate names resolve to the last one in the archive
+  auto it = std::upper_bound(mRecords.begin(), mRecords.end(), fileName,
+                             [this](std::string_view name, Record const &b) {
+                               return name < NameOf(b);
+                             });
+  if (it == mRecords.begin() || NameOf(*std::prev(it)) != fileName)
+    return std::nullopt;
+  return EntryOf(*std::prev(it));
+}
+
+std::vector<IndexEntry> ArchiveIndex::Entries() const {
+  std::vector<IndexEntry> entries{};
+  entries.reserve(mRecords.size());
+  for (auto const &record : mRecords)
+    entries.push_back(EntryOf(record));
+
+  std::sort(entries.begin(), entries.end(),
+            [](IndexEntry const &a, IndexEntry const &b) {
+              return a.headerOffset < b.headerOffset;
+            });
+  return entries;
+}
+
+Status ArchiveIndex::Save(std::string const &indexPath,
+                          ArchiveStamp const &stamp) {
+  Sort();
+
+  IndexFileHeader fileHeader{.magic = INDEX_MAGIC,
+                             .version = INDEX_VERSION,
+                             .reserved = 0,
+                             .stamp = stamp,
+                             .recordCount = mRecords.size(),
+                             .namesSize = mNames.size()};
+
+  // Written next to the final path and renamed, so readers never observe a
+  // partially written index
+  auto temporaryPath = indexPath + ".tmp";
+  std::ofstream indexFile(temporaryPath, std::ios::binary);
+  if (!indexFile)
+    return NewError(
+        error::InvalidStream{temporaryPath, error::StreamType::OUTPUT});
+
+  indexFile.write(reinterpret_cast<const char *>(&fileHeader),
+                  sizeof(fileHeader));
+  indexFile.write(reinterpret_cast<const char *>(mRecords.data()),
+                  mRecords.size() * sizeof(Record));
+  indexFile.write(mNames.data(), mNames.size());
+  indexFile.close();
+  if (!indexFile || std::rename(temporaryPath.c_str(), indexPath.c_str()))
+    return NewError(
+        error::InvalidStream{indexPath, error::StreamType::OUTPUT});
+
+  return Success();
+}
+
+std::optional<ArchiveIndex> ArchiveIndex::Load(std::string const &indexPath,
+                                               ArchiveStamp const &stamp) {
+  std::ifstream indexFile(indexPath, std::ios::binary);
+  if (!indexFile)
+    return std::nullopt;
+
+  IndexFileHeader fileHeader{};
+  indexFile.read(reinterpret_cast<char *>(&fileHeader), sizeof(fileHeader));
+  if (!indexFile || fileHeader.magic != INDEX_MAGIC ||
+      fileHeader.version != INDEX_VERSION || fileHeader.stamp != stamp)
+    return std::nullopt;
+
+  // The sizes in the header are only trusted once they add up to the file
+  auto dataOffset = indexFile.tellg();
+  indexFile.seekg(0, std::ios::end);
+  auto dataSize = static_cast<std::uint64_t>(indexFile.tellg() - dataOffset);
+  indexFile.seekg(dataOffset);
+  if (!indexFile || fileHeader.recordCount > dataSize / sizeof(Record) ||
+      fileHeader.namesSize !=
+          dataSize - fileHeader.recordCount * sizeof(Record))
+    return std::nullopt;
+
+  ArchiveIndex index{};
+  index.mRecords.resize(fileHeader.recordCount);
+  index.mNames.resize(fileHeader.namesSize);
+  indexFile.read(reinterpret_cast<char *>(index.mRecords.data()),
+                 index.mRecords.size() * sizeof(Record));
+  indexFile.read(index.mNames.data(), index.mNames.size());
+  if (!indexFile)
+    return std::nullopt;
+
+  for (auto const &record : index.mRecords) {
+    if (record.nameOffset > index.mNames.size() ||
+        record.nameSize > index.mNames.size() - record.nameOffset)
+      return std::nullopt;
+  }
+
+  return index;
+}
+
+Result<ArchiveIndex> ArchiveIndex::Build(ArchiveSource &tarFile) {
+  ArchiveIndex index{};
+  ExtendedHeader extended{};
+  while (true) {
+    BOOST_LEAF_AUTO(next, ReadHeader(tarFile, extended));
+    if (!next)
+      break;
+
+    // Entries point at the member's own header, after any extension headers
+    auto &header = *next;
+    auto headerOffset = tarFile.Offset() - BLOCK_SIZE_B;
+    BOOST_LEAF_AUTO(fileSize, header.FileSize());
+    BOOST_LEAF_AUTO(fileMode, header.FileMode());
+    index.Add(header.FileName(), fileSize, fileMode, headerOffset,
+              header.SparseSize().has_value());
+    BOOST_LEAF_CHECK(tarFile.Skip(PaddedSize(fileSize)));
+  }
+
+  index.Sort();
+  return {std::move(index)};
+}
+
+std::optional<ArchiveIndex> LoadIndex(std::string const &tarFilePath) {
+  if (IsStandardStream(tarFilePath))
+    return std::nullopt;
+  auto stamp = ReadArchiveStamp(tarFilePath);
+  if (!stamp)
+    return std::nullopt;
+  return ArchiveIndex::Load(IndexPath(tarFilePath), stamp.value());
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,152 @@
+#include "archive_reader.hpp"
+
+#include <optional>
+#include <vector>
+
+#include "archive_index.hpp"
+#include "archive_source.hpp"
+#include "compression.hpp"
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "sparse.hpp"
+
+namespace cc::tar {
+
+struct ArchiveReader::State {
+  std::string tarFilePath{};
+  // Opened up front to scan the archive, or once the index lists a sparse
+  // member
+  std::unique_ptr<detail::ArchiveSource> source{};
+  std::uint64_t pendingSkip{0};
+  detail::ExtendedHeader extended{};
+
+  std::optional<detail::ArchiveIndex> index{};
+  std::vector<detail::IndexEntry> entries{};
+  std::size_t nextEntry{0};
+
+  std::optional<Result<common::ObjectHeader>> current{};
+  bool started{false};
+};
+
+/**
+ * @brief Read the next header from the archive into header, skipping the data
+ * of the previous member first
+ * @returns whether a header was read, false at the end of the archive
+ */
+static Result<bool> ScanNext(detail::ArchiveSource &source,
+                             std::uint64_t &pendingSkip,
+                             detail::ExtendedHeader &extended,
+                             common::ObjectHeader &header) {
+  BOOST_LEAF_CHECK(source.Skip(pendingSkip));
+  pendingSkip = 0;
+
+  BOOST_LEAF_AUTO(view, detail::ReadHeader(source, extended));
+  if (!view)
+    return {false};
+
+  BOOST_LEAF_CHECK(view->CopyTo(header));
+  pendingSkip = detail::PaddedSize(header.fileSize);
+  return {true};
+}
+
+ArchiveReader::ArchiveReader(std::unique_ptr<State> state)
+    : mState(std::move(state)) {}
+
+ArchiveReader::ArchiveReader(ArchiveReader &&) noexcept = default;
+
+ArchiveReader &ArchiveReader::operator=(ArchiveReader &&) noexcept = default;
+
+ArchiveReader::~ArchiveReader() = default;
+
+Result<ArchiveReader>
+ArchiveReader::Open(std::string const &tarFilePath) noexcept {
+  if (!detail::CompressionOf(tarFilePath))
+    return NewError(error::InvalidFile{tarFilePath});
+
+  auto state = std::make_unique<State>();
+  state->tarFilePath = tarFilePath;
+  if ((state->index = detail::LoadIndex(tarFilePath))) {
+    state->entries = state->index->Entries();
+  } else {
+    BOOST_LEAF_ASSIGN(state->source, detail::OpenArchiveSource(tarFilePath));
+  }
+  return {ArchiveReader(std::move(state))};
+}
+
+ArchiveReader::Iterator ArchiveReader::begin() {
+  if (!mState->started) {
+    mState->started = true;
+    Advance();
+  }
+  return Iterator(mState->current ? this : nullptr);
+}
+
+void ArchiveReader::Advance() {
+  auto &state = *mState;
+
+  // Nothing follows a failure
+  if (state.current && !*state.current) {
+    state.current.reset();
+    return;
+  }
+
+  // The previous header is overwritten in place, so its strings keep their
+  // storage and members do not allocate once the names stop growing
+  common::ObjectHeader header{};
+  if (state.current)
+    header = std::move(state.current->value());
+
+  if (state.index) {
+    if (state.nextEntry == state.entries.size()) {
+      state.current.reset();
+      return;
+    }
+    auto const &entry = state.entries[state.nextEntry++];
+    state.current.emplace([&]() -> Result<common::ObjectHeader> {
+      header.fileName.assign(entry.fileName);
+      header.fileSize = entry.fileSize;
+      header.fileMode = entry.fileMode;
+      header.sparseSize = 0;
+      if (!entry.sparse)
+        return {std::move(header)};
+
+      // The index holds the stored size, the restored one ends the map that
+      // starts the data
+      if (!state.source) {
+        BOOST_LEAF_ASSIGN(state.source,
+                          detail::OpenArchiveSource(state.tarFilePath));
+      }
+      BOOST_LEAF_AUTO(map, detail::ReadSparseMapAt(
+                               *state.source,
+                               entry.headerOffset + detail::BLOCK_SIZE_B,
+                               entry.fileSize));
+      header.sparseSize = map.End();
+      return {std::move(header)};
+    }());
+    return;
+  }
+
+  auto next = ScanNext(*state.source, state.pendingSkip, state.extended,
+                       header);
+  if (next && !next.value()) {
+    state.current.reset();
+    return;
+  }
+  state.current.emplace([&]() -> Result<common::ObjectHeader> {
+    BOOST_LEAF_CHECK(next);
+    return {std::move(header)};
+  }());
+}
+
+ArchiveReader::Iterator::reference ArchiveReader::Iterator::operator*() const {
+  return *mReader->mState->current;
+}
+
+ArchiveReader::Iterator &ArchiveReader::Iterator::operator++() {
+  mReader->Advance();
+  if (!mReader->mState->current)
+    mReader = nullptr;
+  return *this;
+}
+
+} // namespace cc::tar
@@ -0,0 +1,169 @@
+#include "archive_sink.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compression.hpp"
+#include "error_code.hpp"
+#include "gzip.hpp"
+#include "instrumentation.hpp"
+#include "pipe.hpp"
+#include "zstd.hpp"
+
+namespace cc::tar::detail {
+
+// Bytes collected before they are written to the archive file
+static constexpr std::size_t SINK_BUFFER_SIZE_B = 256 << 10;
+
+/**
+ * @brief Read part of a file that is being archived
+ */
+static Result<std::size_t> ReadInput(FileDescriptor const &input,
+                                     std::span<char> buffer,
+                                     std::uint64_t offset) {
+  PhaseTimer timer(stats::Phase::FILE_IO);
+  BOOST_LEAF_AUTO(count, ReadAt(input, buffer, offset));
+  Count(stats::Counter::FILE_BYTES_READ, count);
+  return {count};
+}
+
+Result<std::uint64_t> ArchiveSink::CopyFrom(FileDescriptor const &input,
+                                            std::uint64_t offset,
+                                            std::uint64_t size) {
+  return CopyThroughBuffer(input, offset, size);
+}
+
+Result<std::uint64_t>
+ArchiveSink::CopyThroughBuffer(FileDescriptor const &input,
+                               std::uint64_t offset, std::uint64_t size) {
+  std::vector<char> buffer(std::min<std::uint64_t>(size, SINK_BUFFER_SIZE_B));
+  std::uint64_t copied = 0;
+  while (copied < size) {
+    auto chunkSize = std::min<std::uint64_t>(size - copied, buffer.size());
+    BOOST_LEAF_AUTO(count, ReadInput(input, {buffer.data(), chunkSize},
+                                     offset + copied));
+    if (count == 0)
+      break;
+    BOOST_LEAF_CHECK(Write({buffer.data(), count}));
+    copied += count;
+  }
+  return {copied};
+}
+
+/**
+ * @brief Whether the file is a regular file, whose writes need not be whole
+ * records
+ */
+static bool IsRegularFile(FileDescriptor const &file) {
+  struct stat info {};
+  return fstat(file.Get(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+FileSink::FileSink(FileDescriptor file, std::uint64_t recordSize,
+                   std::uint64_t offset)
+    : mFile(std::move(file)), mBuffer(IoBufferSize(recordSize)),
+      mOffset(offset), mAppending(offset > 0),
+      mCopiesInKernel(IsRegularFile(mFile)) {}
+
+Status FileSink::Write(std::span<const char> data) {
+  mOffset += data.size();
+  while (!data.empty()) {
+    auto count = std::min(data.size(), mBuffer.size() - mUsed);
+    std::copy_n(data.begin(), count, mBuffer.data() + mUsed);
+    mUsed += count;
+    data = data.subspan(count);
+    if (mUsed == mBuffer.size())
+      BOOST_LEAF_CHECK(Flush());
+  }
+  return Success();
+}
+
+Result<std::uint64_t> FileSink::CopyFrom(FileDescriptor const &input,
+                                         std::uint64_t offset,
+                                         std::uint64_t size) {
+  std::uint64_t copied = 0;
+  // The flush writes a partial record, which only regular files accept
+  if (mCopiesInKernel && size > KERNEL_COPY_THRESHOLD_B) {
+    BOOST_LEAF_CHECK(Flush());
+    PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+    BOOST_LEAF_ASSIGN(copied, KernelCopy(input, offset, mFile, size));
+    Count(stats::Counter::FILE_BYTES_READ, copied);
+    Count(stats::Counter::ARCHIVE_BYTES_WRITTEN, copied);
+    mOffset += copied;
+  }
+
+  // Whatever the kernel did not copy is read straight into the buffer
+  while (copied < size) {
+    if (mUsed == mBuffer.size())
+      BOOST_LEAF_CHECK(Flush());
+    auto chunkSize = std::min<std::uint64_t>(size - copied,
+                                             mBuffer.size() - mUsed);
+    BOOST_LEAF_AUTO(count,
+                    ReadInput(input, {mBuffer.data() + mUsed, chunkSize},
+                              offset + copied));
+    if (count == 0)
+      break;
+    mUsed += count;
+    mOffset += count;
+    copied += count;
+  }
+  return {copied};
+}
+
+Status FileSink::Flush() {
+  PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+  BOOST_LEAF_CHECK(WriteAll(mFile, {mBuffer.data(), mUsed}));
+  Count(stats::Counter::ARCHIVE_BYTES_WRITTEN, mUsed);
+  mUsed = 0;
+  return Success();
+}
+
+Status FileSink::Close() {
+  BOOST_LEAF_CHECK(Flush());
+  PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+  // Zeros of a longer end-of-archive marker may follow the appended members
+  if (mAppending && ftruncate(mFile.Get(), static_cast<off_t>(mOffset)) != 0)
+    return NewError(mFile.Error());
+  return mFile.Close();
+}
+
+Result<std::unique_ptr<ArchiveSink>>
+OpenArchiveSink(std::string const &filePath, std::uint32_t jobs,
+                std::uint64_t recordSize) {
+  if (IsStandardStream(filePath)) {
+    FileDescriptor output(dup(STDOUT_FILENO), "standard output",
+                          error::StreamType::OUTPUT);
+    if (output.Get() < 0)
+      return NewError(output.Error());
+    return {std::make_unique<PipeSink>(filePath, std::move(output),
+                                       recordSize)};
+  }
+
+  BOOST_LEAF_AUTO(file, FileDescriptor::Open(filePath, O_WRONLY | O_CREAT |
+                                                           O_TRUNC));
+
+  auto fileSink = std::make_unique<FileSink>(std::move(file), recordSize);
+  auto compression = CompressionOf(filePath);
+  if (compression == Compression::GZIP)
+    return {std::make_unique<GzipSink>(filePath, std::move(fileSink), jobs)};
+  if (compression == Compression::ZSTD)
+    return {std::make_unique<ZstdSink>(filePath, std::move(fileSink), jobs)};
+  return {std::move(fileSink)};
+}
+
+Result<std::unique_ptr<ArchiveSink>>
+OpenArchiveSinkAt(std::string const &filePath, std::uint64_t offset,
+                  std::uint64_t recordSize) {
+  if (IsStandardStream(filePath) ||
+      CompressionOf(filePath) != Compression::NONE)
+    return NewError(error::InvalidFile{filePath});
+
+  BOOST_LEAF_AUTO(file, FileDescriptor::Open(filePath, O_WRONLY | O_CREAT));
+  if (lseek(file.Get(), static_cast<off_t>(offset), SEEK_SET) < 0)
+    return NewError(file.Error());
+  return {std::make_unique<FileSink>(std::move(file), recordSize, offset)};
+}
+
+} // namespace cc::tar::detail
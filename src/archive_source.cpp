@@ -0,0 +1,275 @@
+#include "archive_source.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compression.hpp"
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "gzip.hpp"
+#include "instrumentation.hpp"
+#include "pipe.hpp"
+#include "zstd.hpp"
+
+namespace cc::tar::detail {
+
+// Member data ranges from this size onwards are prefetched explicitly, smaller
+// ones are covered by the sequential read-ahead of the kernel
+static constexpr std::uint64_t WILLNEED_THRESHOLD_B = 1 << 20;
+
+Result<std::span<const char>> ArchiveSource::ReadAt(std::uint64_t,
+                                                    std::uint64_t) const {
+  return NewError(error::UnexpectedError{});
+}
+
+Result<std::uint64_t> ArchiveSource::CopyData(FileDescriptor const &output,
+                                              std::uint64_t size) {
+  std::uint64_t copied = 0;
+  while (copied < size) {
+    BOOST_LEAF_AUTO(data, ReadData(size - copied));
+    if (data.empty())
+      break;
+    BOOST_LEAF_CHECK(WriteMemberData(output, data));
+    copied += data.size();
+  }
+  return {copied};
+}
+
+Status ArchiveSource::CopyAt(std::uint64_t offset, std::uint64_t size,
+                             FileDescriptor const &output) const {
+  BOOST_LEAF_AUTO(data, ReadAt(offset, size));
+  return WriteMemberData(output, data);
+}
+
+MappedSource::~MappedSource() {
+  if (mMapping != nullptr)
+    munmap(const_cast<char *>(mMapping), mSize);
+}
+
+Result<std::span<const char>> MappedSource::ReadBlock() {
+  if (mOffset >= mSize)
+    return {std::span<const char>{}};
+  if (mSize - mOffset < BLOCK_SIZE_B)
+    return NewError(mFile.Error());
+
+  std::span<const char> block(mMapping + mOffset, BLOCK_SIZE_B);
+  mOffset += BLOCK_SIZE_B;
+  Count(stats::Counter::ARCHIVE_BYTES_READ, BLOCK_SIZE_B);
+  return {block};
+}
+
+Result<std::span<const char>> MappedSource::ReadData(std::uint64_t maxSize) {
+  auto size = std::min(maxSize, mSize - std::min(mOffset, mSize));
+  std::span<const char> data(mMapping + mOffset, size);
+
+  if (size >= WILLNEED_THRESHOLD_B) {
+    auto pageSize = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    auto alignedOffset = mOffset / pageSize * pageSize;
+    madvise(const_cast<char *>(mMapping) + alignedOffset,
+            mOffset + size - alignedOffset, MADV_WILLNEED);
+  }
+
+  mOffset += size;
+  Count(stats::Counter::ARCHIVE_BYTES_READ, size);
+  return {data};
+}
+
+Status MappedSource::Skip(std::uint64_t size) {
+  if (size > mSize - std::min(mOffset, mSize))
+    return NewError(mFile.Error());
+  mOffset += size;
+  return Success();
+}
+
+Result<std::span<const char>> MappedSource::ReadAt(std::uint64_t offset,
+                                                   std::uint64_t size) const {
+  if (offset > mSize || size > mSize - offset)
+    return NewError(mFile.Error());
+  Count(stats::Counter::ARCHIVE_BYTES_READ, size);
+  return {std::span<const char>(mMapping + offset, size)};
+}
+
+Result<std::uint64_t> MappedSource::CopyData(FileDescriptor const &output,
+                                             std::uint64_t size) {
+  size = std::min(size, mSize - std::min(mOffset, mSize));
+  BOOST_LEAF_CHECK(CopyAt(mOffset, size, output));
+  mOffset += size;
+  return {size};
+}
+
+Status MappedSource::CopyAt(std::uint64_t offset, std::uint64_t size,
+                            FileDescriptor const &output) const {
+  if (offset > mSize || size > mSize - offset)
+    return NewError(mFile.Error());
+
+  Count(stats::Counter::ARCHIVE_BYTES_READ, size);
+  std::uint64_t copied = 0;
+  if (size > KERNEL_COPY_THRESHOLD_B) {
+    PhaseTimer timer(stats::Phase::FILE_IO);
+    BOOST_LEAF_ASSIGN(copied, KernelCopy(mFile, offset, output, size));
+    Count(stats::Counter::FILE_BYTES_WRITTEN, copied);
+  }
+
+  // Whatever the kernel did not copy is written from the mapping
+  return WriteMemberData(output, {mMapping + offset + copied, size - copied});
+}
+
+void StreamSource::Fill(std::size_t minimum) {
+  if (Available() >= minimum)
+    return;
+
+  std::copy(mBuffer.data() + mPosition, mBuffer.data() + mEnd, mBuffer.data());
+  mEnd -= mPosition;
+  mPosition = 0;
+  PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+  while (mEnd < minimum && *mStream) {
+    mStream->read(mBuffer.data() + mEnd,
+                  static_cast<std::streamsize>(mBuffer.size() - mEnd));
+    auto count = static_cast<std::size_t>(mStream->gcount());
+    Count(stats::Counter::ARCHIVE_BYTES_READ, count);
+    mEnd += count;
+  }
+}
+
+Result<std::span<const char>> StreamSource::ReadBlock() {
+  Fill(BLOCK_SIZE_B);
+  if (Available() == 0)
+    return {std::span<const char>{}};
+  if (Available() < BLOCK_SIZE_B)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+
+  std::span<const char> block(mBuffer.data() + mPosition, BLOCK_SIZE_B);
+  mPosition += BLOCK_SIZE_B;
+  mOffset += BLOCK_SIZE_B;
+  return {block};
+}
+
+Result<std::span<const char>> StreamSource::ReadData(std::uint64_t maxSize) {
+  Fill(1);
+  auto size = static_cast<std::size_t>(
+      std::min<std::uint64_t>(maxSize, Available()));
+  std::span<const char> data(mBuffer.data() + mPosition, size);
+  mPosition += size;
+  mOffset += size;
+  return {data};
+}
+
+Status StreamSource::Skip(std::uint64_t size) {
+  // Buffered bytes are dropped first, the rest is skipped in the stream
+  auto buffered = static_cast<std::size_t>(
+      std::min<std::uint64_t>(size, Available()));
+  mPosition += buffered;
+  mOffset += buffered;
+  size -= buffered;
+  if (size == 0)
+    return Success();
+
+  PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+  mStream->clear();
+  if (mStream->seekg(static_cast<std::streamoff>(size), std::ios_base::cur)) {
+    mOffset += size;
+    return Success();
+  }
+
+  // Non-seekable inputs can only skip by reading and dropping the bytes
+  mStream->clear();
+  mStream->ignore(static_cast<std::streamsize>(size));
+  Count(stats::Counter::ARCHIVE_BYTES_READ,
+        static_cast<std::uint64_t>(mStream->gcount()));
+  if (static_cast<std::uint64_t>(mStream->gcount()) != size)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+  mOffset += size;
+  return Success();
+}
+
+static Result<std::unique_ptr<ArchiveSource>>
+OpenFileSource(std::string const &filePath) {
+  if (IsStandardStream(filePath)) {
+    FileDescriptor input(dup(STDIN_FILENO), "standard input",
+                         error::StreamType::INPUT);
+    if (input.Get() < 0)
+      return NewError(input.Error());
+    return {std::make_unique<PipeSource>(filePath, std::move(input))};
+  }
+
+  // Only regular files are mapped, pipes and devices are opened as a stream
+  // straight away since they can be opened only once
+  struct stat fileInfo;
+  if (stat(filePath.c_str(), &fileInfo) == 0 && S_ISREG(fileInfo.st_mode)) {
+    BOOST_LEAF_AUTO(file, FileDescriptor::Open(filePath, O_RDONLY));
+
+    auto size = static_cast<std::uint64_t>(fileInfo.st_size);
+    if (size == 0)
+      return {std::make_unique<MappedSource>(std::move(file), 0, nullptr)};
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.Get(), 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, size, MADV_SEQUENTIAL);
+      return {
+          std::make_unique<MappedSource>(std::move(file), size, mapping)};
+    }
+  }
+
+  auto stream = std::make_unique<std::ifstream>(filePath, std::ios::binary);
+  if (!*stream)
+    return NewError(error::InvalidStream{filePath, error::StreamType::INPUT});
+  return {std::make_unique<StreamSource>(filePath, std::move(stream),
+                                         IO_BUFFER_SIZE_B)};
+}
+
+Result<std::optional<HeaderView>> ReadHeader(ArchiveSource &source,
+                                             ExtendedHeader &extended) {
+  PhaseTimer timer(stats::Phase::HEADER_PARSE);
+  extended.Clear();
+  while (true) {
+    BOOST_LEAF_AUTO(block, source.ReadBlock());
+    if (IsEndOfArchive(block))
+      return {std::nullopt};
+
+    BOOST_LEAF_AUTO(view, HeaderView::Open(block, &extended));
+    if (!IsExtension(view.LinkIndicator())) {
+      Count(stats::Counter::MEMBERS_READ, 1);
+      return {view};
+    }
+
+    // The size of the extension itself is never overridden
+    BOOST_LEAF_AUTO(size, view.Get<common::FILE_SIZE>());
+    if (size > MAX_EXTENSION_SIZE_B)
+      return NewError(error::InvalidBufferSize{});
+    auto type = view.LinkIndicator();
+    extended.data.clear();
+    while (extended.data.size() < size) {
+      BOOST_LEAF_AUTO(data, source.ReadData(size - extended.data.size()));
+      if (data.empty())
+        return NewError(error::InvalidConversion{});
+      extended.data.append(data.data(), data.size());
+    }
+    BOOST_LEAF_CHECK(source.Skip(PaddedSize(size) - size));
+    BOOST_LEAF_CHECK(ApplyExtension(type, extended.data, extended));
+  }
+}
+
+Status WriteMemberData(FileDescriptor const &output,
+                       std::span<const char> data) {
+  PhaseTimer timer(stats::Phase::FILE_IO);
+  BOOST_LEAF_CHECK(WriteAll(output, data));
+  Count(stats::Counter::FILE_BYTES_WRITTEN, data.size());
+  return Success();
+}
+
+Result<std::unique_ptr<ArchiveSource>>
+OpenArchiveSource(std::string const &filePath) {
+  BOOST_LEAF_AUTO(fileSource, OpenFileSource(filePath));
+  auto compression = CompressionOf(filePath);
+  if (compression == Compression::GZIP)
+    return {std::make_unique<GzipSource>(filePath, std::move(fileSource))};
+  if (compression == Compression::ZSTD)
+    return OpenZstdSource(filePath, std::move(fileSource));
+  return {std::move(fileSource)};
+}
+
+} // namespace cc::tar::detail
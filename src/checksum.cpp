@@ -0,0 +1,161 @@
+#include "checksum.hpp"
+
+#include <optional>
+
+#include "common.hpp"
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "instrumentation.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CC_TAR_X86_CHECKSUM
+#endif
+
+namespace cc::tar::detail {
+
+using ByteSumFunction = std::uint64_t (*)(const unsigned char *, std::size_t);
+
+// The checksum field itself counts as eight spaces
+static constexpr std::uint64_t BLANK_CHECKSUM_SUM =
+    8 * static_cast<std::uint8_t>(' ');
+
+// Archives written by earlier versions of this tool left the twelve bytes from
+// the checksum field onwards out of the sum and added eight '0' characters
+static constexpr std::size_t LEGACY_CHECKSUM_SIZE = 12;
+static constexpr std::uint64_t LEGACY_BLANK_CHECKSUM_SUM =
+    8 * static_cast<std::uint8_t>('0');
+
+static std::uint64_t ByteSumPortable(const unsigned char *data,
+                                     std::size_t size) {
+  std::uint64_t sum = 0;
+  for (std::size_t i = 0; i < size; i++)
+    sum += data[i];
+  return sum;
+}
+
+#ifdef CC_TAR_X86_CHECKSUM
+// Sum of absolute differences against zero adds up groups of eight unsigned
+// bytes into 64 bit lanes, which can not overflow
+__attribute__((target("sse2"))) static std::uint64_t
+ByteSumSse2(const unsigned char *data, std::size_t size) {
+  auto zero = _mm_setzero_si128();
+  auto sums = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(bytes, zero));
+  }
+
+  std::uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+  return lanes[0] + lanes[1] + ByteSumPortable(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) static std::uint64_t
+ByteSumAvx2(const unsigned char *data, std::size_t size) {
+  auto zero = _mm256_setzero_si256();
+  auto sums = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    auto bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    sums = _mm256_add_epi64(sums, _mm256_sad_epu8(bytes, zero));
+  }
+
+  std::uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), sums);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         ByteSumSse2(data + i, size - i);
+}
+#endif
+
+static ByteSumFunction SelectByteSum() {
+#ifdef CC_TAR_X86_CHECKSUM
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return ByteSumAvx2;
+  if (__builtin_cpu_supports("sse2"))
+    return ByteSumSse2;
+#endif
+  return ByteSumPortable;
+}
+
+std::uint64_t ByteSum(std::span<const char> buffer) {
+  static const ByteSumFunction byteSum = SelectByteSum();
+  return byteSum(reinterpret_cast<const unsigned char *>(buffer.data()),
+                 buffer.size());
+}
+
+std::uint64_t CalculateChecksum(std::span<const char> buffer) {
+  PhaseTimer timer(stats::Phase::CHECKSUM);
+  return ByteSum(buffer) -
+         ByteSum(buffer.subspan(common::CHECKSUM::offset,
+                                common::CHECKSUM::size)) +
+         BLANK_CHECKSUM_SUM;
+}
+
+/**
+ * @brief Whether the stored checksum matches the header, summed either as
+ * the standard describes or as earlier versions of this tool did
+ */
+static bool MatchesChecksum(std::span<const char> buffer,
+                            std::uint64_t stored) {
+  PhaseTimer timer(stats::Phase::CHECKSUM);
+  auto sum = ByteSum(buffer);
+  auto field = ByteSum(
+      buffer.subspan(common::CHECKSUM::offset, common::CHECKSUM::size));
+  if (sum - field + BLANK_CHECKSUM_SUM == stored)
+    return true;
+
+  // The legacy sum also leaves out the type flag and the start of the linked
+  // file name
+  auto legacyField =
+      ByteSum(buffer.subspan(common::CHECKSUM::offset, LEGACY_CHECKSUM_SIZE));
+  return sum - legacyField + LEGACY_BLANK_CHECKSUM_SUM == stored;
+}
+
+/**
+ * @brief Read the octal checksum field the same way as \ref helpers::Octal_t,
+ * without going through the error machinery
+ * @returns the stored checksum, or nothing if the field holds no octal digits
+ */
+static std::optional<std::uint64_t>
+StoredChecksum(std::span<const char> buffer) {
+  auto field =
+      buffer.subspan(common::CHECKSUM::offset, common::CHECKSUM::size);
+  std::uint64_t value = 0;
+  std::size_t digits = 0;
+  for (; digits < field.size(); digits++) {
+    auto digit = field[digits];
+    if (digit < '0' || digit > '7')
+      break;
+    value = value * 8 + static_cast<std::uint64_t>(digit - '0');
+  }
+  if (digits == 0)
+    return std::nullopt;
+  return {value};
+}
+
+Status VerifyChecksum(std::span<const char> buffer) {
+  auto headerCheckSum = StoredChecksum(buffer);
+  if (!headerCheckSum)
+    return NewError(error::InvalidConversion{});
+
+  if (!MatchesChecksum(buffer, *headerCheckSum))
+    return NewError(error::InvalidChecksum{});
+  return Success();
+}
+
+std::size_t FindInvalidChecksum(std::span<const char> headers) {
+  auto count = headers.size() / BLOCK_SIZE_B;
+  for (std::size_t index = 0; index < count; index++) {
+    auto header = headers.subspan(index * BLOCK_SIZE_B, BLOCK_SIZE_B);
+    auto stored = StoredChecksum(header);
+    if (!stored || !MatchesChecksum(header, *stored))
+      return index;
+  }
+  return count;
+}
+
+} // namespace cc::tar::detail
@@ -1,63 +1,269 @@
 #include "detail.hpp"
 
 #include "boost/leaf/error.hpp"
+#include "checksum.hpp"
 #include "common.hpp"
+#include "instrumentation.hpp"
 
 #include <algorithm>
+#include <charconv>
 #include <cstdint>
-#include <numeric>
 #include <span>
+#include <string>
 
 namespace cc::tar::detail {
 
-static constexpr std::uint16_t HEADER_SIZE_B = 257;
+// Headers end with the ustar magic and version, the fields after them are
+// left empty
+static constexpr std::uint16_t HEADER_SIZE_B = 265;
 
-// Checksum helpers
-std::uint64_t CalculateChecksum(std::span<char> buffer) {
-  auto unsignedSum = [](std::uint64_t a, char b) {
-    return std::move(a) + static_cast<uint8_t>(b);
-  };
+// Magic and version of POSIX ustar headers, at the end of the linked file name
+static constexpr std::size_t USTAR_MAGIC_OFFSET = 257;
+static constexpr std::string_view USTAR_MAGIC{"ustar\0" "00", 8};
 
-  return std::accumulate(buffer.begin(), buffer.end(), 0, unsignedSum) -
-         std::accumulate(buffer.begin() + common::CHECKSUM::offset,
-                         buffer.begin() + common::CHECKSUM::offset +
-                             common::CHECKSUM::size,
-                         0, unsignedSum) +
-         8 * static_cast<uint8_t>('0');
+// Sizes from 8 GiB onwards need more than the eleven octal digits of the size
+// and time fields, and are also recorded in a PAX extended header
+static constexpr std::uint64_t MAX_OCTAL_NUMBER =
+    (std::uint64_t{1} << 33) - 1;
+
+// Name of the PAX extended headers written before members
+static constexpr std::string_view PAX_HEADER_NAME = "././@PaxHeader";
+
+void ExtendedHeader::Clear() {
+  fileName.clear();
+  linkedFileName.clear();
+  fileSize.reset();
+  lastModified.reset();
+  sparseSize.reset();
 }
 
-Status VerifyChecksum(std::span<char> buffer) {
-  using namespace cc::tar::helpers;
-  BOOST_LEAF_AUTO(headerCheckSum, Read<common::CHECKSUM>(buffer));
-  auto checkSum = CalculateChecksum(buffer);
+bool ExtendedHeader::Empty() const {
+  return fileName.empty() && linkedFileName.empty() && !fileSize &&
+         !lastModified && !sparseSize;
+}
 
-  if (checkSum != headerCheckSum)
-    return NewError(error::InvalidChecksum{});
+bool IsExtension(common::LinkIndicator type) {
+  switch (type) {
+  case common::LinkIndicator::PAX_HEADER:
+  case common::LinkIndicator::PAX_GLOBAL_HEADER:
+  case common::LinkIndicator::GNU_LONG_NAME:
+  case common::LinkIndicator::GNU_LONG_LINK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief Apply the records of a PAX extended header, each of the form
+ * "<length> <key>=<value>\n" where the length covers the whole record
+ */
+static Status ApplyPaxRecords(std::string_view data,
+                              ExtendedHeader &extended) {
+  // Sparse members carry their real name next to the path of a placeholder
+  std::optional<std::string_view> sparseName{};
+  while (!data.empty()) {
+    std::size_t length{};
+    auto [ptr, ec] =
+        std::from_chars(data.data(), data.data() + data.size(), length);
+    auto prefix = static_cast<std::size_t>(ptr - data.data());
+    if (ec != std::errc() || prefix + 2 > length || length > data.size() ||
+        *ptr != ' ' || data[length - 1] != '\n')
+      return NewError(error::InvalidConversion{});
+
+    auto record = data.substr(prefix + 1, length - prefix - 2);
+    data.remove_prefix(length);
+    auto separator = record.find('=');
+    if (separator == std::string_view::npos)
+      return NewError(error::InvalidConversion{});
+    auto key = record.substr(0, separator);
+    auto value = record.substr(separator + 1);
+
+    if (key == "path") {
+      extended.fileName.assign(value);
+    } else if (key == "linkpath") {
+      extended.linkedFileName.assign(value);
+    } else if (key == "size") {
+      std::uint64_t size{};
+      auto [end, error] =
+          std::from_chars(value.data(), value.data() + value.size(), size);
+      if (error != std::errc() || end != value.data() + value.size())
+        return NewError(error::InvalidConversion{});
+      extended.fileSize = size;
+    } else if (key == "mtime") {
+      // Fractions of a second have no field to go to
+      std::uint64_t seconds{};
+      auto [end, error] =
+          std::from_chars(value.data(), value.data() + value.size(), seconds);
+      if (error != std::errc() ||
+          (end != value.data() + value.size() && *end != '.'))
+        return NewError(error::InvalidConversion{});
+      extended.lastModified = seconds;
+    } else if (key == "GNU.sparse.major") {
+      // Earlier formats keep the map in the extended header instead
+      if (value != "1")
+        return NewError(error::InvalidConversion{});
+      if (!extended.sparseSize)
+        extended.sparseSize = 0;
+    } else if (key == "GNU.sparse.realsize") {
+      std::uint64_t size{};
+      auto [end, error] =
+          std::from_chars(value.data(), value.data() + value.size(), size);
+      if (error != std::errc() || end != value.data() + value.size())
+        return NewError(error::InvalidConversion{});
+      extended.sparseSize = size;
+    } else if (key == "GNU.sparse.name") {
+      sparseName = value;
+    } else if (key == "GNU.sparse.map") {
+      return NewError(error::InvalidConversion{});
+    }
+  }
+
+  if (sparseName)
+    extended.fileName.assign(*sparseName);
   return Success();
 }
 
+Status ApplyExtension(common::LinkIndicator type, std::string_view data,
+                      ExtendedHeader &extended) {
+  // GNU long names are stored with a terminating null character
+  auto name = data.substr(0, data.find('\0'));
+  switch (type) {
+  case common::LinkIndicator::PAX_HEADER:
+    return ApplyPaxRecords(data, extended);
+  case common::LinkIndicator::GNU_LONG_NAME:
+    extended.fileName.assign(name);
+    return Success();
+  case common::LinkIndicator::GNU_LONG_LINK:
+    extended.linkedFileName.assign(name);
+    return Success();
+  default:
+    // Global headers only set defaults for fields that are not read
+    return Success();
+  }
+}
+
 // Parsing and serialisation
-Result<common::ObjectHeader> ParseHeader(std::span<char> buffer) {
-  using namespace cc::tar::helpers;
+Result<HeaderView> HeaderView::Open(std::span<const char> buffer,
+                                    ExtendedHeader const *extended) {
   if (buffer.size_bytes() < HEADER_SIZE_B)
     return NewError(error::InvalidBufferSize{});
 
   BOOST_LEAF_CHECK(VerifyChecksum(buffer));
+  return {HeaderView(buffer, extended)};
+}
 
-  common::ObjectHeader header{};
-  BOOST_LEAF_ASSIGN(header.fileName, Read<common::FILE_NAME>(buffer));
-  BOOST_LEAF_ASSIGN(header.fileSize, Read<common::FILE_SIZE>(buffer));
-  BOOST_LEAF_ASSIGN(header.fileMode, Read<common::FILE_MODE>(buffer));
-  BOOST_LEAF_ASSIGN(header.userID, Read<common::USER_ID>(buffer));
-  BOOST_LEAF_ASSIGN(header.groupID, Read<common::GROUP_ID>(buffer));
-  BOOST_LEAF_ASSIGN(header.linkIndicator, Read<common::LINK_INDICATOR>(buffer));
-  BOOST_LEAF_ASSIGN(header.linkedFileName,
-                    Read<common::LINKED_FILE_NAME>(buffer));
-  return header;
+Status HeaderView::CopyTo(common::ObjectHeader &header) const {
+  PhaseTimer timer(stats::Phase::HEADER_PARSE);
+  header.fileName.assign(FileName());
+  BOOST_LEAF_ASSIGN(header.fileSize, FileSize());
+  BOOST_LEAF_ASSIGN(header.fileMode, FileMode());
+  BOOST_LEAF_ASSIGN(header.userID, Get<common::USER_ID>());
+  BOOST_LEAF_ASSIGN(header.groupID, Get<common::GROUP_ID>());
+  BOOST_LEAF_ASSIGN(header.lastModified, LastModified());
+  header.linkIndicator = LinkIndicator();
+  header.linkedFileName.assign(LinkedFileName());
+  header.sparseSize = SparseSize().value_or(0);
+  return Success();
 }
 
-Status SerialiseHeader(common::ObjectHeader const &header,
-                       std::span<char> buffer) {
+bool IsEndOfArchive(std::span<const char> block) {
+  return std::all_of(block.begin(), block.end(),
+                     [](char byte) { return byte == 0x00; });
+}
+
+Result<common::ObjectHeader> ParseHeader(std::span<const char> buffer) {
+  PhaseTimer timer(stats::Phase::HEADER_PARSE);
+  ExtendedHeader extended{};
+  while (true) {
+    auto block =
+        buffer.first(std::min<std::size_t>(buffer.size(), BLOCK_SIZE_B));
+    BOOST_LEAF_AUTO(view, HeaderView::Open(block, &extended));
+    if (!IsExtension(view.LinkIndicator())) {
+      common::ObjectHeader header{};
+      BOOST_LEAF_CHECK(view.CopyTo(header));
+      return header;
+    }
+
+    // The size of the extension itself is never overridden
+    BOOST_LEAF_AUTO(size, view.Get<common::FILE_SIZE>());
+    if (size > MAX_EXTENSION_SIZE_B ||
+        buffer.size() < BLOCK_SIZE_B + PaddedSize(size))
+      return NewError(error::InvalidBufferSize{});
+    std::string_view data(buffer.data() + BLOCK_SIZE_B, size);
+    BOOST_LEAF_CHECK(ApplyExtension(view.LinkIndicator(), data, extended));
+    buffer = buffer.subspan(BLOCK_SIZE_B + PaddedSize(size));
+  }
+}
+
+/**
+ * @brief Whether a name fits into a header field including its terminator
+ */
+template <helpers::FieldType Field>
+static bool FitsField(std::string const &name) {
+  return name.size() < Field::size;
+}
+
+static bool NeedsExtendedHeader(common::ObjectHeader const &header) {
+  return !FitsField<common::FILE_NAME>(header.fileName) ||
+         !FitsField<common::LINKED_FILE_NAME>(header.linkedFileName) ||
+         header.fileSize > MAX_OCTAL_NUMBER ||
+         header.lastModified > MAX_OCTAL_NUMBER || header.sparseSize > 0;
+}
+
+/**
+ * @brief Name in the header block of a sparse member, so readers without
+ * support for them do not extract the packed data under the real name
+ */
+static std::string SparsePlaceholder(std::string const &fileName) {
+  auto slash = fileName.rfind('/');
+  std::string directory =
+      slash == std::string::npos ? "." : fileName.substr(0, slash);
+  return directory + "/GNUSparseFile.0/" +
+         fileName.substr(slash == std::string::npos ? 0 : slash + 1);
+}
+
+static void AppendPaxRecord(std::string &records, std::string_view key,
+                            std::string_view value) {
+  // The length includes its own digits, which may add a digit to it
+  auto length = key.size() + value.size() + 3;
+  auto digits = std::to_string(length).size();
+  if (std::to_string(length + digits).size() > digits)
+    digits++;
+
+  records += std::to_string(length + digits);
+  records += ' ';
+  records += key;
+  records += '=';
+  records += value;
+  records += '\n';
+}
+
+static std::string PaxRecords(common::ObjectHeader const &header) {
+  std::string records{};
+  if (header.sparseSize > 0) {
+    AppendPaxRecord(records, "GNU.sparse.major", "1");
+    AppendPaxRecord(records, "GNU.sparse.minor", "0");
+    AppendPaxRecord(records, "GNU.sparse.name", header.fileName);
+    AppendPaxRecord(records, "GNU.sparse.realsize",
+                    std::to_string(header.sparseSize));
+  } else if (!FitsField<common::FILE_NAME>(header.fileName)) {
+    AppendPaxRecord(records, "path", header.fileName);
+  }
+  if (!FitsField<common::LINKED_FILE_NAME>(header.linkedFileName))
+    AppendPaxRecord(records, "linkpath", header.linkedFileName);
+  if (header.fileSize > MAX_OCTAL_NUMBER)
+    AppendPaxRecord(records, "size", std::to_string(header.fileSize));
+  if (header.lastModified > MAX_OCTAL_NUMBER)
+    AppendPaxRecord(records, "mtime", std::to_string(header.lastModified));
+  return records;
+}
+
+/**
+ * @brief Serialise the fields of a header into a single block
+ */
+static Status SerialiseBlock(common::ObjectHeader const &header,
+                             std::span<char> buffer) {
   using namespace cc::tar::helpers;
   if (buffer.size_bytes() < HEADER_SIZE_B)
     return NewError(error::InvalidBufferSize{});
@@ -68,14 +274,65 @@ Status SerialiseHeader(common::ObjectHeader const &header,
   BOOST_LEAF_CHECK(Write<common::USER_ID>(header.userID, buffer));
   BOOST_LEAF_CHECK(Write<common::GROUP_ID>(header.groupID, buffer));
   BOOST_LEAF_CHECK(Write<common::FILE_SIZE>(header.fileSize, buffer));
+  BOOST_LEAF_CHECK(Write<common::LAST_MODIFIED>(header.lastModified, buffer));
   BOOST_LEAF_CHECK(Write<common::LINK_INDICATOR>(header.linkIndicator, buffer));
   BOOST_LEAF_CHECK(
       Write<common::LINKED_FILE_NAME>(header.linkedFileName, buffer));
+  std::copy(USTAR_MAGIC.begin(), USTAR_MAGIC.end(),
+            buffer.begin() + USTAR_MAGIC_OFFSET);
 
-  // Checksum
+  // Six octal digits followed by a null character and a space, as other tar
+  // programs write it. Sums of 512 bytes always fit
   auto checkSum = CalculateChecksum(buffer);
-  BOOST_LEAF_CHECK(Write<common::CHECKSUM>(checkSum, buffer));
+  auto field =
+      buffer.subspan(common::CHECKSUM::offset, common::CHECKSUM::size);
+  for (std::size_t digit = 6; digit-- > 0; checkSum >>= 3)
+    field[digit] = static_cast<char>('0' + (checkSum & 7));
+  field[6] = '\0';
+  field[7] = ' ';
   return Success();
 }
 
+std::uint64_t SerialisedSize(common::ObjectHeader const &header) {
+  if (!NeedsExtendedHeader(header))
+    return BLOCK_SIZE_B;
+  return 2 * BLOCK_SIZE_B + PaddedSize(PaxRecords(header).size());
+}
+
+Status SerialiseHeader(common::ObjectHeader const &header,
+                       std::span<char> buffer) {
+  PhaseTimer timer(stats::Phase::HEADER_SERIALISE);
+  if (!NeedsExtendedHeader(header))
+    return SerialiseBlock(header, buffer);
+
+  auto records = PaxRecords(header);
+  auto dataSize = PaddedSize(records.size());
+  if (buffer.size_bytes() < 2 * BLOCK_SIZE_B + dataSize)
+    return NewError(error::InvalidBufferSize{});
+
+  common::ObjectHeader pax{.fileName = std::string(PAX_HEADER_NAME),
+                           .fileSize = records.size(),
+                           .fileMode = 0644,
+                           .userID = header.userID,
+                           .groupID = header.groupID,
+                           .lastModified = header.lastModified,
+                           .linkIndicator = common::LinkIndicator::PAX_HEADER,
+                           .linkedFileName = {}};
+  BOOST_LEAF_CHECK(SerialiseBlock(pax, buffer.first(BLOCK_SIZE_B)));
+  auto data = buffer.subspan(BLOCK_SIZE_B, dataSize);
+  std::fill(data.begin(), data.end(), 0x00);
+  std::copy(records.begin(), records.end(), data.begin());
+
+  // Readers without PAX support still get the names cut to the fields
+  auto truncated = header;
+  if (header.sparseSize > 0)
+    truncated.fileName = SparsePlaceholder(header.fileName);
+  if (!FitsField<common::FILE_NAME>(truncated.fileName))
+    truncated.fileName.resize(common::FILE_NAME::size - 1);
+  if (!FitsField<common::LINKED_FILE_NAME>(truncated.linkedFileName))
+    truncated.linkedFileName.resize(common::LINKED_FILE_NAME::size - 1);
+  return SerialiseBlock(truncated,
+                        buffer.subspan(BLOCK_SIZE_B + dataSize, BLOCK_SIZE_B));
+}
+
 } // namespace cc::tar::detail
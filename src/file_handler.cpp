@@ -1,139 +1,1333 @@
 #include "file_handler.hpp"
 
 #include <algorithm>
+#include <cerrno>
+#include <condition_variable>
 #include <cstdint>
-#include <fstream>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <string_view>
 #include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
 
+#include "archive_index.hpp"
+#include "archive_sink.hpp"
+#include "archive_source.hpp"
 #include "common.hpp"
+#include "compression.hpp"
 #include "detail.hpp"
 #include "error_code.hpp"
+#include "error_slot.hpp"
+#include "instrumentation.hpp"
+#include "io_backend.hpp"
+#include "member_filter.hpp"
+#include "posix_file.hpp"
+#include "snapshot.hpp"
+#include "sparse.hpp"
+#include "thread_pool.hpp"
+#include "tree_walker.hpp"
+#include "verify.hpp"
 
 namespace cc::tar {
 
-bool FileHandler::IsValid() noexcept {
-  auto validExtension =
-      mTarFilePath.find(".tar", mTarFilePath.size() - 4) != std::string::npos;
-  return validExtension;
+/**
+ * @brief Archive member together with the location of its data
+ */
+struct ExtractJob {
+  std::uint64_t fileSize;
+  std::uint64_t dataOffset;
+  // Restored size of a sparse member
+  std::optional<std::uint64_t> sparseSize;
+};
+
+/**
+ * @brief Link member, created once the data of all other members was written
+ *
+ * Symbolic links are created last, after the hard links, so no member or hard
+ * link is written through a symbolic link extracted before it.
+ */
+struct LinkJob {
+  std::string fileName;
+  std::string linkedFileName;
+  common::LinkIndicator linkIndicator;
+};
+
+static bool IsLink(common::LinkIndicator linkIndicator) {
+  return linkIndicator == common::LinkIndicator::HARD_LINK ||
+         linkIndicator == common::LinkIndicator::SYMBOLIC_LINK;
 }
 
-Result<std::vector<common::ObjectHeader>> FileHandler::ListContents() noexcept {
-  if (!IsValid()) {
-    return NewError(error::InvalidFile{mTarFilePath});
+/**
+ * @brief Whether any component of a member path is the provided one
+ */
+static bool HasComponent(std::string_view filePath,
+                         std::string_view component) {
+  while (!filePath.empty()) {
+    auto slash = filePath.find('/');
+    if (filePath.substr(0, slash) == component)
+      return true;
+    if (slash == std::string_view::npos)
+      break;
+    filePath.remove_prefix(slash + 1);
   }
+  return false;
+}
 
-  // TODO: Introduce scopeguard class for file management
-  std::ifstream tarFile(mTarFilePath, std::ios::binary);
-  if (!tarFile) {
-    return NewError(
-        error::InvalidStream{mTarFilePath, error::StreamType::INPUT});
+/**
+ * @brief Reject member paths that may reach outside of the extraction
+ * directory, which are absolute paths and paths with a parent component
+ */
+static Status ValidatePath(std::string_view filePath) {
+  if (filePath.empty() || filePath.starts_with('/') ||
+      HasComponent(filePath, "..")) {
+    return NewError(error::InvalidContents{});
   }
+  return Success();
+}
+
+/**
+ * @brief Resolve a member path whose directory has to be inside of the
+ * extraction directory once symbolic links are followed
+ * @returns the path with its directory resolved, the last component is not
+ * followed
+ */
+static Result<std::filesystem::path> ResolveInside(std::string_view fileName) {
+  namespace fs = std::filesystem;
+  auto path = fs::path(fileName).lexically_normal();
+  if (!path.has_filename())
+    path = path.parent_path();
+  if (!path.has_filename() || path.filename() == ".")
+    return NewError(error::InvalidContents{});
 
-  std::vector<common::ObjectHeader> output{};
-  std::vector<char> buffer(CHUNK_SIZE_B);
-  while (tarFile.read(buffer.data(), CHUNK_SIZE_B) || tarFile.gcount()) {
-    BOOST_LEAF_AUTO(header, detail::ParseHeader(buffer));
-    output.push_back(header);
+  std::error_code resolveError{};
+  auto root = fs::canonical(".", resolveError);
+  if (resolveError)
+    return NewError(error::InvalidFile{std::string(fileName)});
+  auto parent = fs::weakly_canonical(root / path.parent_path(), resolveError);
+  if (resolveError)
+    return NewError(error::InvalidFile{std::string(fileName)});
+
+  auto relative = parent.lexically_relative(root);
+  if (relative.empty() || *relative.begin() == "..")
+    return NewError(error::InvalidContents{});
+  return {parent / path.filename()};
+}
 
-    auto fileSizeChunks = header.fileSize / CHUNK_SIZE_B + 1;
-    tarFile.seekg(fileSizeChunks * CHUNK_SIZE_B, std::ios_base::cur);
+/**
+ * @brief Whether a directory on the way to a member path is a symbolic link
+ */
+static bool PassesThroughLink(std::string_view filePath) {
+  std::string directory{};
+  for (auto slash = filePath.find('/'); slash != std::string_view::npos;
+       slash = filePath.find('/', slash + 1)) {
+    directory.assign(filePath.substr(0, slash));
+    struct stat fileInfo;
+    if (lstat(directory.c_str(), &fileInfo) == 0 && S_ISLNK(fileInfo.st_mode))
+      return true;
   }
+  return false;
+}
+
+/**
+ * @brief Whether a member path is the path of a deletion marker or below it
+ */
+static bool IsRemovedBy(std::string_view filePath, std::string_view removed) {
+  while (removed.size() > 1 && removed.ends_with('/'))
+    removed.remove_suffix(1);
+  return filePath.starts_with(removed) &&
+         (filePath.size() == removed.size() || filePath[removed.size()] == '/');
+}
 
-  tarFile.close();
+/**
+ * @brief Drop the queued links that a deletion marker removes
+ */
+static void RemoveLinkJobs(std::vector<LinkJob> &linkJobs,
+                           std::string_view removed) {
+  std::erase_if(linkJobs, [&](LinkJob const &job) {
+    return IsRemovedBy(job.fileName, removed);
+  });
+}
 
-  return {output};
+static Result<detail::FileDescriptor>
+CreateMember(std::string const &fileName) {
+  return detail::FileDescriptor::Open(fileName, O_WRONLY | O_CREAT | O_TRUNC);
 }
 
-Status FileHandler::Extract() noexcept {
-  if (!IsValid()) {
-    return NewError(error::InvalidFile{mTarFilePath});
+static Status SeekMember(detail::FileDescriptor const &extractedFile,
+                         std::uint64_t offset) {
+  detail::PhaseTimer timer(stats::Phase::FILE_IO);
+  return detail::Seek(extractedFile, offset);
+}
+
+static Status ResizeMember(detail::FileDescriptor const &extractedFile,
+                           std::uint64_t size) {
+  detail::PhaseTimer timer(stats::Phase::FILE_IO);
+  return detail::Resize(extractedFile, size);
+}
+
+/**
+ * @brief Write the member data found at dataOffset of a random access archive
+ */
+static Status WriteMember(detail::ArchiveSource const &tarFile,
+                          std::string const &fileName, std::uint64_t fileSize,
+                          std::uint64_t dataOffset) {
+  BOOST_LEAF_AUTO(extractedFile, CreateMember(fileName));
+  BOOST_LEAF_CHECK(tarFile.CopyAt(dataOffset, fileSize, extractedFile));
+  return extractedFile.Close();
+}
+
+/**
+ * @brief Write the data extents of a sparse member found at dataOffset of a
+ * random access archive, seeking over the holes so they stay unallocated
+ */
+static Status WriteSparseMember(detail::ArchiveSource const &tarFile,
+                                std::string const &fileName,
+                                std::uint64_t fileSize,
+                                std::uint64_t dataOffset,
+                                std::uint64_t sparseSize) {
+  BOOST_LEAF_AUTO(map, detail::ReadSparseMapAt(tarFile, dataOffset, fileSize));
+  BOOST_LEAF_AUTO(extractedFile, CreateMember(fileName));
+  auto extentOffset = dataOffset + map.mapSize;
+  for (auto const &extent : map.extents) {
+    BOOST_LEAF_CHECK(SeekMember(extractedFile, extent.offset));
+    BOOST_LEAF_CHECK(tarFile.CopyAt(extentOffset, extent.size, extractedFile));
+    extentOffset += extent.size;
   }
+  BOOST_LEAF_CHECK(
+      ResizeMember(extractedFile, std::max(sparseSize, map.End())));
+  return extractedFile.Close();
+}
 
-  std::ifstream tarFile(mTarFilePath, std::ios::binary);
-  if (!tarFile) {
-    return NewError(
-        error::InvalidStream{mTarFilePath, error::StreamType::INPUT});
+/**
+ * @brief Write the data extents of the sparse member at the current position
+ * of a sequential archive, which is left at the end of its data
+ */
+static Status ExtractSparseMember(detail::ArchiveSource &tarFile,
+                                  std::string const &tarFilePath,
+                                  std::string const &fileName,
+                                  std::uint64_t fileSize,
+                                  std::uint64_t sparseSize) {
+  BOOST_LEAF_AUTO(map, detail::ReadSparseMap(tarFile, fileSize));
+  BOOST_LEAF_AUTO(extractedFile, CreateMember(fileName));
+  for (auto const &extent : map.extents) {
+    BOOST_LEAF_CHECK(SeekMember(extractedFile, extent.offset));
+    BOOST_LEAF_AUTO(copied, tarFile.CopyData(extractedFile, extent.size));
+    if (copied != extent.size)
+      return NewError(
+          error::InvalidStream{tarFilePath, error::StreamType::INPUT});
   }
+  BOOST_LEAF_CHECK(
+      ResizeMember(extractedFile, std::max(sparseSize, map.End())));
+  return extractedFile.Close();
+}
 
-  std::vector<char> buffer(CHUNK_SIZE_B);
-  while (tarFile.read(buffer.data(), CHUNK_SIZE_B) || tarFile.gcount()) {
-    BOOST_LEAF_AUTO(header, detail::ParseHeader(buffer));
+/**
+ * @brief Create one link of an extracted member, replacing the file that is in
+ * its place
+ *
+ * Links are only placed inside of the extraction directory. Hard links may not
+ * reach their target through a symbolic link, which could point anywhere.
+ */
+static Status CreateLink(LinkJob const &job) {
+  BOOST_LEAF_CHECK(ResolveInside(job.fileName));
+  auto hardLink = job.linkIndicator == common::LinkIndicator::HARD_LINK;
+  if (hardLink && PassesThroughLink(job.linkedFileName))
+    return NewError(error::InvalidContents{});
+  if (unlink(job.fileName.c_str()) != 0 && errno != ENOENT)
+    return NewError(error::InvalidFile{job.fileName});
 
-    // Validate file path
-    if (header.fileName.find("../", 0) != std::string::npos) {
-      return NewError(error::InvalidContents{});
+  auto const *target = job.linkedFileName.c_str();
+  auto result = hardLink ? link(target, job.fileName.c_str())
+                         : symlink(target, job.fileName.c_str());
+  if (result != 0)
+    return NewError(error::InvalidFile{job.fileName});
+  return Success();
+}
+
+/**
+ * @brief Create the links of the extracted members, the hard links before any
+ * symbolic link of the archive exists
+ */
+static Status CreateLinks(std::vector<LinkJob> const &linkJobs) {
+  detail::PhaseTimer timer(stats::Phase::METADATA);
+  for (auto hardLinks : {true, false}) {
+    for (auto const &job : linkJobs) {
+      if ((job.linkIndicator == common::LinkIndicator::HARD_LINK) == hardLinks)
+        BOOST_LEAF_CHECK(CreateLink(job));
     }
+  }
+  return Success();
+}
 
-    // Create new file with object contents
-    std::ofstream extractedFile(header.fileName, std::ios::binary);
-    if (!extractedFile)
-      return NewError(
-          error::InvalidStream{header.fileName, error::StreamType::OUTPUT});
+/**
+ * @brief Queue the link of a member, hard links may only point at paths
+ * inside of the extracted tree
+ */
+static Status AddLinkJob(std::vector<LinkJob> &linkJobs,
+                         detail::HeaderView const &header) {
+  auto linkIndicator = header.LinkIndicator();
+  auto linkedFileName = header.LinkedFileName();
+  if (linkIndicator == common::LinkIndicator::HARD_LINK)
+    BOOST_LEAF_CHECK(ValidatePath(linkedFileName));
+  linkJobs.push_back({.fileName = std::string(header.FileName()),
+                      .linkedFileName = std::string(linkedFileName),
+                      .linkIndicator = linkIndicator});
+  return Success();
+}
+
+/**
+ * @brief Header of the member archiving a file system object found by the
+ * tree walker
+ */
+static common::ObjectHeader MemberHeader(detail::WalkEntry const &entry) {
+  common::ObjectHeader header{};
+  header.fileName = entry.path;
+  header.fileSize = entry.info.st_size;
+  header.fileMode = entry.info.st_mode;
+  header.userID = entry.info.st_uid;
+  header.groupID = entry.info.st_gid;
+  header.lastModified =
+      static_cast<std::uint64_t>(std::max<time_t>(entry.info.st_mtime, 0));
+  if (S_ISDIR(entry.info.st_mode)) {
+    header.fileName.push_back('/');
+    header.fileSize = 0;
+    header.linkIndicator = common::LinkIndicator::DIRECTORY;
+  } else if (S_ISLNK(entry.info.st_mode)) {
+    header.fileSize = 0;
+    header.linkIndicator = common::LinkIndicator::SYMBOLIC_LINK;
+    header.linkedFileName = entry.linkTarget;
+  }
+  return header;
+}
+
+/**
+ * @brief Identity of a file with several names
+ */
+struct FileID {
+  std::uint64_t device;
+  std::uint64_t inode;
+
+  bool operator==(FileID const &) const = default;
+};
+
+struct FileIDHash {
+  std::size_t operator()(FileID const &id) const noexcept {
+    return std::hash<std::uint64_t>{}(id.inode * 31 + id.device);
+  }
+};
+
+/**
+ * @brief Name of the first member of every archived file with more than one
+ * hard link
+ */
+using LinkTargets = std::unordered_map<FileID, std::string, FileIDHash>;
 
-    for (std::uint64_t offset = 0; offset < header.fileSize;
-         offset += CHUNK_SIZE_B) {
-      // Read full chunk from tar file
-      tarFile.read(buffer.data(), CHUNK_SIZE_B);
+/**
+ * @brief Turn the header of a file archived before under another name into a
+ * hard link to that member, which carries no data
+ */
+static void LinkToEarlierMember(LinkTargets &linkTargets,
+                                detail::WalkEntry const &entry,
+                                common::ObjectHeader &header) {
+  if (!S_ISREG(entry.info.st_mode) || entry.info.st_nlink < 2)
+    return;
+
+  auto [it, inserted] = linkTargets.try_emplace(
+      {.device = static_cast<std::uint64_t>(entry.info.st_dev),
+       .inode = static_cast<std::uint64_t>(entry.info.st_ino)},
+      header.fileName);
+  if (inserted)
+    return;
+  header.fileSize = 0;
+  header.linkIndicator = common::LinkIndicator::HARD_LINK;
+  header.linkedFileName = it->second;
+}
+
+/**
+ * @brief Whether the data of a file follows the header of its member
+ */
+static bool HasData(common::ObjectHeader const &header) {
+  return header.linkIndicator != common::LinkIndicator::DIRECTORY &&
+         !IsLink(header.linkIndicator);
+}
+
+/**
+ * @brief Remove the path of a deletion marker, with everything below it
+ *
+ * Only paths strictly inside of the extraction directory are removed, never
+ * the directory itself. The parent of the path is resolved first, so a
+ * symbolic link extracted earlier can not lead the removal outside of it.
+ */
+static Status RemovePath(std::string_view fileName) {
+  BOOST_LEAF_CHECK(ValidatePath(fileName));
+  if (HasComponent(fileName, "."))
+    return NewError(error::InvalidContents{});
+
+  detail::PhaseTimer timer(stats::Phase::METADATA);
+  BOOST_LEAF_AUTO(path, ResolveInside(fileName));
+  std::error_code removeError{};
+  std::filesystem::remove_all(path, removeError);
+  if (removeError)
+    return NewError(error::InvalidFile{std::string(fileName)});
+  return Success();
+}
+
+/**
+ * @brief Create the directory of a member, which may exist already
+ */
+static Status CreateDirectory(std::string_view fileName) {
+  std::string path(fileName);
+  while (path.size() > 1 && path.back() == '/')
+    path.pop_back();
+
+  detail::PhaseTimer timer(stats::Phase::METADATA);
+  struct stat fileInfo;
+  if (mkdir(path.c_str(), 0777) != 0 &&
+      (errno != EEXIST || stat(path.c_str(), &fileInfo) != 0 ||
+       !S_ISDIR(fileInfo.st_mode)))
+    return NewError(error::InvalidFile{path});
+  return Success();
+}
+
+static Status WriteZeros(detail::ArchiveSink &tarFile, std::uint64_t size) {
+  static constexpr std::array<char, detail::BLOCK_SIZE_B> zeros{0x00};
+  for (; size > zeros.size(); size -= zeros.size())
+    BOOST_LEAF_CHECK(tarFile.Write(zeros));
+  return tarFile.Write({zeros.data(), size});
+}
 
-      // Write useful contents to extracted file
-      auto remainingSize = std::min(header.fileSize - offset, CHUNK_SIZE_B);
-      extractedFile.write(buffer.data(), remainingSize);
+/**
+ * @brief Write the two zero blocks ending the archive, followed by zeros up to
+ * the end of the record
+ */
+static Status WriteEndOfArchive(detail::ArchiveSink &tarFile,
+                                std::uint64_t recordSize) {
+  auto end = tarFile.Offset() + 2 * detail::BLOCK_SIZE_B;
+  auto padding = (recordSize - end % recordSize) % recordSize;
+  return WriteZeros(tarFile, 2 * detail::BLOCK_SIZE_B + padding);
+}
+
+/**
+ * @brief Copy the contents of an input file into the archive, padded to whole
+ * blocks
+ *
+ * Exactly the size recorded in the header is written, a file that shrank in
+ * the meantime is filled up with zeros so the archive stays readable.
+ */
+static Status CopyFileData(detail::FileDescriptor const &inputFile,
+                           std::uint64_t fileSize,
+                           detail::ArchiveSink &tarFile) {
+  BOOST_LEAF_AUTO(copied, tarFile.CopyFrom(inputFile, 0, fileSize));
+  return WriteZeros(tarFile, detail::PaddedSize(fileSize) - copied);
+}
+
+/**
+ * @brief Write the header block of a member, adding it to the archive index if
+ * one is provided
+ */
+static Status WriteMemberHeader(detail::ArchiveSink &tarFile,
+                                common::ObjectHeader const &header,
+                                detail::ArchiveIndex *archiveIndex) {
+  BOOST_LEAF_CHECK(tarFile.BeginMember());
+  detail::Count(stats::Counter::MEMBERS_WRITTEN, 1);
+
+  // Index entries point at the last block, past a PAX extended header
+  auto size = detail::SerialisedSize(header);
+  if (archiveIndex)
+    archiveIndex->Add(header, tarFile.Offset() + size - detail::BLOCK_SIZE_B);
+
+  if (size == detail::BLOCK_SIZE_B) {
+    std::array<char, detail::BLOCK_SIZE_B> buffer{0x00};
+    BOOST_LEAF_CHECK(detail::SerialiseHeader(header, buffer));
+    return tarFile.Write(buffer);
+  }
+  std::vector<char> buffer(size);
+  BOOST_LEAF_CHECK(detail::SerialiseHeader(header, buffer));
+  return tarFile.Write(buffer);
+}
+
+/**
+ * @brief Write the member of a file with holes, only its data extents are
+ * read and stored after the map
+ */
+static Status WriteSparseMember(detail::ArchiveSink &tarFile,
+                                common::ObjectHeader header,
+                                detail::FileDescriptor const &inputFile,
+                                detail::SparseMap const &map,
+                                detail::ArchiveIndex *archiveIndex) {
+  auto mapText = detail::SerialiseSparseMap(map);
+  header.sparseSize = header.fileSize;
+  header.fileSize = mapText.size() + map.DataSize();
+  BOOST_LEAF_CHECK(WriteMemberHeader(tarFile, header, archiveIndex));
+  BOOST_LEAF_CHECK(tarFile.Write(mapText));
+
+  // Extents a shrinking file no longer has are filled up with zeros
+  for (auto const &extent : map.extents) {
+    BOOST_LEAF_AUTO(copied,
+                    tarFile.CopyFrom(inputFile, extent.offset, extent.size));
+    BOOST_LEAF_CHECK(WriteZeros(tarFile, extent.size - copied));
+  }
+  return WriteZeros(tarFile,
+                    detail::PaddedSize(header.fileSize) - header.fileSize);
+}
+
+// Budget for file contents read ahead of the writer by the create pipeline
+static constexpr std::uint64_t PIPELINE_BUFFER_B = 64 << 20;
+
+// Larger files are not read ahead, the writer copies them from the file
+static constexpr std::uint64_t MAX_BUFFERED_MEMBER_B = 8 << 20;
+
+// Number of walked members the create pipeline holds ahead of the writer
+static constexpr std::size_t PIPELINE_MAX_MEMBERS = 4096;
+
+/**
+ * @brief Latest modification time of the members of an archive, by name
+ */
+using MemberTimes = std::unordered_map<std::string, std::uint64_t>;
+
+/**
+ * @brief Whether the archive holds the member already, modified at the same
+ * time or later
+ */
+static bool IsArchived(MemberTimes const *archived,
+                       common::ObjectHeader const &header) {
+  if (!archived)
+    return false;
+  auto it = archived->find(header.fileName);
+  return it != archived->end() && it->second >= header.lastModified;
+}
+
+/**
+ * @brief Which of the walked entries are written as members
+ */
+struct MemberSelection {
+  // Latest modification times of the members of an archive being updated
+  MemberTimes const *archived{nullptr};
+  // Snapshot of the previous incremental run, and the one taken by this run
+  detail::Snapshot const *previous{nullptr};
+  detail::Snapshot *current{nullptr};
+};
+
+/**
+ * @brief Whether a walked entry is written as a member, recording it in the
+ * current snapshot
+ *
+ * Directories are always written, so their unchanged contents can be
+ * extracted into them from an earlier archive.
+ */
+static bool IsSelected(MemberSelection const &selection,
+                       detail::WalkEntry const &entry,
+                       common::ObjectHeader const &header) {
+  if (selection.current) {
+    auto state = detail::SnapshotEntry::Of(entry.info);
+    selection.current->Add(entry.path, state);
+    if (!S_ISDIR(entry.info.st_mode) &&
+        selection.previous->Find(entry.path) == state)
+      return false;
+  }
+  return !IsArchived(selection.archived, header);
+}
+
+/**
+ * @brief Entries to archive, taken from the tree walk while it runs or from
+ * the entries collected by a complete walk beforehand
+ */
+class MemberEntries {
+public:
+  explicit MemberEntries(detail::TreeWalker &walker) : mWalker(walker) {}
+
+  /**
+   * @brief Complete the walk, keeping the entries the selection accepts
+   *
+   * Selecting a kept entry again gives the same result, the current snapshot
+   * is complete afterwards.
+   */
+  [[nodiscard]] Status Collect(MemberSelection const &selection) {
+    std::deque<detail::WalkEntry> collected{};
+    while (true) {
+      BOOST_LEAF_AUTO(entry, mWalker.Next());
+      if (!entry)
+        break;
+      if (IsSelected(selection, *entry, MemberHeader(*entry)))
+        collected.push_back(std::move(*entry));
+    }
+    mCollected = std::move(collected);
+    return Success();
+  }
+
+  [[nodiscard]] Result<std::optional<detail::WalkEntry>> Next() {
+    if (!mCollected)
+      return mWalker.Next();
+    if (mCollected->empty())
+      return {std::nullopt};
+    std::optional<detail::WalkEntry> entry = std::move(mCollected->front());
+    mCollected->pop_front();
+    return {std::move(entry)};
+  }
+
+  void Stop() { mWalker.Stop(); }
+
+private:
+  detail::TreeWalker &mWalker;
+  std::optional<std::deque<detail::WalkEntry>> mCollected{};
+};
+
+/**
+ * @brief Input file of the create pipeline, prepared ahead of the writer
+ */
+struct PreparedMember {
+  common::ObjectHeader header{};
+  struct stat info {};
+  // Set for files with holes, which are never read ahead
+  std::optional<detail::SparseMap> sparseMap{};
+  std::vector<char> data{};
+  bool buffered{false};
+  bool ready{false};
+  detail::ErrorSlot error{};
+};
+
+/**
+ * @brief Write the archive members using a pool of worker threads that read
+ * the input files ahead of a single ordered writer
+ *
+ * Members are queued as the tree walker finds them and written in that order,
+ * and added to the archive index if one is provided. Unless the walk is
+ * sorted its order depends on thread timing, so two archives of the same tree
+ * may differ. Entries the selection leaves out are skipped, further names of
+ * a file become hard links to its first member. File contents held in memory
+ * are bounded by \ref PIPELINE_BUFFER_B, only the member the writer waits for
+ * may exceed it.
+ */
+static Status CompressParallel(detail::ArchiveSink &tarFile,
+                               MemberEntries &entries, std::uint32_t jobs,
+                               detail::ArchiveIndex *archiveIndex,
+                               MemberSelection const &selection,
+                               LinkTargets &linkTargets) {
+  // A deque keeps the members in place while the walker adds to its back and
+  // the writer removes from its front
+  std::deque<PreparedMember> members{};
+  std::mutex mutex{};
+  std::condition_variable memberChanged{};
+  std::uint64_t bufferedBytes = 0;
+  bool walkDone = false;
+  bool aborted = false;
+  detail::ErrorSlot walkError{};
+
+  // Reading ahead only pays off for files the sink can not copy in the kernel
+  auto maxBufferedSize = tarFile.CopiesInKernel()
+                             ? detail::KERNEL_COPY_THRESHOLD_B
+                             : MAX_BUFFERED_MEMBER_B;
+
+  auto prepareMember = [&](PreparedMember &member) -> Status {
+    BOOST_LEAF_AUTO(inputFile, detail::FileDescriptor::Open(
+                                   member.header.fileName, O_RDONLY));
+    BOOST_LEAF_ASSIGN(member.sparseMap,
+                      detail::FindDataExtents(inputFile, member.info));
+
+    auto size = member.header.fileSize;
+    if (member.sparseMap || size > maxBufferedSize)
+      return Success();
+
+    {
+      std::unique_lock lock(mutex);
+      memberChanged.wait(lock, [&]() {
+        return aborted || &member == &members.front() ||
+               bufferedBytes + size <= PIPELINE_BUFFER_B;
+      });
+      if (aborted)
+        return Success();
+      bufferedBytes += size;
+      member.buffered = true;
+    }
+
+    member.data.resize(size);
+    detail::PhaseTimer timer(stats::Phase::FILE_IO);
+    BOOST_LEAF_AUTO(count, detail::ReadAt(inputFile, member.data, 0));
+    detail::Count(stats::Counter::FILE_BYTES_READ, count);
+    member.data.resize(count);
+    return Success();
+  };
+
+  detail::ThreadPool pool(jobs);
+  auto feedMembers = [&]() -> Status {
+    while (true) {
+      BOOST_LEAF_AUTO(entry, entries.Next());
+      if (!entry)
+        return Success();
+      auto header = MemberHeader(*entry);
+      if (!IsSelected(selection, *entry, header))
+        continue;
+      LinkToEarlierMember(linkTargets, *entry, header);
+
+      PreparedMember *member;
+      {
+        std::unique_lock lock(mutex);
+        memberChanged.wait(lock, [&]() {
+          return aborted || members.size() < PIPELINE_MAX_MEMBERS;
+        });
+        if (aborted)
+          return Success();
+        member = &members.emplace_back();
+        member->header = std::move(header);
+        member->info = entry->info;
+        // Directories and links have no contents to prepare
+        member->ready = !HasData(member->header);
+      }
+      if (member->ready) {
+        memberChanged.notify_all();
+        continue;
+      }
+
+      pool.Submit([&, member]() {
+        member->error.Run([&]() -> Status {
+          {
+            std::lock_guard lock(mutex);
+            if (aborted)
+              return Success();
+          }
+          return prepareMember(*member);
+        });
+        {
+          std::lock_guard lock(mutex);
+          member->ready = true;
+        }
+        memberChanged.notify_all();
+      });
+    }
+  };
+
+  // The walk runs on its own thread, so the writer never waits for a
+  // directory listing while earlier members are ready
+  std::thread feeder([&]() {
+    walkError.Run(feedMembers);
+    {
+      std::lock_guard lock(mutex);
+      walkDone = true;
     }
+    memberChanged.notify_all();
+  });
 
-    extractedFile.close();
+  auto writeMembers = [&]() -> Status {
+    while (true) {
+      PreparedMember *member;
+      {
+        std::unique_lock lock(mutex);
+        memberChanged.wait(lock, [&]() {
+          return walkError.Failed() ||
+                 (members.empty() ? walkDone : members.front().ready);
+        });
+        if (walkError.Failed() || members.empty())
+          break;
+        member = &members.front();
+      }
+      BOOST_LEAF_CHECK(member->error.Rethrow());
+
+      auto const &header = member->header;
+      if (member->sparseMap) {
+        BOOST_LEAF_AUTO(inputFile, detail::FileDescriptor::Open(
+                                       header.fileName, O_RDONLY));
+        BOOST_LEAF_CHECK(WriteSparseMember(tarFile, header, inputFile,
+                                           *member->sparseMap, archiveIndex));
+      } else if (member->buffered) {
+        BOOST_LEAF_CHECK(WriteMemberHeader(tarFile, header, archiveIndex));
+        BOOST_LEAF_CHECK(tarFile.Write(member->data));
+        BOOST_LEAF_CHECK(
+            WriteZeros(tarFile, detail::PaddedSize(header.fileSize) -
+                                    member->data.size()));
+      } else {
+        BOOST_LEAF_CHECK(WriteMemberHeader(tarFile, header, archiveIndex));
+        if (HasData(header)) {
+          BOOST_LEAF_AUTO(inputFile, detail::FileDescriptor::Open(
+                                         header.fileName, O_RDONLY));
+          BOOST_LEAF_CHECK(CopyFileData(inputFile, header.fileSize, tarFile));
+        }
+      }
+
+      {
+        std::lock_guard lock(mutex);
+        if (member->buffered)
+          bufferedBytes -= header.fileSize;
+        members.pop_front();
+      }
+      memberChanged.notify_all();
+    }
+    return walkError.Rethrow();
+  };
+
+  auto status = writeMembers();
+
+  // Release the walk and workers still waiting for space after a failure
+  {
+    std::lock_guard lock(mutex);
+    aborted = true;
   }
+  entries.Stop();
+  memberChanged.notify_all();
+  feeder.join();
+  pool.Wait();
+
+  return status;
+}
 
-  tarFile.close();
+static std::uint64_t RecordSize(HandlerOptions const &options) {
+  return options.blockingFactor * detail::BLOCK_SIZE_B;
+}
+
+/**
+ * @brief Write a deletion marker for every path of the previous snapshot that
+ * the complete walk did not find again, or found with another type
+ */
+static Status WriteDeletionMarkers(detail::ArchiveSink &tarFile,
+                                   MemberSelection const &selection,
+                                   detail::ArchiveIndex *archiveIndex) {
+  for (auto &path : selection.previous->RemovedFrom(*selection.current)) {
+    common::ObjectHeader header{};
+    header.fileName = std::move(path);
+    header.linkIndicator = common::LinkIndicator::DELETED;
+    BOOST_LEAF_CHECK(WriteMemberHeader(tarFile, header, archiveIndex));
+  }
   return Success();
 }
 
-Status FileHandler::Compress(std::vector<std::string> filePaths) noexcept {
+/**
+ * @brief Walk the provided paths and write the members of the selected
+ * entries
+ */
+static Status WriteMembers(detail::ArchiveSink &tarFile,
+                           std::vector<std::string> filePaths,
+                           HandlerOptions const &options,
+                           detail::ArchiveIndex *archiveIndex,
+                           MemberSelection const &selection) {
+  detail::TreeWalker walker(std::move(filePaths), options.jobs,
+                            options.sortEntries);
+  MemberEntries entries(walker);
+
+  // Incremental archives start with their deletion markers, so the old
+  // objects are gone before anything is extracted in their place. Which paths
+  // are gone is only known once the walk is complete
+  if (selection.current) {
+    BOOST_LEAF_CHECK(entries.Collect(selection));
+    BOOST_LEAF_CHECK(WriteDeletionMarkers(tarFile, selection, archiveIndex));
+  }
+
+  LinkTargets linkTargets{};
+  if (options.jobs > 1)
+    return CompressParallel(tarFile, entries, options.jobs, archiveIndex,
+                            selection, linkTargets);
+
+  while (true) {
+    BOOST_LEAF_AUTO(entry, entries.Next());
+    if (!entry)
+      break;
+
+    auto header = MemberHeader(*entry);
+    if (!IsSelected(selection, *entry, header))
+      continue;
+    LinkToEarlierMember(linkTargets, *entry, header);
+    if (!HasData(header)) {
+      BOOST_LEAF_CHECK(WriteMemberHeader(tarFile, header, archiveIndex));
+      continue;
+    }
+
+    BOOST_LEAF_AUTO(inputFile,
+                    detail::FileDescriptor::Open(entry->path, O_RDONLY));
+    BOOST_LEAF_AUTO(sparseMap, detail::FindDataExtents(inputFile, entry->info));
+    if (sparseMap) {
+      BOOST_LEAF_CHECK(WriteSparseMember(tarFile, header, inputFile,
+                                         *sparseMap, archiveIndex));
+      continue;
+    }
+    BOOST_LEAF_CHECK(WriteMemberHeader(tarFile, header, archiveIndex));
+    BOOST_LEAF_CHECK(CopyFileData(inputFile, header.fileSize, tarFile));
+  }
+  return Success();
+}
+
+/**
+ * @brief End the archive and close it, then save its index if one is
+ * provided
+ */
+static Status CompleteArchive(detail::ArchiveSink &tarFile,
+                              std::string const &tarFilePath,
+                              HandlerOptions const &options,
+                              detail::ArchiveIndex *archiveIndex) {
+  BOOST_LEAF_CHECK(WriteEndOfArchive(tarFile, RecordSize(options)));
+  BOOST_LEAF_CHECK(tarFile.Close());
+
+  // The stamp is taken once the archive is complete, so the index is fresh
+  if (archiveIndex) {
+    BOOST_LEAF_AUTO(stamp, detail::ReadArchiveStamp(tarFilePath));
+    BOOST_LEAF_CHECK(archiveIndex->Save(detail::IndexPath(tarFilePath), stamp));
+  }
+  return Success();
+}
+
+/**
+ * @brief Find the end-of-archive marker of an existing archive, skipping
+ * over the data of its members without reading it
+ *
+ * The members are added to the index and their modification times to
+ * archived, where provided.
+ *
+ * @returns the offset of the marker, or of the end of the archive if it has
+ * none
+ */
+static Result<std::uint64_t> FindEndOfArchive(detail::ArchiveSource &tarFile,
+                                              detail::ArchiveIndex *archiveIndex,
+                                              MemberTimes *archived) {
+  detail::ExtendedHeader extended{};
+  while (true) {
+    auto offset = tarFile.Offset();
+    BOOST_LEAF_AUTO(next, detail::ReadHeader(tarFile, extended));
+    if (!next)
+      return {offset};
+
+    auto &header = *next;
+    BOOST_LEAF_AUTO(fileSize, header.FileSize());
+    if (archiveIndex) {
+      BOOST_LEAF_AUTO(fileMode, header.FileMode());
+      archiveIndex->Add(header.FileName(), fileSize, fileMode,
+                        tarFile.Offset() - detail::BLOCK_SIZE_B,
+                        header.SparseSize().has_value());
+    }
+    if (archived) {
+      BOOST_LEAF_AUTO(lastModified, header.LastModified());
+      auto &latest = (*archived)[std::string(header.FileName())];
+      latest = std::max(latest, lastModified);
+    }
+    BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+  }
+}
+
+/**
+ * @brief Extract a random access archive on a pool of worker threads
+ *
+ * A single pass over the headers collects the work list of members accepted
+ * by the filter. Members sharing a path are handled by one task in archive
+ * order, so a path is never written by two threads at once and the last member
+ * still wins. Links are created once all tasks are done.
+ */
+static Status ExtractParallel(detail::ArchiveSource &tarFile,
+                              detail::MemberFilter &filter,
+                              std::uint32_t jobs) {
+  // A deque keeps the names in place, they are the keys of pathIndex
+  std::deque<std::string> paths{};
+  std::vector<std::vector<ExtractJob>> pathJobs{};
+  std::unordered_map<std::string_view, std::size_t> pathIndex{};
+  std::vector<LinkJob> linkJobs{};
+  detail::ExtendedHeader extended{};
+  while (true) {
+    BOOST_LEAF_AUTO(next, detail::ReadHeader(tarFile, extended));
+    if (!next)
+      break;
+
+    auto &header = *next;
+    BOOST_LEAF_AUTO(fileSize, header.FileSize());
+    auto fileName = header.FileName();
+    auto dataOffset = tarFile.Offset();
+    if (!filter.Matches(fileName)) {
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+    BOOST_LEAF_CHECK(ValidatePath(fileName));
+
+    // Directories are created during the pass, before any of their contents
+    if (header.LinkIndicator() == common::LinkIndicator::DIRECTORY) {
+      BOOST_LEAF_CHECK(CreateDirectory(fileName));
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+
+    // Deleted paths are removed during the pass too, earlier members at or
+    // below the path are no longer written
+    if (header.LinkIndicator() == common::LinkIndicator::DELETED) {
+      for (auto const &[path, index] : pathIndex) {
+        if (IsRemovedBy(path, fileName))
+          pathJobs[index].clear();
+      }
+      RemoveLinkJobs(linkJobs, fileName);
+      BOOST_LEAF_CHECK(RemovePath(fileName));
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+    if (IsLink(header.LinkIndicator())) {
+      BOOST_LEAF_CHECK(AddLinkJob(linkJobs, header));
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+
+    // The header is only valid until the source moves on, so the name is
+    // copied before skipping the data
+    auto it = pathIndex.find(fileName);
+    if (it == pathIndex.end()) {
+      auto const &path = paths.emplace_back(fileName);
+      it = pathIndex.emplace(path, pathJobs.size()).first;
+      pathJobs.emplace_back();
+    }
+    pathJobs[it->second].push_back(
+        {fileSize, dataOffset, header.SparseSize()});
+    BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+  }
+
+  auto threadCount = std::min<std::size_t>(jobs, pathJobs.size());
+  detail::ErrorSlot errors{};
+  detail::ThreadPool pool(static_cast<std::uint32_t>(threadCount));
+  for (std::size_t index = 0; index < pathJobs.size(); index++) {
+    pool.Submit([&tarFile, &errors, &path = paths[index],
+                 &jobList = pathJobs[index]]() {
+      errors.Run([&]() -> Status {
+        for (auto const &job : jobList) {
+          if (errors.Failed())
+            return Success();
+
+          if (job.sparseSize) {
+            BOOST_LEAF_CHECK(WriteSparseMember(tarFile, path, job.fileSize,
+                                               job.dataOffset,
+                                               *job.sparseSize));
+            continue;
+          }
+          BOOST_LEAF_CHECK(
+              WriteMember(tarFile, path, job.fileSize, job.dataOffset));
+        }
+        return Success();
+      });
+    });
+  }
+  pool.Wait();
+
+  BOOST_LEAF_CHECK(errors.Rethrow());
+  return CreateLinks(linkJobs);
+}
+
+/**
+ * @brief Read the data of a small member, copying it into a buffer of the
+ * backend unless the source keeps it valid
+ */
+static Result<std::span<const char>>
+ReadMemberData(detail::ArchiveSource &tarFile, std::string const &tarFilePath,
+               detail::IoBackend &io, std::uint64_t fileSize) {
+  BOOST_LEAF_AUTO(data, tarFile.ReadData(fileSize));
+  if (data.size() == fileSize && tarFile.HasStableSpans())
+    return {data};
+
+  BOOST_LEAF_AUTO(buffer, io.Buffer(fileSize));
+  std::copy(data.begin(), data.end(), buffer.begin());
+  for (auto filled = data.size(); filled < fileSize; filled += data.size()) {
+    BOOST_LEAF_ASSIGN(data, tarFile.ReadData(fileSize - filled));
+    if (data.empty())
+      return NewError(
+          error::InvalidStream{tarFilePath, error::StreamType::INPUT});
+    std::copy(data.begin(), data.end(), buffer.begin() + filled);
+  }
+  return {std::span<const char>(buffer)};
+}
+
+/**
+ * @brief Extract the members accepted by the filter in a single pass over the
+ * archive
+ *
+ * Data of other members is skipped without being read where the source
+ * allows it. Members matching a name again later replace the earlier copy.
+ * Small members are written through the I/O backend, which may keep many of
+ * them in flight. Links are created at the end.
+ */
+static Status ExtractSequential(detail::ArchiveSource &tarFile,
+                                std::string const &tarFilePath,
+                                detail::MemberFilter &filter,
+                                detail::IoBackend &io) {
+  // Reused between members, so names are only allocated while it grows
+  std::string fileName{};
+  std::vector<LinkJob> linkJobs{};
+  detail::ExtendedHeader extended{};
+  while (true) {
+    BOOST_LEAF_AUTO(next, detail::ReadHeader(tarFile, extended));
+    if (!next)
+      break;
+
+    auto &header = *next;
+    BOOST_LEAF_AUTO(fileSize, header.FileSize());
+    if (!filter.Matches(header.FileName())) {
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+    BOOST_LEAF_CHECK(ValidatePath(header.FileName()));
+    if (header.LinkIndicator() == common::LinkIndicator::DIRECTORY) {
+      BOOST_LEAF_CHECK(CreateDirectory(header.FileName()));
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+    fileName.assign(header.FileName());
+
+    // Writes still in flight may be below a deleted directory, links are
+    // only created at the end
+    if (header.LinkIndicator() == common::LinkIndicator::DELETED) {
+      BOOST_LEAF_CHECK(io.Wait());
+      RemoveLinkJobs(linkJobs, fileName);
+      BOOST_LEAF_CHECK(RemovePath(fileName));
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+    if (IsLink(header.LinkIndicator())) {
+      BOOST_LEAF_CHECK(AddLinkJob(linkJobs, header));
+      BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize)));
+      continue;
+    }
+
+    // Sparse members restore their holes with a seek between the extents
+    if (auto sparseSize = header.SparseSize()) {
+      BOOST_LEAF_CHECK(io.Wait(fileName));
+      BOOST_LEAF_CHECK(ExtractSparseMember(tarFile, tarFilePath, fileName,
+                                           fileSize, *sparseSize));
+    } else if (fileSize <= detail::BACKEND_WRITE_MAX_B) {
+      BOOST_LEAF_AUTO(data,
+                      ReadMemberData(tarFile, tarFilePath, io, fileSize));
+      BOOST_LEAF_CHECK(io.WriteFile(fileName, data));
+    } else {
+      // Create new file with object contents, memory mapped archives copy
+      // large members inside the kernel
+      BOOST_LEAF_CHECK(io.Wait(fileName));
+      BOOST_LEAF_AUTO(extractedFile, CreateMember(fileName));
+      BOOST_LEAF_AUTO(copied, tarFile.CopyData(extractedFile, fileSize));
+      if (copied != fileSize)
+        return NewError(
+            error::InvalidStream{tarFilePath, error::StreamType::INPUT});
+      BOOST_LEAF_CHECK(extractedFile.Close());
+    }
+    BOOST_LEAF_CHECK(tarFile.Skip(detail::PaddedSize(fileSize) - fileSize));
+  }
+
+  BOOST_LEAF_CHECK(io.Wait());
+  return CreateLinks(linkJobs);
+}
+
+/**
+ * @brief Extract members by name straight from their index entries, without
+ * walking the archive
+ *
+ * The index does not hold link targets, links whose target may have been cut
+ * to the header field are added to unresolved instead, for a scan to extract
+ * them with their extension headers.
+ */
+static Status ExtractIndexed(detail::ArchiveSource &tarFile,
+                             detail::ArchiveIndex const &index,
+                             detail::MemberFilter &filter,
+                             std::vector<std::string> &unresolved) {
+  std::vector<LinkJob> linkJobs{};
+  detail::ExtendedHeader extended{};
+  for (auto const &fileName : filter.Patterns()) {
+    auto entry = index.Find(fileName);
+    if (!entry)
+      continue;
+
+    // Entries point past the extension headers, their values are taken from
+    // the index instead
+    extended.fileName.assign(entry->fileName);
+    extended.fileSize = entry->fileSize;
+    extended.sparseSize.reset();
+    if (entry->sparse)
+      extended.sparseSize = 0;
+    BOOST_LEAF_AUTO(block,
+                    tarFile.ReadAt(entry->headerOffset, detail::BLOCK_SIZE_B));
+    BOOST_LEAF_AUTO(header, detail::HeaderView::Open(block, &extended));
+    BOOST_LEAF_AUTO(fileSize, header.FileSize());
+    if (!filter.Matches(header.FileName()))
+      continue;
+    BOOST_LEAF_CHECK(ValidatePath(header.FileName()));
+
+    if (header.LinkIndicator() == common::LinkIndicator::DIRECTORY) {
+      BOOST_LEAF_CHECK(CreateDirectory(fileName));
+      continue;
+    }
+    if (header.LinkIndicator() == common::LinkIndicator::DELETED) {
+      BOOST_LEAF_CHECK(RemovePath(fileName));
+      continue;
+    }
+    if (IsLink(header.LinkIndicator())) {
+      if (header.LinkedFileName().size() + 1 >=
+          common::LINKED_FILE_NAME::size) {
+        unresolved.push_back(fileName);
+        continue;
+      }
+      BOOST_LEAF_CHECK(AddLinkJob(linkJobs, header));
+      continue;
+    }
+    auto dataOffset = entry->headerOffset + detail::BLOCK_SIZE_B;
+    if (auto sparseSize = header.SparseSize()) {
+      BOOST_LEAF_CHECK(WriteSparseMember(tarFile, fileName, fileSize,
+                                         dataOffset, *sparseSize));
+      continue;
+    }
+    BOOST_LEAF_CHECK(WriteMember(tarFile, fileName, fileSize, dataOffset));
+  }
+  return CreateLinks(linkJobs);
+}
+
+bool FileHandler::IsValid() noexcept {
+  auto validExtension = detail::CompressionOf(mTarFilePath).has_value();
+  return validExtension;
+}
+
+Result<ArchiveReader> FileHandler::ReadContents() noexcept {
   if (!IsValid()) {
     return NewError(error::InvalidFile{mTarFilePath});
   }
+  return ArchiveReader::Open(mTarFilePath);
+}
 
-  std::ofstream tarFile(mTarFilePath, std::ios::binary);
-  if (!tarFile) {
-    return NewError(
-        error::InvalidStream{mTarFilePath, error::StreamType::OUTPUT});
+Result<MemberReader> FileHandler::OpenMembers() noexcept {
+  if (!IsValid()) {
+    return NewError(error::InvalidFile{mTarFilePath});
   }
+  return MemberReader::Open(mTarFilePath);
+}
 
-  std::array<char, CHUNK_SIZE_B> buffer{0x00};
-  for (auto const &filePath : filePaths) {
-    std::ifstream inputFile(filePath, std::ios::binary);
-    if (!inputFile)
-      return NewError(error::InvalidStream{filePath, error::StreamType::INPUT});
+Result<common::HeaderTable> FileHandler::ListContents() noexcept {
+  BOOST_LEAF_AUTO(reader, ReadContents());
 
-    // Extract file information
-    struct stat fileInfo;
-    if (stat(filePath.data(), &fileInfo) != 0) {
-      return NewError(error::InvalidFile{filePath});
-    }
+  common::HeaderTable output{};
+  for (auto &member : reader) {
+    BOOST_LEAF_CHECK(member);
+    output.Add(member.value());
+  }
 
-    common::ObjectHeader header{};
-    header.fileName = filePath;
-    header.fileSize = fileInfo.st_size;
-    header.fileMode = fileInfo.st_mode;
-    header.userID = fileInfo.st_uid;
-    header.groupID = fileInfo.st_gid;
+  return {std::move(output)};
+}
 
-    // Write to output buffer
-    BOOST_LEAF_CHECK(detail::SerialiseHeader(header, buffer));
-    tarFile.write(buffer.data(), buffer.size());
+Status FileHandler::Extract(std::vector<std::string> patterns) noexcept {
+  if (!IsValid()) {
+    return NewError(error::InvalidFile{mTarFilePath});
+  }
 
-    std::fill(buffer.begin(), buffer.end(), 0x00);
-    while (inputFile.read(buffer.data(), CHUNK_SIZE_B) || inputFile.gcount()) {
-      tarFile.write(buffer.data(), CHUNK_SIZE_B);
-      std::fill(buffer.begin(), buffer.end(), 0x00);
+  BOOST_LEAF_AUTO(tarFile, detail::OpenArchiveSource(mTarFilePath));
+  detail::MemberFilter filter(std::move(patterns));
+
+  // Names without wildcards are looked up in an up to date index
+  std::optional<detail::ArchiveIndex> index{};
+  if (!filter.Patterns().empty() && !filter.HasGlobs() &&
+      tarFile->IsRandomAccess())
+    index = detail::LoadIndex(mTarFilePath);
+
+  if (index) {
+    std::vector<std::string> unresolved{};
+    BOOST_LEAF_CHECK(ExtractIndexed(*tarFile, *index, filter, unresolved));
+    if (!unresolved.empty()) {
+      detail::MemberFilter scanFilter(std::move(unresolved));
+      auto io = detail::OpenIoBackend(mOptions.asyncIo);
+      BOOST_LEAF_CHECK(
+          ExtractSequential(*tarFile, mTarFilePath, scanFilter, *io));
     }
+  } else if (mOptions.jobs > 1 && tarFile->IsRandomAccess()) {
+    BOOST_LEAF_CHECK(ExtractParallel(*tarFile, filter, mOptions.jobs));
+  } else {
+    auto io = detail::OpenIoBackend(mOptions.asyncIo);
+    BOOST_LEAF_CHECK(ExtractSequential(*tarFile, mTarFilePath, filter, *io));
+  }
+
+  auto unmatched = filter.Unmatched();
+  if (!unmatched.empty())
+    return NewError(error::MemberNotFound{unmatched.front()});
+  return Success();
+}
+
+Status FileHandler::Verify() noexcept {
+  if (!IsValid()) {
+    return NewError(error::InvalidFile{mTarFilePath});
+  }
+
+  BOOST_LEAF_AUTO(tarFile, detail::OpenArchiveSource(mTarFilePath));
+  return detail::VerifyArchive(*tarFile, mTarFilePath, mOptions.jobs);
+}
 
-    inputFile.close();
+Status FileHandler::BuildIndex() noexcept {
+  // Indexes are tied to an archive file, the standard input is read once
+  if (!IsValid() || detail::IsStandardStream(mTarFilePath)) {
+    return NewError(error::InvalidFile{mTarFilePath});
   }
 
-  tarFile.close();
+  BOOST_LEAF_AUTO(stamp, detail::ReadArchiveStamp(mTarFilePath));
+  BOOST_LEAF_AUTO(tarFile, detail::OpenArchiveSource(mTarFilePath));
+  BOOST_LEAF_AUTO(index, detail::ArchiveIndex::Build(*tarFile));
+  return index.Save(detail::IndexPath(mTarFilePath), stamp);
+}
 
+Status FileHandler::Compress(std::vector<std::string> filePaths) noexcept {
+  if (!IsValid()) {
+    return NewError(error::InvalidFile{mTarFilePath});
+  }
+
+  BOOST_LEAF_AUTO(tarFile, detail::OpenArchiveSink(mTarFilePath, mOptions.jobs,
+                                                   RecordSize(mOptions)));
+
+  // Archives written to the standard output have no file to index
+  detail::ArchiveIndex index{};
+  auto indexed =
+      mOptions.buildIndex && !detail::IsStandardStream(mTarFilePath);
+  auto indexPtr = indexed ? &index : nullptr;
+
+  MemberSelection selection{};
+  detail::Snapshot previous{};
+  detail::Snapshot current{};
+  auto incremental = !mOptions.snapshotPath.empty();
+  if (incremental) {
+    BOOST_LEAF_ASSIGN(previous, detail::Snapshot::Load(mOptions.snapshotPath));
+    selection.previous = &previous;
+    selection.current = &current;
+  }
+
+  BOOST_LEAF_CHECK(WriteMembers(*tarFile, std::move(filePaths), mOptions,
+                                indexPtr, selection));
+  BOOST_LEAF_CHECK(CompleteArchive(*tarFile, mTarFilePath, mOptions, indexPtr));
+
+  // Only replaced once the archive is complete, so a failed run is repeated
+  // against the same snapshot
+  if (incremental)
+    BOOST_LEAF_CHECK(current.Save(mOptions.snapshotPath));
   return Success();
 }
 
+Status FileHandler::Append(std::vector<std::string> filePaths) noexcept {
+  return AddMembers(std::move(filePaths), false);
+}
+
+Status FileHandler::Update(std::vector<std::string> filePaths) noexcept {
+  return AddMembers(std::move(filePaths), true);
+}
+
+Status FileHandler::AddMembers(std::vector<std::string> filePaths,
+                               bool update) noexcept {
+  // Members are added in place, which needs a seekable archive file
+  if (detail::IsStandardStream(mTarFilePath) ||
+      detail::CompressionOf(mTarFilePath) != detail::Compression::NONE) {
+    return NewError(error::InvalidFile{mTarFilePath});
+  }
+
+  // An existing index is kept up to date, the scan lists every member anyway
+  struct stat fileInfo;
+  auto indexed = mOptions.buildIndex ||
+                 stat(detail::IndexPath(mTarFilePath).c_str(), &fileInfo) == 0;
+  detail::ArchiveIndex index{};
+  auto indexPtr = indexed ? &index : nullptr;
+  MemberTimes archived{};
+  auto archivedPtr = update ? &archived : nullptr;
+
+  // A missing archive is created, as by tar
+  std::uint64_t end = 0;
+  if (stat(mTarFilePath.c_str(), &fileInfo) == 0) {
+    BOOST_LEAF_AUTO(source, detail::OpenArchiveSource(mTarFilePath));
+    BOOST_LEAF_ASSIGN(end, FindEndOfArchive(*source, indexPtr, archivedPtr));
+  }
+
+  BOOST_LEAF_AUTO(tarFile, detail::OpenArchiveSinkAt(mTarFilePath, end,
+                                                     RecordSize(mOptions)));
+  BOOST_LEAF_CHECK(WriteMembers(*tarFile, std::move(filePaths), mOptions,
+                                indexPtr, {.archived = archivedPtr}));
+  return CompleteArchive(*tarFile, mTarFilePath, mOptions, indexPtr);
+}
+
 } // namespace cc::tar
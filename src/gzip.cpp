@@ -0,0 +1,306 @@
+#include "gzip.hpp"
+
+#include <algorithm>
+#include <array>
+#include <zlib.h>
+
+#include "detail.hpp"
+#include "error_code.hpp"
+
+namespace cc::tar::detail {
+
+// Compressed bytes handed to inflate per read from the underlying source
+static constexpr std::uint64_t GZIP_INPUT_SIZE_B = 256 << 10;
+
+// Decompressed chunks are a multiple of the block size, so no header is ever
+// split across two chunks
+static constexpr std::size_t GZIP_CHUNK_SIZE_B = 1 << 20;
+static_assert(GZIP_CHUNK_SIZE_B % BLOCK_SIZE_B == 0);
+
+static constexpr std::size_t MAX_QUEUED_CHUNKS = 4;
+
+// Uncompressed bytes per independently deflated block
+static constexpr std::size_t GZIP_BLOCK_SIZE_B = 128 << 10;
+
+static constexpr std::size_t GZIP_DICTIONARY_SIZE_B = 32 << 10;
+
+GzipSource::GzipSource(std::string fileName,
+                       std::unique_ptr<ArchiveSource> compressed)
+    : mFileName(std::move(fileName)), mCompressed(std::move(compressed)) {
+  mInflateThread = std::thread([this]() {
+    mErrors.Run([this]() { return Inflate(); });
+    {
+      std::lock_guard lock(mMutex);
+      mFinished = true;
+    }
+    mChunkAdded.notify_all();
+  });
+}
+
+GzipSource::~GzipSource() {
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mChunkTaken.notify_all();
+  mInflateThread.join();
+}
+
+Status GzipSource::Inflate() {
+  z_stream stream{};
+  // Window bits of 15 with 16 added to expect a gzip wrapper
+  if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK)
+    return NewError(error::UnexpectedError{});
+  std::unique_ptr<z_stream, decltype(&inflateEnd)> streamGuard(&stream,
+                                                              inflateEnd);
+
+  std::vector<char> chunk(GZIP_CHUNK_SIZE_B);
+  std::size_t filled = 0;
+  bool memberEnded = false;
+  while (true) {
+    if (stream.avail_in == 0) {
+      BOOST_LEAF_AUTO(input, mCompressed->ReadData(GZIP_INPUT_SIZE_B));
+      if (input.empty())
+        break;
+      stream.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+      stream.avail_in = static_cast<uInt>(input.size());
+    }
+
+    // Another gzip member follows the one that just ended
+    if (memberEnded) {
+      inflateReset(&stream);
+      memberEnded = false;
+    }
+
+    stream.next_out = reinterpret_cast<Bytef *>(chunk.data() + filled);
+    stream.avail_out = static_cast<uInt>(chunk.size() - filled);
+    auto result = inflate(&stream, Z_NO_FLUSH);
+    if (result == Z_STREAM_END)
+      memberEnded = true;
+    else if (result != Z_OK && result != Z_BUF_ERROR)
+      return NewError(error::InvalidConversion{});
+
+    filled = chunk.size() - stream.avail_out;
+    if (filled == chunk.size()) {
+      if (!PushChunk(std::move(chunk)))
+        return Success();
+      chunk = std::vector<char>(GZIP_CHUNK_SIZE_B);
+      filled = 0;
+    }
+  }
+
+  if (!memberEnded)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+
+  chunk.resize(filled);
+  if (!chunk.empty())
+    (void)PushChunk(std::move(chunk));
+  return Success();
+}
+
+bool GzipSource::PushChunk(std::vector<char> chunk) {
+  {
+    std::unique_lock lock(mMutex);
+    mChunkTaken.wait(lock, [this]() {
+      return mStopping || mChunks.size() < MAX_QUEUED_CHUNKS;
+    });
+    if (mStopping)
+      return false;
+    mChunks.push_back(std::move(chunk));
+  }
+  mChunkAdded.notify_one();
+  return true;
+}
+
+Result<bool> GzipSource::NextChunk() {
+  {
+    std::unique_lock lock(mMutex);
+    mChunkAdded.wait(lock, [this]() { return mFinished || !mChunks.empty(); });
+    if (!mChunks.empty()) {
+      mCurrent = std::move(mChunks.front());
+      mChunks.pop_front();
+      mPosition = 0;
+    } else {
+      mCurrent.clear();
+      mPosition = 0;
+    }
+  }
+  mChunkTaken.notify_one();
+
+  if (mCurrent.empty()) {
+    BOOST_LEAF_CHECK(mErrors.Rethrow());
+    return {false};
+  }
+  return {true};
+}
+
+Result<std::span<const char>> GzipSource::ReadBlock() {
+  if (mPosition == mCurrent.size()) {
+    BOOST_LEAF_AUTO(available, NextChunk());
+    if (!available)
+      return {std::span<const char>{}};
+  }
+  if (mCurrent.size() - mPosition < BLOCK_SIZE_B)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+
+  std::span<const char> block(mCurrent.data() + mPosition, BLOCK_SIZE_B);
+  mPosition += BLOCK_SIZE_B;
+  mOffset += BLOCK_SIZE_B;
+  return {block};
+}
+
+Result<std::span<const char>> GzipSource::ReadData(std::uint64_t maxSize) {
+  if (mPosition == mCurrent.size()) {
+    BOOST_LEAF_AUTO(available, NextChunk());
+    if (!available)
+      return {std::span<const char>{}};
+  }
+
+  auto size = std::min<std::uint64_t>(maxSize, mCurrent.size() - mPosition);
+  std::span<const char> data(mCurrent.data() + mPosition, size);
+  mPosition += size;
+  mOffset += size;
+  return {data};
+}
+
+Status GzipSource::Skip(std::uint64_t size) {
+  while (size > 0) {
+    BOOST_LEAF_AUTO(data, ReadData(size));
+    if (data.empty())
+      return NewError(
+          error::InvalidStream{mFileName, error::StreamType::INPUT});
+    size -= data.size();
+  }
+  return Success();
+}
+
+GzipSink::GzipSink(std::string fileName, std::unique_ptr<ArchiveSink> output,
+                   std::uint32_t jobs)
+    : mFileName(std::move(fileName)), mOutput(std::move(output)),
+      mMaxPendingBlocks(2 * static_cast<std::size_t>(jobs)),
+      mChecksum(crc32(0, Z_NULL, 0)), mPool(jobs) {
+  mInput.reserve(GZIP_BLOCK_SIZE_B);
+}
+
+Status GzipSink::Write(std::span<const char> data) {
+  while (!data.empty()) {
+    auto size = std::min(data.size(), GZIP_BLOCK_SIZE_B - mInput.size());
+    mInput.insert(mInput.end(), data.begin(), data.begin() + size);
+    data = data.subspan(size);
+    mOffset += size;
+
+    if (mInput.size() == GZIP_BLOCK_SIZE_B)
+      BOOST_LEAF_CHECK(SubmitBlock(false));
+  }
+  return Success();
+}
+
+Status GzipSink::Close() {
+  BOOST_LEAF_CHECK(SubmitBlock(true));
+  while (!mPendingBlocks.empty())
+    BOOST_LEAF_CHECK(WriteOldestBlock());
+
+  // Trailer with the checksum and size of the uncompressed data
+  std::array<char, 8> trailer{};
+  for (std::size_t i = 0; i < 4; i++) {
+    trailer[i] = static_cast<char>((mChecksum >> (8 * i)) & 0xFF);
+    trailer[4 + i] = static_cast<char>((mOffset >> (8 * i)) & 0xFF);
+  }
+  BOOST_LEAF_CHECK(mOutput->Write(trailer));
+  return mOutput->Close();
+}
+
+static bool DeflateBlock(std::vector<char> const &input,
+                         std::vector<char> const &dictionary, bool last,
+                         std::vector<char> &output) {
+  z_stream stream{};
+  // Negative window bits produce raw deflate data without a wrapper
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  if (!dictionary.empty())
+    deflateSetDictionary(&stream,
+                         reinterpret_cast<const Bytef *>(dictionary.data()),
+                         static_cast<uInt>(dictionary.size()));
+
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+
+  // Blocks other than the last end in a sync flush, which leaves the deflate
+  // stream on a byte boundary without marking it as final
+  output.resize(deflateBound(&stream, stream.avail_in) + 16);
+  auto flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+  bool finished = false;
+  while (!finished) {
+    stream.next_out = reinterpret_cast<Bytef *>(output.data()) +
+                      stream.total_out;
+    stream.avail_out = static_cast<uInt>(output.size() - stream.total_out);
+    auto result = deflate(&stream, flush);
+    if (result == Z_STREAM_ERROR)
+      break;
+
+    finished = stream.avail_out != 0 && (!last || result == Z_STREAM_END);
+    output.resize(finished ? stream.total_out : output.size() * 2);
+  }
+  deflateEnd(&stream);
+  return finished;
+}
+
+Status GzipSink::SubmitBlock(bool last) {
+  if (!mHeaderWritten) {
+    // Minimal gzip header: deflate method, no flags or timestamp, Unix
+    static constexpr std::array<char, 10> GZIP_HEADER = {
+        '\x1f', '\x8b', '\x08', 0, 0, 0, 0, 0, 0, '\x03'};
+    BOOST_LEAF_CHECK(mOutput->Write(GZIP_HEADER));
+    mHeaderWritten = true;
+  }
+
+  while (mPendingBlocks.size() >= mMaxPendingBlocks)
+    BOOST_LEAF_CHECK(WriteOldestBlock());
+
+  auto block = std::make_shared<CompressedBlock>();
+  block->size = mInput.size();
+  auto dictionary = mDictionary;
+  auto dictionarySize = static_cast<std::ptrdiff_t>(
+      std::min(mInput.size(), GZIP_DICTIONARY_SIZE_B));
+  mDictionary.assign(mInput.end() - dictionarySize, mInput.end());
+
+  auto input = std::move(mInput);
+  mInput = {};
+  mInput.reserve(GZIP_BLOCK_SIZE_B);
+
+  mPendingBlocks.push_back(block);
+  mPool.Submit([this, block, last, input = std::move(input),
+                dictionary = std::move(dictionary)]() {
+    auto deflated = DeflateBlock(input, dictionary, last, block->data);
+    auto checksum = crc32(0, reinterpret_cast<const Bytef *>(input.data()),
+                          static_cast<uInt>(input.size()));
+    {
+      std::lock_guard lock(mMutex);
+      block->checksum = checksum;
+      block->failed = !deflated;
+      block->done = true;
+    }
+    mBlockDone.notify_all();
+  });
+  return Success();
+}
+
+Status GzipSink::WriteOldestBlock() {
+  auto block = mPendingBlocks.front();
+  {
+    std::unique_lock lock(mMutex);
+    mBlockDone.wait(lock, [&block]() { return block->done; });
+  }
+  mPendingBlocks.pop_front();
+
+  if (block->failed)
+    return NewError(error::UnexpectedError{});
+  BOOST_LEAF_CHECK(mOutput->Write(block->data));
+  mChecksum = crc32_combine(mChecksum, block->checksum,
+                            static_cast<z_off_t>(block->size));
+  return Success();
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,96 @@
+#include "header_table.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace cc::tar::common {
+
+/**
+ * @brief Reorder a column so that element i holds the element at order[i]
+ */
+template <typename T>
+static void Permute(std::vector<T> &column,
+                    std::vector<std::size_t> const &order) {
+  std::vector<T> sorted{};
+  sorted.reserve(column.size());
+  for (auto index : order)
+    sorted.push_back(column[index]);
+  column = std::move(sorted);
+}
+
+void HeaderTable::Reserve(std::size_t members, std::size_t nameBytes) {
+  mNames.reserve(nameBytes);
+  mFileNames.reserve(members);
+  mFileSizes.reserve(members);
+  mFileModes.reserve(members);
+  mUserIDs.reserve(members);
+  mGroupIDs.reserve(members);
+  mLinkIndicators.reserve(members);
+  mLinkedFileNames.reserve(members);
+}
+
+HeaderTable::NameRef HeaderTable::Intern(std::string_view name) {
+  NameRef ref{.offset = mNames.size(), .size = name.size()};
+  mNames.insert(mNames.end(), name.begin(), name.end());
+  return ref;
+}
+
+void HeaderTable::Add(HeaderRow const &row) {
+  mFileNames.push_back(Intern(row.fileName));
+  mFileSizes.push_back(row.fileSize);
+  mFileModes.push_back(row.fileMode);
+  mUserIDs.push_back(row.userID);
+  mGroupIDs.push_back(row.groupID);
+  mLinkIndicators.push_back(row.linkIndicator);
+  mLinkedFileNames.push_back(Intern(row.linkedFileName));
+}
+
+void HeaderTable::Add(ObjectHeader const &header) {
+  Add(HeaderRow{.fileName = header.fileName,
+                .fileSize = header.fileSize,
+                .fileMode = header.fileMode,
+                .userID = header.userID,
+                .groupID = header.groupID,
+                .linkIndicator = header.linkIndicator,
+                .linkedFileName = header.linkedFileName});
+}
+
+void HeaderTable::SortByName() {
+  std::vector<std::size_t> order(Size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [this](std::size_t a, std::size_t b) {
+                     return NameOf(mFileNames[a]) < NameOf(mFileNames[b]);
+                   });
+
+  // The name pool stays in archive order, only the references move
+  Permute(mFileNames, order);
+  Permute(mFileSizes, order);
+  Permute(mFileModes, order);
+  Permute(mUserIDs, order);
+  Permute(mGroupIDs, order);
+  Permute(mLinkIndicators, order);
+  Permute(mLinkedFileNames, order);
+}
+
+HeaderRow HeaderTable::operator[](std::size_t index) const {
+  return {.fileName = NameOf(mFileNames[index]),
+          .fileSize = mFileSizes[index],
+          .fileMode = mFileModes[index],
+          .userID = mUserIDs[index],
+          .groupID = mGroupIDs[index],
+          .linkIndicator = mLinkIndicators[index],
+          .linkedFileName = NameOf(mLinkedFileNames[index])};
+}
+
+std::size_t HeaderTable::Capacity() const {
+  return mNames.capacity() +
+         (mFileNames.capacity() + mLinkedFileNames.capacity()) *
+             sizeof(NameRef) +
+         (mFileSizes.capacity() + mFileModes.capacity() +
+          mUserIDs.capacity() + mGroupIDs.capacity()) *
+             sizeof(std::uint64_t) +
+         mLinkIndicators.capacity() * sizeof(LinkIndicator);
+}
+
+} // namespace cc::tar::common
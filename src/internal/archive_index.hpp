@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "archive_source.hpp"
+#include "common.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Location and metadata of a single archive member in the index
+ */
+struct IndexEntry {
+  std::string_view fileName;
+  std::uint64_t headerOffset;
+  std::uint64_t fileSize;
+  std::uint64_t fileMode;
+  // The map of a sparse member starts its data, its restored size is taken
+  // from there
+  bool sparse;
+};
+
+/**
+ * @brief Size and modification time of the archive an index was built for,
+ * used to detect stale indexes
+ */
+struct ArchiveStamp {
+  std::uint64_t size;
+  std::uint64_t modifiedSeconds;
+  std::uint64_t modifiedNanoseconds;
+
+  bool operator==(ArchiveStamp const &) const = default;
+};
+
+[[nodiscard]] Result<ArchiveStamp> ReadArchiveStamp(std::string const &path);
+
+/**
+ * @brief Sidecar index of an archive with its members sorted by name
+ *
+ * The binary layout on disk is a fixed header, followed by one fixed size
+ * record per member and a single pool holding all member names.
+ */
+class ArchiveIndex {
+public:
+  /**
+   * @brief Add a member, \ref Sort has to be called before lookups
+   */
+  void Add(common::ObjectHeader const &header, std::uint64_t headerOffset);
+
+  void Add(std::string_view fileName, std::uint64_t fileSize,
+           std::uint64_t fileMode, std::uint64_t headerOffset, bool sparse);
+
+  void Sort();
+
+  /**
+   * @brief Look up a member of a sorted index by name
+   * @returns the last member with this name in the archive, if any
+   */
+  [[nodiscard]] std::optional<IndexEntry>
+  Find(std::string_view fileName) const;
+
+  /**
+   * @brief All members in the order in which they appear in the archive
+   */
+  [[nodiscard]] std::vector<IndexEntry> Entries() const;
+
+  [[nodiscard]] std::size_t Size() const { return mRecords.size(); }
+
+  [[nodiscard]] Status Save(std::string const &indexPath,
+                            ArchiveStamp const &stamp);
+
+  /**
+   * @brief Load the index at indexPath if it matches the provided stamp
+   * @returns the index, or 'std::nullopt' if it is missing, stale or damaged
+   */
+  [[nodiscard]] static std::optional<ArchiveIndex>
+  Load(std::string const &indexPath, ArchiveStamp const &stamp);
+
+  /**
+   * @brief Build the index of an archive with a scan over its headers
+   */
+  [[nodiscard]] static Result<ArchiveIndex> Build(ArchiveSource &tarFile);
+
+private:
+  static constexpr std::uint32_t SPARSE_FLAG = 1;
+
+  struct Record {
+    std::uint64_t nameOffset;
+    std::uint32_t nameSize;
+    std::uint32_t flags;
+    std::uint64_t headerOffset;
+    std::uint64_t fileSize;
+    std::uint64_t fileMode;
+  };
+
+  [[nodiscard]] std::string_view NameOf(Record const &record) const {
+    return {mNames.data() + record.nameOffset, record.nameSize};
+  }
+
+  [[nodiscard]] IndexEntry EntryOf(Record const &record) const {
+    return {NameOf(record), record.headerOffset, record.fileSize,
+            record.fileMode, (record.flags & SPARSE_FLAG) != 0};
+  }
+
+  std::vector<Record> mRecords{};
+  std::string mNames{};
+};
+
+/**
+ * @brief Path of the sidecar index belonging to an archive
+ */
+[[nodiscard]] inline std::string IndexPath(std::string const &tarFilePath) {
+  return tarFilePath + ".idx";
+}
+
+/**
+ * @brief Load the sidecar index of an archive, provided it is up to date
+ */
+[[nodiscard]] std::optional<ArchiveIndex>
+LoadIndex(std::string const &tarFilePath);
+
+} // namespace cc::tar::detail
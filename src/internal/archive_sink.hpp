@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "detail.hpp"
+#include "posix_file.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Sequential destination for the bytes of a tar archive
+ */
+class ArchiveSink {
+public:
+  virtual ~ArchiveSink() = default;
+
+  [[nodiscard]] virtual Status Write(std::span<const char> data) = 0;
+
+  /**
+   * @brief Copy up to size bytes from the provided offset of the input file
+   * @returns the number of bytes copied, fewer than size only if the input
+   * ended early
+   */
+  [[nodiscard]] virtual Result<std::uint64_t>
+  CopyFrom(FileDescriptor const &input, std::uint64_t offset,
+           std::uint64_t size);
+
+  /**
+   * @brief Mark the start of the headers of a member, where compressing sinks
+   * prefer to begin a new independently decompressible unit
+   */
+  [[nodiscard]] virtual Status BeginMember() { return Success(); }
+
+  /**
+   * @brief Whether \ref CopyFrom hands large copies to the kernel, so there is
+   * no point in reading them into memory up front
+   */
+  [[nodiscard]] virtual bool CopiesInKernel() const { return false; }
+
+  /**
+   * @brief Flush all pending data and complete the archive
+   */
+  [[nodiscard]] virtual Status Close() = 0;
+
+  /**
+   * @brief Number of bytes of the tar stream written so far, before any
+   * compression
+   */
+  [[nodiscard]] virtual std::uint64_t Offset() const = 0;
+
+protected:
+  /**
+   * @brief Copy size bytes of the input from the provided offset by reading
+   * them into memory and passing them to \ref Write
+   * @returns the number of bytes copied
+   */
+  [[nodiscard]] Result<std::uint64_t> CopyThroughBuffer(
+      FileDescriptor const &input, std::uint64_t offset, std::uint64_t size);
+};
+
+/**
+ * @brief Archive sink writing to a file descriptor through a page-aligned
+ * buffer of whole records
+ *
+ * Headers and data are packed into the buffer, which is written once it is
+ * full. Large input files are copied into the archive by the kernel instead
+ * when it is a regular file. Devices and pipes take every input through the
+ * buffer, so each write is a whole number of records.
+ */
+class FileSink : public ArchiveSink {
+public:
+  /**
+   * @param offset position of the descriptor in an existing archive, which
+   * is cut off after the written data on \ref Close
+   */
+  FileSink(FileDescriptor file, std::uint64_t recordSize,
+           std::uint64_t offset = 0);
+
+  [[nodiscard]] Status Write(std::span<const char> data) override;
+
+  [[nodiscard]] Result<std::uint64_t> CopyFrom(FileDescriptor const &input,
+                                               std::uint64_t offset,
+                                               std::uint64_t size) override;
+
+  [[nodiscard]] bool CopiesInKernel() const override {
+    return mCopiesInKernel;
+  }
+
+  [[nodiscard]] Status Close() override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  [[nodiscard]] Status Flush();
+
+  FileDescriptor mFile;
+  AlignedBuffer mBuffer;
+  std::size_t mUsed{0};
+  std::uint64_t mOffset;
+  bool mAppending;
+  // Only regular files may be written in pieces that are not whole records
+  bool mCopiesInKernel;
+};
+
+/**
+ * @brief Create the archive at the provided path, compressing it on jobs
+ * threads if its extension asks for compression
+ */
+[[nodiscard]] Result<std::unique_ptr<ArchiveSink>>
+OpenArchiveSink(std::string const &filePath, std::uint32_t jobs,
+                std::uint64_t recordSize = DEFAULT_BLOCKING_FACTOR *
+                                           BLOCK_SIZE_B);
+
+/**
+ * @brief Open an existing uncompressed archive to write new members over its
+ * end-of-archive marker, which starts at offset
+ */
+[[nodiscard]] Result<std::unique_ptr<ArchiveSink>>
+OpenArchiveSinkAt(std::string const &filePath, std::uint64_t offset,
+                  std::uint64_t recordSize);
+
+} // namespace cc::tar::detail
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "detail.hpp"
+#include "posix_file.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Sequential view on the bytes of a tar archive
+ *
+ * Spans returned by the read functions remain valid until the next call on
+ * the same source.
+ */
+class ArchiveSource {
+public:
+  virtual ~ArchiveSource() = default;
+
+  /**
+   * @brief Read the next 512 byte block of the archive
+   * @returns the block, or an empty span if the end of the archive was reached
+   */
+  [[nodiscard]] virtual Result<std::span<const char>> ReadBlock() = 0;
+
+  /**
+   * @brief Read up to maxSize bytes of member data
+   * @returns a non-empty span of at most maxSize bytes, or an empty span if the
+   * end of the archive was reached
+   */
+  [[nodiscard]] virtual Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) = 0;
+
+  /**
+   * @brief Advance the read position without inspecting the skipped bytes
+   */
+  [[nodiscard]] virtual Status Skip(std::uint64_t size) = 0;
+
+  /**
+   * @brief Number of bytes of the archive consumed so far
+   */
+  [[nodiscard]] virtual std::uint64_t Offset() const = 0;
+
+  /**
+   * @brief Total number of bytes of the archive, known for random access
+   * sources only
+   */
+  [[nodiscard]] virtual std::optional<std::uint64_t> Size() const {
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Whether \ref ReadAt is supported by this source
+   */
+  [[nodiscard]] virtual bool IsRandomAccess() const { return false; }
+
+  /**
+   * @brief Whether returned spans remain valid for the lifetime of the source
+   * instead of until the next call
+   */
+  [[nodiscard]] virtual bool HasStableSpans() const { return false; }
+
+  /**
+   * @brief Thread-safe view of size bytes at an absolute offset, independent
+   * of the sequential read position
+   */
+  [[nodiscard]] virtual Result<std::span<const char>>
+  ReadAt(std::uint64_t offset, std::uint64_t size) const;
+
+  /**
+   * @brief Copy up to size bytes of member data to the current position of
+   * the output file
+   * @returns the number of bytes copied, fewer than size only if the end of
+   * the archive was reached
+   */
+  [[nodiscard]] virtual Result<std::uint64_t>
+  CopyData(FileDescriptor const &output, std::uint64_t size);
+
+  /**
+   * @brief Thread-safe copy of size bytes at an absolute offset to the current
+   * position of the output file
+   */
+  [[nodiscard]] virtual Status CopyAt(std::uint64_t offset, std::uint64_t size,
+                                      FileDescriptor const &output) const;
+};
+
+/**
+ * @brief Archive source backed by a read-only memory mapping of the archive
+ *
+ * All returned spans point straight into the mapping, so no bytes are copied
+ * and they remain valid for the lifetime of the source. Large members are
+ * copied out by the kernel from the archive file itself, without touching the
+ * mapping.
+ */
+class MappedSource : public ArchiveSource {
+public:
+  MappedSource(FileDescriptor file, std::uint64_t size, void *mapping)
+      : mFile(std::move(file)), mSize(size),
+        mMapping(static_cast<const char *>(mapping)) {}
+  MappedSource(MappedSource const &) = delete;
+  MappedSource &operator=(MappedSource const &) = delete;
+  ~MappedSource() override;
+
+  [[nodiscard]] Result<std::span<const char>> ReadBlock() override;
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) override;
+
+  [[nodiscard]] Status Skip(std::uint64_t size) override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+  [[nodiscard]] std::optional<std::uint64_t> Size() const override {
+    return mSize;
+  }
+
+  [[nodiscard]] bool IsRandomAccess() const override { return true; }
+
+  [[nodiscard]] bool HasStableSpans() const override { return true; }
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadAt(std::uint64_t offset, std::uint64_t size) const override;
+
+  [[nodiscard]] Result<std::uint64_t> CopyData(FileDescriptor const &output,
+                                               std::uint64_t size) override;
+
+  [[nodiscard]] Status CopyAt(std::uint64_t offset, std::uint64_t size,
+                              FileDescriptor const &output) const override;
+
+private:
+  FileDescriptor mFile;
+  std::uint64_t mSize;
+  const char *mMapping;
+  std::uint64_t mOffset{0};
+};
+
+/**
+ * @brief Archive source reading a standard input stream in large transfers
+ * into a page-aligned buffer, used for inputs that can not be memory mapped
+ */
+class StreamSource : public ArchiveSource {
+public:
+  StreamSource(std::string fileName, std::unique_ptr<std::istream> stream,
+               std::size_t bufferSize)
+      : mFileName(std::move(fileName)), mStream(std::move(stream)),
+        mBuffer(bufferSize) {}
+
+  [[nodiscard]] Result<std::span<const char>> ReadBlock() override;
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) override;
+
+  [[nodiscard]] Status Skip(std::uint64_t size) override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  /**
+   * @brief Refill the buffer behind the unread bytes until at least minimum
+   * bytes are available or the stream ends
+   */
+  void Fill(std::size_t minimum);
+
+  [[nodiscard]] std::size_t Available() const { return mEnd - mPosition; }
+
+  std::string mFileName;
+  std::unique_ptr<std::istream> mStream;
+  AlignedBuffer mBuffer;
+  std::size_t mPosition{0};
+  std::size_t mEnd{0};
+  std::uint64_t mOffset{0};
+};
+
+/**
+ * @brief Read the header of the next member, applying the extension headers
+ * in front of it
+ *
+ * The view is valid until the source moves on or extended is reused.
+ *
+ * @returns the header, or std::nullopt at the end of the archive
+ */
+[[nodiscard]] Result<std::optional<HeaderView>>
+ReadHeader(ArchiveSource &source, ExtendedHeader &extended);
+
+/**
+ * @brief Write member data to an extracted file at its current position
+ */
+[[nodiscard]] Status WriteMemberData(FileDescriptor const &output,
+                                     std::span<const char> data);
+
+/**
+ * @brief Open the archive at the provided path, memory mapping it when
+ * possible and falling back to stream based reads otherwise
+ *
+ * Compressed archives are decompressed on the fly. Only zstd archives with a
+ * seek table remain randomly accessible, gzip archives are sequential only
+ * sources.
+ */
+[[nodiscard]] Result<std::unique_ptr<ArchiveSource>>
+OpenArchiveSource(std::string const &filePath);
+
+} // namespace cc::tar::detail
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Sum of the buffer's bytes taken as unsigned values, using AVX2 or
+ * SSE2 when the CPU supports them
+ */
+[[nodiscard]] std::uint64_t ByteSum(std::span<const char> buffer);
+
+/**
+ * @brief Checksum of a header buffer as the ustar format defines it, counting
+ * the checksum field as eight spaces
+ */
+[[nodiscard]] std::uint64_t CalculateChecksum(std::span<const char> buffer);
+
+/**
+ * @brief Compare the checksum stored in a header buffer with its contents,
+ * accepting the checksums written by earlier versions of this tool as well
+ */
+[[nodiscard]] Status VerifyChecksum(std::span<const char> buffer);
+
+/**
+ * @brief Verify the checksums of consecutive 512 byte headers in one pass
+ * @returns the index of the first header with an invalid or unreadable
+ * checksum, or the number of headers if all of them are valid
+ */
+[[nodiscard]] std::size_t FindInvalidChecksum(std::span<const char> headers);
+
+} // namespace cc::tar::detail
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+namespace cc::tar::detail {
+
+/**
+ * @brief Compression applied on top of the tar stream of an archive
+ */
+enum class Compression { NONE, GZIP, ZSTD };
+
+/**
+ * @brief Archive path standing for the standard input or output
+ */
+static constexpr std::string_view STANDARD_STREAM_PATH = "-";
+
+[[nodiscard]] inline bool IsStandardStream(std::string_view filePath) {
+  return filePath == STANDARD_STREAM_PATH;
+}
+
+/**
+ * @brief Derive the compression of an archive from its file extension,
+ * archives on the standard streams are never compressed
+ * @returns the compression, or 'std::nullopt' if the extension is unsupported
+ */
+[[nodiscard]] inline std::optional<Compression>
+CompressionOf(std::string_view filePath) {
+  if (IsStandardStream(filePath))
+    return Compression::NONE;
+  if (filePath.ends_with(".tar"))
+    return Compression::NONE;
+  if (filePath.ends_with(".tar.gz") || filePath.ends_with(".tgz"))
+    return Compression::GZIP;
+  if (filePath.ends_with(".tar.zst") || filePath.ends_with(".tzst"))
+    return Compression::ZSTD;
+  return std::nullopt;
+}
+
+} // namespace cc::tar::detail
@@ -1,16 +1,192 @@
 #pragma once
 
 #include <cstdint>
+#include <optional>
 #include <span>
+#include <string>
+#include <string_view>
 
 #include "common.hpp"
+#include "helpers/field.hpp"
 #include "svgys/error.hpp"
 
 namespace cc::tar::detail {
 using namespace svgys::error;
 
-[[nodiscard]] Result<common::ObjectHeader> ParseHeader(std::span<char> buffer);
+static constexpr std::uint64_t BLOCK_SIZE_B = 512;
 
+// Blocks per record when no blocking factor is configured, as in GNU tar
+static constexpr std::uint32_t DEFAULT_BLOCKING_FACTOR = 20;
+
+// Archives are read and written in transfers of at least this size
+static constexpr std::uint64_t IO_BUFFER_SIZE_B = 1 << 20;
+
+/**
+ * @brief Size of a transfer buffer holding whole records
+ */
+[[nodiscard]] constexpr std::uint64_t
+IoBufferSize(std::uint64_t recordSize) {
+  return (IO_BUFFER_SIZE_B + recordSize - 1) / recordSize * recordSize;
+}
+
+/**
+ * @brief Size of a member's data section, including the zero padding up to
+ * the next block boundary
+ */
+[[nodiscard]] constexpr std::uint64_t PaddedSize(std::uint64_t fileSize) {
+  return (fileSize + BLOCK_SIZE_B - 1) / BLOCK_SIZE_B * BLOCK_SIZE_B;
+}
+
+// Data of extension headers is held in memory, larger ones are rejected
+static constexpr std::uint64_t MAX_EXTENSION_SIZE_B = 1 << 20;
+
+/**
+ * @brief Values of the PAX extended and GNU long name headers preceding a
+ * member, which take precedence over the fields of its header
+ *
+ * Only path, linkpath, size and the whole seconds of mtime records are
+ * applied, along with the name and size of GNU 1.0 sparse members. Other
+ * records have no counterpart in \ref common::ObjectHeader.
+ */
+struct ExtendedHeader {
+  std::string fileName{};
+  std::string linkedFileName{};
+  std::optional<std::uint64_t> fileSize{};
+  std::optional<std::uint64_t> lastModified{};
+  // Set for sparse members, zero if only their map records the size
+  std::optional<std::uint64_t> sparseSize{};
+  // Scratch storage for the data of the extension header being read
+  std::string data{};
+
+  void Clear();
+
+  [[nodiscard]] bool Empty() const;
+};
+
+/**
+ * @brief Whether headers of this type carry values for the next member
+ * instead of being members themselves
+ */
+[[nodiscard]] bool IsExtension(common::LinkIndicator type);
+
+/**
+ * @brief Apply the data of an extension header of the provided type
+ */
+[[nodiscard]] Status ApplyExtension(common::LinkIndicator type,
+                                    std::string_view data,
+                                    ExtendedHeader &extended);
+
+/**
+ * @brief Non-owning view of a header block
+ *
+ * Names are returned as views into the block and numbers are decoded on
+ * access, so nothing is allocated. The block has to outlive the view, as do
+ * the extended values applied to it.
+ */
+class HeaderView {
+public:
+  /**
+   * @brief View a header block after checking its size and checksum
+   * @param extended values overriding the fields of the block, if any
+   */
+  [[nodiscard]] static Result<HeaderView>
+  Open(std::span<const char> buffer, ExtendedHeader const *extended = nullptr);
+
+  template <helpers::FieldType Field>
+  [[nodiscard]] typename Field::field_type::view_type Get() const {
+    return helpers::View<Field>(mBuffer);
+  }
+
+  [[nodiscard]] std::string_view FileName() const {
+    if (mExtended && !mExtended->fileName.empty())
+      return mExtended->fileName;
+    return Get<common::FILE_NAME>();
+  }
+
+  [[nodiscard]] Result<std::uint64_t> FileSize() const {
+    if (mExtended && mExtended->fileSize)
+      return {*mExtended->fileSize};
+    return Get<common::FILE_SIZE>();
+  }
+
+  [[nodiscard]] Result<std::uint64_t> FileMode() const {
+    return Get<common::FILE_MODE>();
+  }
+
+  /**
+   * @brief Modification time in seconds since the epoch, zero if the field
+   * was left empty
+   */
+  [[nodiscard]] Result<std::uint64_t> LastModified() const {
+    if (mExtended && mExtended->lastModified)
+      return {*mExtended->lastModified};
+    if (mBuffer[common::LAST_MODIFIED::offset] == '\0')
+      return {0};
+    return Get<common::LAST_MODIFIED>();
+  }
+
+  [[nodiscard]] common::LinkIndicator LinkIndicator() const {
+    return Get<common::LINK_INDICATOR>();
+  }
+
+  [[nodiscard]] std::string_view LinkedFileName() const {
+    if (mExtended && !mExtended->linkedFileName.empty())
+      return mExtended->linkedFileName;
+    return Get<common::LINKED_FILE_NAME>();
+  }
+
+  /**
+   * @brief Size of the file restored from a sparse member, see
+   * \ref SparseMap
+   * @returns the size, zero if only the map records it, or std::nullopt if
+   * the member is not sparse
+   */
+  [[nodiscard]] std::optional<std::uint64_t> SparseSize() const {
+    if (mExtended)
+      return mExtended->sparseSize;
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Decode all fields into an existing header, reusing the storage of
+   * its strings
+   */
+  [[nodiscard]] Status CopyTo(common::ObjectHeader &header) const;
+
+private:
+  HeaderView(std::span<const char> buffer, ExtendedHeader const *extended)
+      : mBuffer(buffer), mExtended(extended) {}
+
+  std::span<const char> mBuffer;
+  ExtendedHeader const *mExtended;
+};
+
+/**
+ * @brief Whether a header block ends the archive, which is the case at the end
+ * of the input and for the zero blocks written after the last member
+ */
+[[nodiscard]] bool IsEndOfArchive(std::span<const char> block);
+
+/**
+ * @brief Parse the header of a member, applying the extension headers and
+ * their data at the start of buffer
+ */
+[[nodiscard]] Result<common::ObjectHeader>
+ParseHeader(std::span<const char> buffer);
+
+/**
+ * @brief Number of bytes \ref SerialiseHeader writes for the header
+ *
+ * This is a single block, unless names do not fit into their fields, the
+ * size needs more than eleven octal digits or the member is sparse. A PAX
+ * extended header and its data then precede the block.
+ */
+[[nodiscard]] std::uint64_t SerialisedSize(common::ObjectHeader const &header);
+
+/**
+ * @brief Serialise the header into the first \ref SerialisedSize bytes of
+ * buffer
+ */
 [[nodiscard]] Status SerialiseHeader(common::ObjectHeader const &header,
                                      std::span<char> buffer);
 
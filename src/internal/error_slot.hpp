@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <variant>
+
+#include "boost/leaf/handle_errors.hpp"
+#include "error_code.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Carries the first error raised by a task on a worker thread back to
+ * the thread that waits for the tasks
+ *
+ * Error objects only reach handlers on the thread that raised them, so worker
+ * tasks are run through \ref Run and the waiting thread raises the stored
+ * error again with \ref Rethrow.
+ */
+class ErrorSlot {
+  using ErrorType =
+      std::variant<error::InvalidFile, error::InvalidStream,
+                   error::InvalidContents, error::InvalidBufferSize,
+                   error::InvalidConversion, error::InvalidChecksum,
+                   error::MemberNotFound, error::UnexpectedError>;
+
+public:
+  /**
+   * @brief Run the task, storing its error if it is the first one to fail
+   */
+  template <typename Task>
+  void Run(Task &&task) noexcept {
+    boost::leaf::try_handle_all(
+        [&]() -> Status { return task(); },
+        [this](error::InvalidFile err) { Store(err); },
+        [this](error::InvalidStream err) { Store(err); },
+        [this](error::InvalidContents err) { Store(err); },
+        [this](error::InvalidBufferSize err) { Store(err); },
+        [this](error::InvalidConversion err) { Store(err); },
+        [this](error::InvalidChecksum err) { Store(err); },
+        [this](error::MemberNotFound err) { Store(err); },
+        [this]() { Store(error::UnexpectedError{}); });
+  }
+
+  /**
+   * @brief Whether any task failed, allowing pending tasks to bail out early
+   */
+  [[nodiscard]] bool Failed() const noexcept { return mFailed; }
+
+  /**
+   * @brief Raise the stored error on the calling thread
+   * @returns 'Success()' if no task failed, the first error otherwise
+   */
+  [[nodiscard]] Status Rethrow() {
+    std::lock_guard lock(mMutex);
+    if (!mError)
+      return Success();
+    return std::visit([](auto err) -> Status { return NewError(err); },
+                      *mError);
+  }
+
+private:
+  void Store(ErrorType err) {
+    std::lock_guard lock(mMutex);
+    if (!mError)
+      mError = std::move(err);
+    mFailed = true;
+  }
+
+  std::mutex mMutex{};
+  std::optional<ErrorType> mError{};
+  std::atomic<bool> mFailed{false};
+};
+
+} // namespace cc::tar::detail
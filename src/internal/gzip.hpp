@@ -0,0 +1,123 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "archive_sink.hpp"
+#include "archive_source.hpp"
+#include "error_slot.hpp"
+#include "svgys/error.hpp"
+#include "thread_pool.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Archive source decompressing a gzip stream on a dedicated thread
+ *
+ * The inflate thread fills a bounded queue of chunks ahead of the reader, so
+ * decompression overlaps with header parsing and writing extracted files.
+ * Concatenated gzip members are read as a single stream.
+ */
+class GzipSource : public ArchiveSource {
+public:
+  GzipSource(std::string fileName, std::unique_ptr<ArchiveSource> compressed);
+  GzipSource(GzipSource const &) = delete;
+  GzipSource &operator=(GzipSource const &) = delete;
+  ~GzipSource() override;
+
+  [[nodiscard]] Result<std::span<const char>> ReadBlock() override;
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) override;
+
+  [[nodiscard]] Status Skip(std::uint64_t size) override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  [[nodiscard]] Status Inflate();
+
+  [[nodiscard]] bool PushChunk(std::vector<char> chunk);
+
+  /**
+   * @brief Wait for the next decompressed chunk
+   * @returns false once the stream is exhausted
+   */
+  [[nodiscard]] Result<bool> NextChunk();
+
+  std::string mFileName;
+  std::unique_ptr<ArchiveSource> mCompressed;
+
+  std::mutex mMutex{};
+  std::condition_variable mChunkAdded{};
+  std::condition_variable mChunkTaken{};
+  std::deque<std::vector<char>> mChunks{};
+  bool mFinished{false};
+  bool mStopping{false};
+  ErrorSlot mErrors{};
+
+  std::vector<char> mCurrent{};
+  std::size_t mPosition{0};
+  std::uint64_t mOffset{0};
+
+  std::thread mInflateThread{};
+};
+
+/**
+ * @brief Archive sink compressing independent blocks on a pool of threads
+ *
+ * Like pigz, every block is deflated separately with the tail of the previous
+ * block as dictionary and ends on a byte boundary, so the compressed blocks
+ * are concatenated in order into a single gzip member.
+ */
+class GzipSink : public ArchiveSink {
+public:
+  GzipSink(std::string fileName, std::unique_ptr<ArchiveSink> output,
+           std::uint32_t jobs);
+
+  [[nodiscard]] Status Write(std::span<const char> data) override;
+
+  [[nodiscard]] Status Close() override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  struct CompressedBlock {
+    std::vector<char> data{};
+    std::uint64_t checksum{0};
+    std::uint64_t size{0};
+    bool done{false};
+    bool failed{false};
+  };
+
+  [[nodiscard]] Status SubmitBlock(bool last);
+
+  [[nodiscard]] Status WriteOldestBlock();
+
+  std::string mFileName;
+  std::unique_ptr<ArchiveSink> mOutput;
+  std::size_t mMaxPendingBlocks;
+
+  std::vector<char> mInput{};
+  std::vector<char> mDictionary{};
+  std::uint64_t mOffset{0};
+  std::uint64_t mChecksum;
+  bool mHeaderWritten{false};
+
+  std::mutex mMutex{};
+  std::condition_variable mBlockDone{};
+  std::deque<std::shared_ptr<CompressedBlock>> mPendingBlocks{};
+
+  // Declared last so the workers are joined before the state they use is gone
+  ThreadPool mPool;
+};
+
+} // namespace cc::tar::detail
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "stats.hpp"
+
+namespace cc::tar::detail {
+
+// Checked before touching any counter, so disabled statistics cost a load
+inline std::atomic<bool> statsEnabled{false};
+
+/**
+ * @brief Add the time from construction to destruction to a phase of the
+ * calling thread
+ *
+ * Timers nest, the time of an inner timer is taken out of the outer one.
+ */
+class PhaseTimer {
+public:
+  explicit PhaseTimer(stats::Phase phase) : mPhase(phase) {
+    if (statsEnabled.load(std::memory_order_relaxed))
+      Start();
+  }
+  PhaseTimer(PhaseTimer const &) = delete;
+  PhaseTimer &operator=(PhaseTimer const &) = delete;
+  ~PhaseTimer() {
+    if (mActive)
+      Stop();
+  }
+
+private:
+  void Start();
+  void Stop();
+
+  stats::Phase mPhase;
+  bool mActive{false};
+  std::uint64_t mStart{0};
+  // Time of the timers nested inside this one
+  std::uint64_t mNested{0};
+  PhaseTimer *mOuter{nullptr};
+};
+
+void AddToCounter(stats::Counter counter, std::uint64_t value);
+
+inline void Count(stats::Counter counter, std::uint64_t value) {
+  if (statsEnabled.load(std::memory_order_relaxed))
+    AddToCounter(counter, value);
+}
+
+} // namespace cc::tar::detail
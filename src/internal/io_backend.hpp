@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "posix_file.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+// Members up to this size are written through an I/O backend, larger ones
+// are copied by the kernel straight from the archive
+static constexpr std::uint64_t BACKEND_WRITE_MAX_B = KERNEL_COPY_THRESHOLD_B;
+
+/**
+ * @brief Creates extracted files, possibly completing the writes after
+ * returning
+ *
+ * Writes to the same path complete in the order in which they were issued.
+ */
+class IoBackend {
+public:
+  virtual ~IoBackend() = default;
+
+  /**
+   * @brief Create or truncate the file at path and write data to it
+   *
+   * The data has to remain valid until \ref Wait returns, unless it was
+   * taken from \ref Buffer.
+   */
+  [[nodiscard]] virtual Status WriteFile(std::string const &path,
+                                         std::span<const char> data) = 0;
+
+  /**
+   * @brief Buffer of size bytes owned by the backend, to assemble the data of
+   * the next \ref WriteFile
+   */
+  [[nodiscard]] virtual Result<std::span<char>> Buffer(std::uint64_t size) = 0;
+
+  /**
+   * @brief Wait for the pending writes to path, so it can be written directly
+   */
+  [[nodiscard]] virtual Status Wait(std::string const &path) = 0;
+
+  /**
+   * @brief Wait for all pending writes
+   * @returns the first error of a write that completed after returning
+   */
+  [[nodiscard]] virtual Status Wait() = 0;
+};
+
+/**
+ * @brief Backend completing every write with blocking system calls before
+ * returning
+ */
+class BlockingBackend : public IoBackend {
+public:
+  [[nodiscard]] Status WriteFile(std::string const &path,
+                                 std::span<const char> data) override;
+
+  [[nodiscard]] Result<std::span<char>> Buffer(std::uint64_t size) override;
+
+  [[nodiscard]] Status Wait(std::string const &) override { return Success(); }
+
+  [[nodiscard]] Status Wait() override { return Success(); }
+
+private:
+  std::vector<char> mBuffer{};
+};
+
+/**
+ * @brief Open the io_uring backend if requested and supported by the kernel,
+ * the blocking backend otherwise
+ */
+[[nodiscard]] std::unique_ptr<IoBackend> OpenIoBackend(bool async);
+
+} // namespace cc::tar::detail
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cc::tar::detail {
+
+/**
+ * @brief Selects archive members by literal name or glob pattern
+ *
+ * Literal names match a member with exactly that name, patterns containing
+ * '*', '?' or '[' are matched with fnmatch(3). An empty pattern list selects
+ * every member. A name may match several members of an archive, the last one
+ * wins as with tar, so no pattern is ever done before the end of the archive.
+ */
+class MemberFilter {
+public:
+  explicit MemberFilter(std::vector<std::string> patterns);
+
+  /**
+   * @brief Whether the member should be extracted, the patterns matching it are
+   * marked as found
+   */
+  [[nodiscard]] bool Matches(std::string_view fileName);
+
+  [[nodiscard]] bool HasGlobs() const { return !mGlobs.empty(); }
+
+  [[nodiscard]] std::vector<std::string> const &Patterns() const {
+    return mPatterns;
+  }
+
+  /**
+   * @brief Patterns that did not match any member so far
+   */
+  [[nodiscard]] std::vector<std::string> Unmatched() const;
+
+private:
+  // Allows looking up literals by std::string_view without a copy
+  struct NameHash : std::hash<std::string_view> {
+    using is_transparent = void;
+  };
+
+  std::vector<std::string> mPatterns;
+  std::vector<bool> mMatched;
+  std::unordered_map<std::string, std::size_t, NameHash, std::equal_to<>>
+      mLiterals{};
+  std::vector<std::size_t> mGlobs{};
+  // Null-terminated copy of the name for fnmatch(3), reused between members
+  std::string mGlobName{};
+};
+
+} // namespace cc::tar::detail
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "archive_sink.hpp"
+#include "archive_source.hpp"
+#include "error_slot.hpp"
+#include "posix_file.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Archive source reading a pipe, such as the standard input, on a
+ * dedicated thread
+ *
+ * The reader thread fills one of two large buffers while the other one is
+ * parsed, so waiting for the pipe overlaps with header parsing and writing
+ * extracted files. Buffers are filled completely except at the end of the
+ * input, so no header is ever split across two of them. Pipes can not seek,
+ * skipped data is read and dropped.
+ */
+class PipeSource : public ArchiveSource {
+public:
+  PipeSource(std::string fileName, FileDescriptor input);
+  PipeSource(PipeSource const &) = delete;
+  PipeSource &operator=(PipeSource const &) = delete;
+  ~PipeSource() override;
+
+  [[nodiscard]] Result<std::span<const char>> ReadBlock() override;
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) override;
+
+  [[nodiscard]] Status Skip(std::uint64_t size) override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  [[nodiscard]] Status ReadInput();
+
+  /**
+   * @brief Hand the current buffer back to the reader thread and wait for
+   * the other one
+   * @returns false once the input is exhausted
+   */
+  [[nodiscard]] Result<bool> NextBuffer();
+
+  std::string mFileName;
+  FileDescriptor mInput;
+  std::vector<AlignedBuffer> mBuffers{};
+
+  std::mutex mMutex{};
+  std::condition_variable mBufferFilled{};
+  std::condition_variable mBufferReleased{};
+  // Bytes in each buffer, set while the buffer belongs to the parsing side
+  std::array<std::size_t, 2> mFilled{};
+  std::array<bool, 2> mReady{};
+  bool mFinished{false};
+  bool mStopping{false};
+  ErrorSlot mErrors{};
+
+  std::size_t mIndex{0};
+  bool mHolding{false};
+  std::span<const char> mCurrent{};
+  std::size_t mPosition{0};
+  std::uint64_t mOffset{0};
+
+  std::thread mReaderThread{};
+};
+
+/**
+ * @brief Archive sink writing to a pipe, such as the standard output, on a
+ * dedicated thread
+ *
+ * Members are packed into one of two large buffers while the writer thread
+ * drains the other one, so waiting for the pipe overlaps with reading the
+ * archived files. Buffers hold whole records.
+ */
+class PipeSink : public ArchiveSink {
+public:
+  PipeSink(std::string fileName, FileDescriptor output,
+           std::uint64_t recordSize);
+  PipeSink(PipeSink const &) = delete;
+  PipeSink &operator=(PipeSink const &) = delete;
+  ~PipeSink() override;
+
+  [[nodiscard]] Status Write(std::span<const char> data) override;
+
+  [[nodiscard]] Status Close() override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  [[nodiscard]] Status WriteOutput();
+
+  /**
+   * @brief Hand the current buffer to the writer thread and wait until the
+   * other one is drained
+   */
+  [[nodiscard]] Status Submit();
+
+  void Stop();
+
+  std::string mFileName;
+  FileDescriptor mOutput;
+  std::vector<AlignedBuffer> mBuffers{};
+
+  std::mutex mMutex{};
+  std::condition_variable mBufferSubmitted{};
+  std::condition_variable mBufferDrained{};
+  // Bytes to write from each buffer, set while it belongs to the writer
+  std::array<std::size_t, 2> mPending{};
+  std::array<bool, 2> mReady{};
+  bool mWriterDone{false};
+  bool mStopping{false};
+  ErrorSlot mErrors{};
+
+  std::size_t mIndex{0};
+  std::size_t mUsed{0};
+  std::uint64_t mOffset{0};
+
+  std::thread mWriterThread{};
+};
+
+} // namespace cc::tar::detail
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <span>
+#include <string>
+#include <sys/types.h>
+
+#include "error_code.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Owning wrapper around a POSIX file descriptor, remembering the path
+ * it was opened with for error reporting
+ */
+class FileDescriptor {
+public:
+  FileDescriptor() = default;
+  FileDescriptor(int fd, std::string fileName, error::StreamType type)
+      : mFd(fd), mFileName(std::move(fileName)), mType(type) {}
+  FileDescriptor(FileDescriptor &&other) noexcept;
+  FileDescriptor &operator=(FileDescriptor &&other) noexcept;
+  FileDescriptor(FileDescriptor const &) = delete;
+  FileDescriptor &operator=(FileDescriptor const &) = delete;
+  ~FileDescriptor();
+
+  [[nodiscard]] static Result<FileDescriptor>
+  Open(std::string const &filePath, int flags, mode_t mode = 0666);
+
+  [[nodiscard]] int Get() const { return mFd; }
+
+  [[nodiscard]] std::string const &FileName() const { return mFileName; }
+
+  /**
+   * @brief Close the descriptor, reporting errors such as failed write-back
+   */
+  [[nodiscard]] Status Close();
+
+  /**
+   * @brief Error object describing a failed operation on this descriptor
+   */
+  [[nodiscard]] error::InvalidStream Error() const {
+    return {mFileName, mType};
+  }
+
+private:
+  int mFd{-1};
+  std::string mFileName{};
+  error::StreamType mType{error::StreamType::INPUT};
+};
+
+/**
+ * @brief Fixed size I/O buffer aligned to the page size
+ */
+class AlignedBuffer {
+public:
+  explicit AlignedBuffer(std::size_t size);
+
+  [[nodiscard]] char *data() const { return mData.get(); }
+
+  [[nodiscard]] std::size_t size() const { return mSize; }
+
+  [[nodiscard]] std::span<char> Span() const { return {data(), mSize}; }
+
+private:
+  struct Free {
+    void operator()(char *data) const { std::free(data); }
+  };
+
+  std::unique_ptr<char, Free> mData;
+  std::size_t mSize;
+};
+
+/**
+ * @brief Write all data at the current position of the descriptor
+ */
+[[nodiscard]] Status WriteAll(FileDescriptor const &file,
+                              std::span<const char> data);
+
+/**
+ * @brief Move the position of the descriptor to an absolute offset, past the
+ * end of a file leaving a hole on the next write
+ */
+[[nodiscard]] Status Seek(FileDescriptor const &file, std::uint64_t offset);
+
+/**
+ * @brief Set the size of the file, extending it with a hole
+ */
+[[nodiscard]] Status Resize(FileDescriptor const &file, std::uint64_t size);
+
+/**
+ * @brief Read into the buffer from the provided offset until it is full or
+ * the end of the file is reached
+ * @returns the number of bytes read
+ */
+[[nodiscard]] Result<std::size_t> ReadAt(FileDescriptor const &file,
+                                         std::span<char> buffer,
+                                         std::uint64_t offset);
+
+/**
+ * @brief Copy bytes between two files inside the kernel, using
+ * copy_file_range(2) and falling back to sendfile(2)
+ *
+ * Data is read from the provided offset of the input and written at the
+ * current position of the output, so concurrent copies from the same input
+ * are safe.
+ *
+ * @returns the number of bytes copied, which is less than size if the kernel
+ * can not copy between these files or the input ends early. The caller copies
+ * the remainder through user space.
+ */
+[[nodiscard]] Result<std::uint64_t> KernelCopy(FileDescriptor const &input,
+                                               std::uint64_t inputOffset,
+                                               FileDescriptor const &output,
+                                               std::uint64_t size);
+
+// Copies up to this size go through user space, where they are cheaper to
+// batch with the surrounding headers
+static constexpr std::uint64_t KERNEL_COPY_THRESHOLD_B = 64 << 10;
+
+} // namespace cc::tar::detail
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief State of a file system object that decides whether an incremental
+ * archive has to include it again
+ */
+struct SnapshotEntry {
+  std::uint64_t device;
+  std::uint64_t inode;
+  std::uint64_t size;
+  std::uint64_t modifiedSeconds;
+  std::uint64_t modifiedNanoseconds;
+  // Type bits of the mode, a path that changes its type is replaced
+  std::uint64_t fileType;
+
+  bool operator==(SnapshotEntry const &) const = default;
+
+  [[nodiscard]] static SnapshotEntry Of(struct stat const &info);
+};
+
+/**
+ * @brief Paths archived by an incremental run together with their state,
+ * looked up in a hash table
+ *
+ * The binary layout on disk is a fixed header, followed by one fixed size
+ * record per path and a single pool holding all paths.
+ */
+class Snapshot {
+public:
+  void Add(std::string path, SnapshotEntry const &entry);
+
+  [[nodiscard]] std::optional<SnapshotEntry>
+  Find(std::string const &path) const;
+
+  /**
+   * @brief Paths of this snapshot that are missing from a later one, or that
+   * are of another type in it
+   * @returns the paths ordered by name
+   */
+  [[nodiscard]] std::vector<std::string>
+  RemovedFrom(Snapshot const &later) const;
+
+  [[nodiscard]] std::size_t Size() const { return mEntries.size(); }
+
+  [[nodiscard]] Status Save(std::string const &snapshotPath) const;
+
+  /**
+   * @brief Load the snapshot at snapshotPath
+   * @returns the snapshot, which is empty if there is no file at the path yet
+   */
+  [[nodiscard]] static Result<Snapshot> Load(std::string const &snapshotPath);
+
+private:
+  std::unordered_map<std::string, SnapshotEntry> mEntries{};
+};
+
+} // namespace cc::tar::detail
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "archive_source.hpp"
+#include "posix_file.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Range of a sparse file that holds data, everything between two
+ * extents is a hole
+ */
+struct SparseExtent {
+  std::uint64_t offset;
+  std::uint64_t size;
+
+  bool operator==(SparseExtent const &) const = default;
+};
+
+/**
+ * @brief Data extents of a sparse member, in the GNU 1.0 format of PAX
+ * archives
+ *
+ * The member data starts with the map in decimal text, the number of extents
+ * followed by the offset and size of each, one per line and padded to whole
+ * blocks. The contents of the extents follow without any padding in between.
+ * The last extent ends at the end of the file, an empty one marks a trailing
+ * hole.
+ */
+struct SparseMap {
+  std::vector<SparseExtent> extents{};
+  // Bytes of member data taken by the map itself
+  std::uint64_t mapSize{0};
+
+  /**
+   * @brief Bytes of data held by the extents
+   */
+  [[nodiscard]] std::uint64_t DataSize() const;
+
+  /**
+   * @brief Size of the file the map describes
+   */
+  [[nodiscard]] std::uint64_t End() const;
+};
+
+/**
+ * @brief Find the data extents of a file with SEEK_DATA and SEEK_HOLE
+ *
+ * Only files with fewer blocks allocated than their size are searched.
+ *
+ * @returns the map, or std::nullopt if the file has no holes or the file
+ * system can not report them
+ */
+[[nodiscard]] Result<std::optional<SparseMap>>
+FindDataExtents(FileDescriptor const &file, struct stat const &info);
+
+/**
+ * @brief Text of the map at the start of the member data, padded to whole
+ * blocks
+ */
+[[nodiscard]] std::string SerialiseSparseMap(SparseMap const &map);
+
+/**
+ * @brief Read the map at the current position of a source, which is left
+ * at the start of the first extent
+ * @param fileSize size of the member data the map has to fit into
+ */
+[[nodiscard]] Result<SparseMap> ReadSparseMap(ArchiveSource &source,
+                                              std::uint64_t fileSize);
+
+/**
+ * @brief Read the map of the member whose data starts at dataOffset of a
+ * random access source
+ */
+[[nodiscard]] Result<SparseMap> ReadSparseMapAt(ArchiveSource const &source,
+                                                std::uint64_t dataOffset,
+                                                std::uint64_t fileSize);
+
+} // namespace cc::tar::detail
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cc::tar::detail {
+
+/**
+ * @brief Fixed size pool of worker threads executing tasks in submission order
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(std::uint32_t threadCount);
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+  ~ThreadPool();
+
+  void Submit(std::function<void()> task);
+
+  /**
+   * @brief Block until every submitted task has finished
+   */
+  void Wait();
+
+private:
+  void Run();
+
+  std::mutex mMutex{};
+  std::condition_variable mTaskAvailable{};
+  std::condition_variable mTasksDone{};
+  std::deque<std::function<void()>> mTasks{};
+  std::size_t mActiveTasks{0};
+  bool mStopping{false};
+  std::vector<std::thread> mThreads{};
+};
+
+/**
+ * @brief Pool of worker threads with a task queue per worker, for tasks that
+ * submit further tasks
+ *
+ * Tasks submitted from a worker go to its own queue and are taken newest
+ * first, so a recursive workload is processed depth first. Idle workers steal
+ * the oldest task of another worker.
+ */
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(std::uint32_t threadCount);
+  WorkStealingPool(WorkStealingPool const &) = delete;
+  WorkStealingPool &operator=(WorkStealingPool const &) = delete;
+  ~WorkStealingPool();
+
+  void Submit(std::function<void()> task);
+
+  /**
+   * @brief Block until every submitted task, including the tasks they
+   * submitted, has finished
+   */
+  void Wait();
+
+private:
+  struct Queue {
+    std::mutex mutex{};
+    std::deque<std::function<void()>> tasks{};
+  };
+
+  [[nodiscard]] bool TryTake(std::size_t worker, std::function<void()> &task);
+
+  void Run(std::size_t worker);
+
+  std::vector<std::unique_ptr<Queue>> mQueues{};
+  std::mutex mMutex{};
+  std::condition_variable mTaskAvailable{};
+  std::condition_variable mTasksDone{};
+  std::size_t mQueuedTasks{0};
+  std::size_t mPendingTasks{0};
+  std::size_t mNextQueue{0};
+  bool mStopping{false};
+  std::vector<std::thread> mThreads{};
+};
+
+} // namespace cc::tar::detail
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "error_slot.hpp"
+#include "posix_file.hpp"
+#include "svgys/error.hpp"
+#include "thread_pool.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief File system object found by \ref TreeWalker
+ */
+struct WalkEntry {
+  std::string path{};
+  struct stat info {};
+  // Target of a symbolic link
+  std::string linkTarget{};
+};
+
+/**
+ * @brief Recursively list the input paths of an archive on a work stealing
+ * pool
+ *
+ * Directories are read relative to the descriptor of their parent, with
+ * getdents64(2) and fstatat(2), by worker threads that run ahead of the
+ * consumer. Entries are handed out as soon as their directory was read, a
+ * directory always before its contents. In sorted mode the walk is depth
+ * first with the entries of each directory ordered by name, so the order does
+ * not depend on the file system or on thread timing. Otherwise it follows the
+ * directory order of the file system and the order in which the workers
+ * finish, and may differ between two walks of the same tree.
+ *
+ * Once a few thousand entries wait for the consumer, the listings of further
+ * directories are held back until it catches up. Entries removed
+ * while the walk runs are skipped with a warning.
+ *
+ * Regular files, directories and symbolic links are listed, symbolic links
+ * are never followed. Other file types are left out.
+ */
+class TreeWalker {
+public:
+  TreeWalker(std::vector<std::string> roots, std::uint32_t jobs, bool sorted);
+  TreeWalker(TreeWalker const &) = delete;
+  TreeWalker &operator=(TreeWalker const &) = delete;
+  ~TreeWalker();
+
+  /**
+   * @brief Wait for the next entry of the walk
+   * @returns the entry, or std::nullopt once the walk is complete
+   */
+  [[nodiscard]] Result<std::optional<WalkEntry>> Next();
+
+  /**
+   * @brief Stop listing directories, unblocking a pending \ref Next
+   */
+  void Stop();
+
+private:
+  struct Directory;
+
+  struct Child {
+    std::string path{};
+    struct stat info {};
+    std::string linkTarget{};
+    // Listing of the child, if it is a directory
+    Directory *directory{nullptr};
+  };
+
+  struct Directory {
+    std::vector<Child> children{};
+    bool listed{false};
+    // Set while the listing is held back, with what it is submitted with
+    bool deferred{false};
+    std::shared_ptr<FileDescriptor> parent{};
+    std::string path{};
+  };
+
+  /**
+   * @brief Position of the consumer within the listing of a directory
+   */
+  struct Cursor {
+    Directory *directory;
+    std::size_t child;
+  };
+
+  /**
+   * @brief Stat the roots, which form the listing of a virtual top directory
+   */
+  [[nodiscard]] Status ListRoots();
+
+  /**
+   * @brief Queue the listing of the directory at path, opened relative to
+   * parent or to the working directory if there is none
+   */
+  void Submit(Directory &directory, std::shared_ptr<FileDescriptor> parent,
+              std::string path);
+
+  /**
+   * @brief Submit a held back listing, with mMutex held
+   */
+  void Resume(Directory &directory);
+
+  /**
+   * @brief Submit the oldest held back listing if there is one, with mMutex
+   * held
+   */
+  void ResumeNext();
+
+  /**
+   * @brief Read the entries of a directory, keeping it open in file
+   */
+  [[nodiscard]] Status List(FileDescriptor const *parent,
+                            std::string const &path, FileDescriptor &file,
+                            std::vector<Child> &children);
+
+  /**
+   * @brief Publish a listing and queue the listings of its subdirectories
+   */
+  void Publish(Directory &directory, std::shared_ptr<FileDescriptor> file,
+               std::vector<Child> children);
+
+  std::vector<std::string> mRoots;
+  bool mSorted;
+
+  std::mutex mMutex{};
+  std::condition_variable mListed{};
+  // A deque keeps the listings in place while workers add new ones
+  std::deque<Directory> mDirectories{};
+  // Listings waiting for the consumer, in sorted mode only the top of the
+  // stack is consumed
+  std::deque<Cursor> mCursors{};
+  // Listings held back while the consumer is behind, oldest first
+  std::deque<Directory *> mDeferred{};
+  // Entries listed but not yet handed to the consumer
+  std::size_t mQueuedEntries{0};
+  std::size_t mPendingListings{0};
+  bool mRootsListed{false};
+  bool mStopping{false};
+  ErrorSlot mErrors{};
+
+  // Declared last, so the workers are joined before the state they use is
+  // destroyed
+  WorkStealingPool mPool;
+};
+
+} // namespace cc::tar::detail
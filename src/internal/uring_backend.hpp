@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "error_code.hpp"
+#include "io_backend.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace cc::tar::detail {
+
+/**
+ * @brief Backend keeping the open, write and close calls of many files in
+ * flight on an io_uring instance
+ *
+ * Data assembled in \ref Buffer lives in a staging area registered with the
+ * ring, so its writes skip the per call mapping of user memory.
+ */
+class UringBackend : public IoBackend {
+public:
+  UringBackend(UringBackend const &) = delete;
+  UringBackend &operator=(UringBackend const &) = delete;
+  ~UringBackend() override;
+
+  /**
+   * @brief Set up a ring
+   * @returns the backend, or nullptr if io_uring or one of the required
+   * operations is not available
+   */
+  [[nodiscard]] static std::unique_ptr<UringBackend> Create();
+
+  [[nodiscard]] Status WriteFile(std::string const &path,
+                                 std::span<const char> data) override;
+
+  [[nodiscard]] Result<std::span<char>> Buffer(std::uint64_t size) override;
+
+  [[nodiscard]] Status Wait(std::string const &path) override;
+
+  [[nodiscard]] Status Wait() override;
+
+private:
+  enum class Operation : std::uint64_t { OPEN, WRITE, CLOSE };
+
+  /**
+   * @brief File being written, at most one of its operations is in flight
+   */
+  struct Request {
+    std::string path{};
+    std::span<const char> data{};
+    std::uint64_t written{0};
+    int fd{-1};
+    bool active{false};
+  };
+
+  UringBackend() = default;
+
+  [[nodiscard]] io_uring_sqe *NextSqe(std::size_t slot, Operation operation);
+
+  void QueueOpen(std::size_t slot);
+  void QueueWrite(std::size_t slot);
+  void QueueClose(std::size_t slot);
+
+  /**
+   * @brief Submit the queued operations and handle the completions, waiting
+   * for at least minComplete of them
+   */
+  void Enter(unsigned minComplete);
+
+  void Complete(io_uring_cqe const &cqe);
+
+  void Fail(std::size_t slot);
+
+  void Release(std::size_t slot);
+
+  int mRingFd{-1};
+  void *mSqRing{nullptr};
+  std::size_t mSqRingSize{0};
+  void *mCqRing{nullptr};
+  std::size_t mCqRingSize{0};
+  io_uring_sqe *mSqes{nullptr};
+  std::size_t mSqesSize{0};
+
+  unsigned *mSqHead{nullptr};
+  unsigned *mSqTail{nullptr};
+  unsigned *mSqMask{nullptr};
+  unsigned *mSqArray{nullptr};
+  unsigned *mCqHead{nullptr};
+  unsigned *mCqTail{nullptr};
+  unsigned *mCqMask{nullptr};
+  io_uring_cqe *mCqes{nullptr};
+
+  unsigned mQueued{0};
+  unsigned mInFlight{0};
+
+  std::vector<Request> mRequests{};
+  std::vector<std::size_t> mFreeSlots{};
+
+  char *mStaging{nullptr};
+  std::size_t mStagingSize{0};
+  std::size_t mStagingUsed{0};
+  bool mStagingRegistered{false};
+
+  std::optional<error::InvalidStream> mError{};
+};
+
+} // namespace cc::tar::detail
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "archive_source.hpp"
+#include "svgys/error.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Check the structure of an archive without writing anything
+ *
+ * Every header block has to carry a valid checksum and fields that decode,
+ * extended sizes have to match, sparse maps have to fit their member and the
+ * padding behind the data of each member has to be zero. The archive has to
+ * end in at least two zero blocks, followed by nothing but zeros.
+ *
+ * Random access sources are first scanned for the headers, hopping over the
+ * member data with only the size fields and extension headers decoded. The
+ * checks then run on jobs threads, each taking a range of the archive at a
+ * time. Other sources are checked in a single sequential pass.
+ */
+[[nodiscard]] Status VerifyArchive(ArchiveSource &tarFile,
+                                   std::string const &fileName,
+                                   std::uint32_t jobs);
+
+} // namespace cc::tar::detail
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <zstd.h>
+
+#include "archive_sink.hpp"
+#include "archive_source.hpp"
+#include "svgys/error.hpp"
+#include "thread_pool.hpp"
+
+namespace cc::tar::detail {
+using namespace svgys::error;
+
+/**
+ * @brief Independently compressed zstd frame of an archive, as listed in the
+ * seek table
+ */
+struct ZstdFrame {
+  std::uint64_t compressedOffset;
+  std::uint64_t compressedSize;
+  // Range of the tar stream the frame decompresses to
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+/**
+ * @brief Archive source decompressing a zstd stream as it is read, used for
+ * archives without a seek table
+ */
+class ZstdSource : public ArchiveSource {
+public:
+  ZstdSource(std::string fileName, std::unique_ptr<ArchiveSource> compressed);
+  ZstdSource(ZstdSource const &) = delete;
+  ZstdSource &operator=(ZstdSource const &) = delete;
+  ~ZstdSource() override;
+
+  [[nodiscard]] Result<std::span<const char>> ReadBlock() override;
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) override;
+
+  [[nodiscard]] Status Skip(std::uint64_t size) override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  /**
+   * @brief Decompress behind the unread bytes until at least minimum bytes
+   * are available or the stream ends
+   */
+  [[nodiscard]] Status Fill(std::size_t minimum);
+
+  [[nodiscard]] std::size_t Available() const { return mEnd - mPosition; }
+
+  std::string mFileName;
+  std::unique_ptr<ArchiveSource> mCompressed;
+  ZSTD_DStream *mStream;
+
+  std::span<const char> mInput{};
+  bool mFrameEnded{false};
+
+  std::vector<char> mBuffer;
+  std::size_t mPosition{0};
+  std::size_t mEnd{0};
+  std::uint64_t mOffset{0};
+};
+
+/**
+ * @brief Random access archive source over the frames listed in the seek
+ * table of a zstd archive
+ *
+ * Sequential reads decompress the frames ahead of the reader on a pool of
+ * threads. Skips are only recorded, frames lying entirely in skipped ranges
+ * are never decompressed. Reads at an absolute offset decompress just the
+ * frames holding the range on the calling thread, which keeps the last one
+ * for the next read.
+ */
+class SeekableZstdSource : public ArchiveSource {
+public:
+  SeekableZstdSource(std::string fileName,
+                     std::unique_ptr<ArchiveSource> compressed,
+                     std::vector<ZstdFrame> frames);
+
+  [[nodiscard]] Result<std::span<const char>> ReadBlock() override;
+
+  [[nodiscard]] Result<std::span<const char>>
+  ReadData(std::uint64_t maxSize) override;
+
+  [[nodiscard]] Status Skip(std::uint64_t size) override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+  [[nodiscard]] std::optional<std::uint64_t> Size() const override {
+    return mSize;
+  }
+
+  [[nodiscard]] bool IsRandomAccess() const override { return true; }
+
+  /**
+   * @brief Range of size bytes at an absolute offset, valid until the next
+   * call from the same thread
+   */
+  [[nodiscard]] Result<std::span<const char>>
+  ReadAt(std::uint64_t offset, std::uint64_t size) const override;
+
+  [[nodiscard]] Status CopyAt(std::uint64_t offset, std::uint64_t size,
+                              FileDescriptor const &output) const override;
+
+private:
+  struct DecodedFrame {
+    std::size_t index{0};
+    std::vector<char> data{};
+    bool done{false};
+    bool failed{false};
+    // Set once the reader skipped past the frame before it was decompressed
+    bool dropped{false};
+  };
+
+  /**
+   * @brief Last frame decompressed by a thread for \ref ReadAt
+   */
+  struct FrameCache {
+    std::size_t index{SIZE_MAX};
+    std::vector<char> data{};
+    // Ranges spanning several frames are joined here
+    std::vector<char> joined{};
+  };
+
+  /**
+   * @brief Index of the frame holding the byte at offset
+   */
+  [[nodiscard]] std::size_t FrameAt(std::uint64_t offset) const;
+
+  /**
+   * @brief Make the frame holding the read position current
+   * @returns false at the end of the archive
+   */
+  [[nodiscard]] Result<bool> Load();
+
+  /**
+   * @brief Queue frames behind the pending ones until the read-ahead is full
+   */
+  [[nodiscard]] Status SubmitAhead();
+
+  /**
+   * @brief Drop the pending frames in front of index, or all of them if index
+   * is not among them
+   */
+  void DropPendingBefore(std::size_t index);
+
+  /**
+   * @brief Decompress a frame into the cache of the calling thread, unless it
+   * is there already
+   */
+  [[nodiscard]] Status Decode(std::size_t index, FrameCache &cache) const;
+
+  [[nodiscard]] FrameCache &ThreadCache() const;
+
+  std::string mFileName;
+  std::unique_ptr<ArchiveSource> mCompressed;
+  std::vector<ZstdFrame> mFrames;
+  std::uint64_t mSize;
+  std::size_t mMaxPendingFrames;
+
+  std::shared_ptr<DecodedFrame> mCurrent{};
+  std::uint64_t mOffset{0};
+  std::array<char, BLOCK_SIZE_B> mBlock{};
+
+  std::mutex mMutex{};
+  std::condition_variable mFrameDone{};
+  std::deque<std::shared_ptr<DecodedFrame>> mPendingFrames{};
+  std::size_t mNextFrame{0};
+
+  mutable std::mutex mCacheMutex{};
+  mutable std::unordered_map<std::thread::id, FrameCache> mCaches{};
+
+  // Declared last so the workers are joined before the state they use is gone
+  ThreadPool mPool;
+};
+
+/**
+ * @brief Archive sink compressing independent zstd frames on a pool of
+ * threads, followed by a seek table in the zstd seekable format
+ *
+ * A frame is closed at the first member boundary after it reached its target
+ * size, so most members start at the beginning of a frame. Members larger
+ * than the maximum frame size are split over several frames.
+ */
+class ZstdSink : public ArchiveSink {
+public:
+  ZstdSink(std::string fileName, std::unique_ptr<ArchiveSink> output,
+           std::uint32_t jobs);
+
+  [[nodiscard]] Status Write(std::span<const char> data) override;
+
+  [[nodiscard]] Status BeginMember() override;
+
+  [[nodiscard]] Status Close() override;
+
+  [[nodiscard]] std::uint64_t Offset() const override { return mOffset; }
+
+private:
+  struct CompressedFrame {
+    std::vector<char> data{};
+    std::uint64_t size{0};
+    bool done{false};
+    bool failed{false};
+  };
+
+  [[nodiscard]] Status SubmitFrame();
+
+  [[nodiscard]] Status WriteOldestFrame();
+
+  [[nodiscard]] Status WriteSeekTable();
+
+  std::string mFileName;
+  std::unique_ptr<ArchiveSink> mOutput;
+  std::size_t mMaxPendingFrames;
+
+  std::vector<char> mInput{};
+  std::uint64_t mOffset{0};
+  // Compressed and decompressed size of every frame written so far
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> mSeekTable{};
+
+  std::mutex mMutex{};
+  std::condition_variable mFrameDone{};
+  std::deque<std::shared_ptr<CompressedFrame>> mPendingFrames{};
+
+  // Declared last so the workers are joined before the state they use is gone
+  ThreadPool mPool;
+};
+
+/**
+ * @brief Open a zstd compressed archive, with random access through its seek
+ * table if it has one and the compressed archive is randomly accessible
+ */
+[[nodiscard]] Result<std::unique_ptr<ArchiveSource>>
+OpenZstdSource(std::string const &fileName,
+               std::unique_ptr<ArchiveSource> compressed);
+
+} // namespace cc::tar::detail
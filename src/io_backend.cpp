@@ -0,0 +1,35 @@
+#include "io_backend.hpp"
+
+#include <fcntl.h>
+
+#include "instrumentation.hpp"
+#include "uring_backend.hpp"
+
+namespace cc::tar::detail {
+
+Status BlockingBackend::WriteFile(std::string const &path,
+                                  std::span<const char> data) {
+  BOOST_LEAF_AUTO(file,
+                  FileDescriptor::Open(path, O_WRONLY | O_CREAT | O_TRUNC));
+  {
+    PhaseTimer timer(stats::Phase::FILE_IO);
+    BOOST_LEAF_CHECK(WriteAll(file, data));
+    Count(stats::Counter::FILE_BYTES_WRITTEN, data.size());
+  }
+  return file.Close();
+}
+
+Result<std::span<char>> BlockingBackend::Buffer(std::uint64_t size) {
+  mBuffer.resize(size);
+  return {std::span<char>(mBuffer)};
+}
+
+std::unique_ptr<IoBackend> OpenIoBackend(bool async) {
+  if (async) {
+    if (auto backend = UringBackend::Create())
+      return backend;
+  }
+  return std::make_unique<BlockingBackend>();
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,49 @@
+#include "member_filter.hpp"
+
+#include <fnmatch.h>
+
+namespace cc::tar::detail {
+
+MemberFilter::MemberFilter(std::vector<std::string> patterns)
+    : mPatterns(std::move(patterns)), mMatched(mPatterns.size(), false) {
+  for (std::size_t i = 0; i < mPatterns.size(); i++) {
+    if (mPatterns[i].find_first_of("*?[") != std::string::npos) {
+      mGlobs.push_back(i);
+    } else if (!mLiterals.try_emplace(mPatterns[i], i).second) {
+      // Repeated names only have to be found once
+      mMatched[i] = true;
+    }
+  }
+}
+
+bool MemberFilter::Matches(std::string_view fileName) {
+  if (mPatterns.empty())
+    return true;
+
+  bool matches = false;
+  if (auto it = mLiterals.find(fileName); it != mLiterals.end()) {
+    mMatched[it->second] = true;
+    matches = true;
+  }
+
+  if (!mGlobs.empty())
+    mGlobName.assign(fileName);
+  for (auto index : mGlobs) {
+    if (fnmatch(mPatterns[index].c_str(), mGlobName.c_str(), 0) == 0) {
+      mMatched[index] = true;
+      matches = true;
+    }
+  }
+  return matches;
+}
+
+std::vector<std::string> MemberFilter::Unmatched() const {
+  std::vector<std::string> unmatched{};
+  for (std::size_t i = 0; i < mPatterns.size(); i++) {
+    if (!mMatched[i])
+      unmatched.push_back(mPatterns[i]);
+  }
+  return unmatched;
+}
+
+} // namespace cc::tar::detail
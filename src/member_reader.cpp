@@ -0,0 +1,137 @@
+#include "member_reader.hpp"
+
+#include <cstring>
+
+#include "archive_index.hpp"
+#include "archive_source.hpp"
+#include "compression.hpp"
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "sparse.hpp"
+
+namespace cc::tar {
+
+// Bytes requested from the archive per read, so decompressing sources never
+// assemble more than this in their per-thread buffer
+static constexpr std::uint64_t STREAM_CHUNK_SIZE_B = 1 << 20;
+
+struct MemberReader::State {
+  std::unique_ptr<detail::ArchiveSource> source{};
+  detail::ArchiveIndex index{};
+};
+
+MemberReader::MemberReader(std::unique_ptr<State> state)
+    : mState(std::move(state)) {}
+
+MemberReader::MemberReader(MemberReader &&) noexcept = default;
+
+MemberReader &MemberReader::operator=(MemberReader &&) noexcept = default;
+
+MemberReader::~MemberReader() = default;
+
+Result<MemberReader>
+MemberReader::Open(std::string const &tarFilePath) noexcept {
+  if (!detail::CompressionOf(tarFilePath))
+    return NewError(error::InvalidFile{tarFilePath});
+
+  auto state = std::make_unique<State>();
+  BOOST_LEAF_ASSIGN(state->source, detail::OpenArchiveSource(tarFilePath));
+  if (!state->source->IsRandomAccess())
+    return NewError(error::InvalidFile{tarFilePath});
+
+  if (auto index = detail::LoadIndex(tarFilePath)) {
+    state->index = std::move(*index);
+  } else {
+    BOOST_LEAF_ASSIGN(state->index,
+                      detail::ArchiveIndex::Build(*state->source));
+  }
+  return {MemberReader(std::move(state))};
+}
+
+bool MemberReader::Contains(std::string_view fileName) const noexcept {
+  return mState->index.Find(fileName).has_value();
+}
+
+Result<std::span<const char>>
+MemberReader::View(std::string_view fileName) const noexcept {
+  auto entry = mState->index.Find(fileName);
+  if (!entry)
+    return NewError(error::MemberNotFound{std::string(fileName)});
+  if (entry->sparse || !mState->source->HasStableSpans())
+    return NewError(error::InvalidContents{});
+
+  return mState->source->ReadAt(entry->headerOffset + detail::BLOCK_SIZE_B,
+                                entry->fileSize);
+}
+
+Result<MemberReader::Stream>
+MemberReader::OpenMember(std::string_view fileName) const noexcept {
+  auto entry = mState->index.Find(fileName);
+  if (!entry)
+    return NewError(error::MemberNotFound{std::string(fileName)});
+
+  auto dataOffset = entry->headerOffset + detail::BLOCK_SIZE_B;
+  if (!entry->sparse) {
+    return {Stream(mState.get(), entry->fileSize,
+                   {{.offset = 0,
+                     .size = entry->fileSize,
+                     .archiveOffset = dataOffset}})};
+  }
+
+  // Extents are stored one after the other behind the map
+  BOOST_LEAF_AUTO(map, detail::ReadSparseMapAt(*mState->source, dataOffset,
+                                               entry->fileSize));
+  std::vector<Stream::Extent> extents{};
+  extents.reserve(map.extents.size());
+  auto archiveOffset = dataOffset + map.mapSize;
+  for (auto const &extent : map.extents) {
+    extents.push_back({.offset = extent.offset,
+                       .size = extent.size,
+                       .archiveOffset = archiveOffset});
+    archiveOffset += extent.size;
+  }
+  return {Stream(mState.get(), map.End(), std::move(extents))};
+}
+
+Result<std::size_t> MemberReader::Stream::Read(std::span<char> buffer) {
+  BOOST_LEAF_AUTO(count, ReadAt(mOffset, buffer));
+  mOffset += count;
+  return {count};
+}
+
+Result<std::size_t>
+MemberReader::Stream::ReadAt(std::uint64_t offset,
+                             std::span<char> buffer) const {
+  if (offset >= mSize)
+    return {std::size_t{0}};
+  auto size = static_cast<std::size_t>(
+      std::min<std::uint64_t>(buffer.size(), mSize - offset));
+  auto end = offset + size;
+
+  // Holes are whatever the extents leave untouched
+  if (mExtents.size() != 1 || mExtents.front().size != mSize)
+    std::memset(buffer.data(), 0, size);
+
+  auto extent = std::upper_bound(
+      mExtents.begin(), mExtents.end(), offset,
+      [](std::uint64_t position, Extent const &next) {
+        return position < next.offset;
+      });
+  if (extent != mExtents.begin())
+    extent--;
+  for (; extent != mExtents.end() && extent->offset < end; extent++) {
+    auto from = std::max(offset, extent->offset);
+    auto to = std::min(end, extent->offset + extent->size);
+    while (from < to) {
+      auto part = std::min(to - from, STREAM_CHUNK_SIZE_B);
+      BOOST_LEAF_AUTO(data, mState->source->ReadAt(
+                                extent->archiveOffset + from - extent->offset,
+                                part));
+      std::memcpy(buffer.data() + (from - offset), data.data(), data.size());
+      from += part;
+    }
+  }
+  return {size};
+}
+
+} // namespace cc::tar
@@ -0,0 +1,239 @@
+#include "pipe.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "instrumentation.hpp"
+
+namespace cc::tar::detail {
+
+// Size of each of the two buffers, a multiple of the block size
+static constexpr std::size_t PIPE_BUFFER_SIZE_B = 4 << 20;
+static_assert(PIPE_BUFFER_SIZE_B % BLOCK_SIZE_B == 0);
+
+PipeSource::PipeSource(std::string fileName, FileDescriptor input)
+    : mFileName(std::move(fileName)), mInput(std::move(input)) {
+  mBuffers.emplace_back(PIPE_BUFFER_SIZE_B);
+  mBuffers.emplace_back(PIPE_BUFFER_SIZE_B);
+  mReaderThread = std::thread([this]() {
+    mErrors.Run([this]() { return ReadInput(); });
+    {
+      std::lock_guard lock(mMutex);
+      mFinished = true;
+    }
+    mBufferFilled.notify_all();
+  });
+}
+
+PipeSource::~PipeSource() {
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mBufferReleased.notify_all();
+  mReaderThread.join();
+}
+
+Status PipeSource::ReadInput() {
+  for (std::size_t index = 0;; index ^= 1) {
+    {
+      std::unique_lock lock(mMutex);
+      mBufferReleased.wait(lock,
+                           [&]() { return mStopping || !mReady[index]; });
+      if (mStopping)
+        return Success();
+    }
+
+    // Pipes return what is buffered so far, the buffer is filled in a loop
+    auto buffer = mBuffers[index].Span();
+    std::size_t filled = 0;
+    {
+      PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+      while (filled < buffer.size()) {
+        auto count =
+            read(mInput.Get(), buffer.data() + filled, buffer.size() - filled);
+        if (count < 0 && errno == EINTR)
+          continue;
+        if (count < 0)
+          return NewError(mInput.Error());
+        if (count == 0)
+          break;
+        filled += static_cast<std::size_t>(count);
+      }
+      Count(stats::Counter::ARCHIVE_BYTES_READ, filled);
+    }
+
+    if (filled > 0) {
+      {
+        std::lock_guard lock(mMutex);
+        mFilled[index] = filled;
+        mReady[index] = true;
+      }
+      mBufferFilled.notify_one();
+    }
+    if (filled < buffer.size())
+      return Success();
+  }
+}
+
+Result<bool> PipeSource::NextBuffer() {
+  {
+    std::unique_lock lock(mMutex);
+    if (mHolding) {
+      mReady[mIndex] = false;
+      mIndex ^= 1;
+      mHolding = false;
+      mBufferReleased.notify_one();
+    }
+    mBufferFilled.wait(lock, [this]() { return mFinished || mReady[mIndex]; });
+    mHolding = mReady[mIndex];
+    mCurrent = {mBuffers[mIndex].data(), mHolding ? mFilled[mIndex] : 0};
+    mPosition = 0;
+  }
+
+  if (!mHolding) {
+    BOOST_LEAF_CHECK(mErrors.Rethrow());
+    return {false};
+  }
+  return {true};
+}
+
+Result<std::span<const char>> PipeSource::ReadBlock() {
+  if (mPosition == mCurrent.size()) {
+    BOOST_LEAF_AUTO(available, NextBuffer());
+    if (!available)
+      return {std::span<const char>{}};
+  }
+  if (mCurrent.size() - mPosition < BLOCK_SIZE_B)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+
+  auto block = mCurrent.subspan(mPosition, BLOCK_SIZE_B);
+  mPosition += BLOCK_SIZE_B;
+  mOffset += BLOCK_SIZE_B;
+  return {block};
+}
+
+Result<std::span<const char>> PipeSource::ReadData(std::uint64_t maxSize) {
+  if (mPosition == mCurrent.size()) {
+    BOOST_LEAF_AUTO(available, NextBuffer());
+    if (!available)
+      return {std::span<const char>{}};
+  }
+
+  auto size = static_cast<std::size_t>(
+      std::min<std::uint64_t>(maxSize, mCurrent.size() - mPosition));
+  auto data = mCurrent.subspan(mPosition, size);
+  mPosition += size;
+  mOffset += size;
+  return {data};
+}
+
+Status PipeSource::Skip(std::uint64_t size) {
+  while (size > 0) {
+    BOOST_LEAF_AUTO(data, ReadData(size));
+    if (data.empty())
+      return NewError(
+          error::InvalidStream{mFileName, error::StreamType::INPUT});
+    size -= data.size();
+  }
+  return Success();
+}
+
+PipeSink::PipeSink(std::string fileName, FileDescriptor output,
+                   std::uint64_t recordSize)
+    : mFileName(std::move(fileName)), mOutput(std::move(output)) {
+  auto bufferSize =
+      (PIPE_BUFFER_SIZE_B + recordSize - 1) / recordSize * recordSize;
+  mBuffers.emplace_back(bufferSize);
+  mBuffers.emplace_back(bufferSize);
+  mWriterThread = std::thread([this]() {
+    mErrors.Run([this]() { return WriteOutput(); });
+    {
+      std::lock_guard lock(mMutex);
+      mWriterDone = true;
+    }
+    mBufferDrained.notify_all();
+  });
+}
+
+PipeSink::~PipeSink() { Stop(); }
+
+void PipeSink::Stop() {
+  if (!mWriterThread.joinable())
+    return;
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mBufferSubmitted.notify_all();
+  mWriterThread.join();
+}
+
+Status PipeSink::WriteOutput() {
+  for (std::size_t index = 0;; index ^= 1) {
+    std::size_t size = 0;
+    {
+      std::unique_lock lock(mMutex);
+      mBufferSubmitted.wait(lock,
+                            [&]() { return mStopping || mReady[index]; });
+      // Buffers submitted before stopping are still written
+      if (!mReady[index])
+        return Success();
+      size = mPending[index];
+    }
+
+    {
+      PhaseTimer timer(stats::Phase::ARCHIVE_IO);
+      BOOST_LEAF_CHECK(WriteAll(mOutput, {mBuffers[index].data(), size}));
+      Count(stats::Counter::ARCHIVE_BYTES_WRITTEN, size);
+    }
+
+    {
+      std::lock_guard lock(mMutex);
+      mReady[index] = false;
+    }
+    mBufferDrained.notify_one();
+  }
+}
+
+Status PipeSink::Submit() {
+  {
+    std::unique_lock lock(mMutex);
+    mPending[mIndex] = mUsed;
+    mReady[mIndex] = true;
+    mBufferSubmitted.notify_one();
+
+    mIndex ^= 1;
+    mUsed = 0;
+    mBufferDrained.wait(lock,
+                        [this]() { return mWriterDone || !mReady[mIndex]; });
+  }
+  return mErrors.Rethrow();
+}
+
+Status PipeSink::Write(std::span<const char> data) {
+  mOffset += data.size();
+  while (!data.empty()) {
+    auto &buffer = mBuffers[mIndex];
+    auto count = std::min(data.size(), buffer.size() - mUsed);
+    std::copy_n(data.begin(), count, buffer.data() + mUsed);
+    mUsed += count;
+    data = data.subspan(count);
+    if (mUsed == buffer.size())
+      BOOST_LEAF_CHECK(Submit());
+  }
+  return Success();
+}
+
+Status PipeSink::Close() {
+  if (mUsed > 0)
+    BOOST_LEAF_CHECK(Submit());
+  Stop();
+  BOOST_LEAF_CHECK(mErrors.Rethrow());
+  return mOutput.Close();
+}
+
+} // namespace cc::tar::detail
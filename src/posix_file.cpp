@@ -0,0 +1,174 @@
+#include "posix_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <new>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include "instrumentation.hpp"
+
+namespace cc::tar::detail {
+
+// Largest chunk handed to a single read, write or copy call
+static constexpr std::uint64_t MAX_TRANSFER_SIZE_B = 1 << 30;
+
+// Cleared once the kernel reports copy_file_range(2) as not implemented
+static std::atomic<bool> copyFileRangeAvailable{true};
+
+FileDescriptor::FileDescriptor(FileDescriptor &&other) noexcept
+    : mFd(other.mFd), mFileName(std::move(other.mFileName)),
+      mType(other.mType) {
+  other.mFd = -1;
+}
+
+FileDescriptor &FileDescriptor::operator=(FileDescriptor &&other) noexcept {
+  if (this != &other) {
+    if (mFd >= 0) {
+      PhaseTimer timer(stats::Phase::FILE_CLOSE);
+      close(mFd);
+    }
+    mFd = other.mFd;
+    mFileName = std::move(other.mFileName);
+    mType = other.mType;
+    other.mFd = -1;
+  }
+  return *this;
+}
+
+FileDescriptor::~FileDescriptor() {
+  if (mFd >= 0) {
+    PhaseTimer timer(stats::Phase::FILE_CLOSE);
+    close(mFd);
+  }
+}
+
+Result<FileDescriptor> FileDescriptor::Open(std::string const &filePath,
+                                            int flags, mode_t mode) {
+  auto type = (flags & O_ACCMODE) == O_RDONLY ? error::StreamType::INPUT
+                                              : error::StreamType::OUTPUT;
+  PhaseTimer timer(stats::Phase::FILE_OPEN);
+  int fd = open(filePath.c_str(), flags | O_CLOEXEC, mode);
+  if (fd < 0)
+    return NewError(error::InvalidStream{filePath, type});
+  return {FileDescriptor(fd, filePath, type)};
+}
+
+Status FileDescriptor::Close() {
+  int fd = mFd;
+  mFd = -1;
+  PhaseTimer timer(stats::Phase::FILE_CLOSE);
+  if (fd >= 0 && close(fd) != 0)
+    return NewError(Error());
+  return Success();
+}
+
+AlignedBuffer::AlignedBuffer(std::size_t size) : mSize(size) {
+  auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  auto allocation = (std::max<std::size_t>(size, 1) + pageSize - 1) /
+                    pageSize * pageSize;
+  mData.reset(static_cast<char *>(std::aligned_alloc(pageSize, allocation)));
+  if (!mData)
+    throw std::bad_alloc();
+}
+
+Status WriteAll(FileDescriptor const &file, std::span<const char> data) {
+  while (!data.empty()) {
+    auto size = std::min<std::uint64_t>(data.size(), MAX_TRANSFER_SIZE_B);
+    auto written = write(file.Get(), data.data(), size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return NewError(file.Error());
+    data = data.subspan(static_cast<std::size_t>(written));
+  }
+  return Success();
+}
+
+Status Seek(FileDescriptor const &file, std::uint64_t offset) {
+  if (lseek(file.Get(), static_cast<off_t>(offset), SEEK_SET) < 0)
+    return NewError(file.Error());
+  return Success();
+}
+
+Status Resize(FileDescriptor const &file, std::uint64_t size) {
+  if (ftruncate(file.Get(), static_cast<off_t>(size)) != 0)
+    return NewError(file.Error());
+  return Success();
+}
+
+Result<std::size_t> ReadAt(FileDescriptor const &file, std::span<char> buffer,
+                           std::uint64_t offset) {
+  std::size_t total = 0;
+  while (total < buffer.size()) {
+    auto size = std::min<std::uint64_t>(buffer.size() - total,
+                                        MAX_TRANSFER_SIZE_B);
+    auto count = pread(file.Get(), buffer.data() + total, size,
+                       static_cast<off_t>(offset + total));
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0)
+      return NewError(file.Error());
+    if (count == 0)
+      break;
+    total += static_cast<std::size_t>(count);
+  }
+  return {total};
+}
+
+/**
+ * @brief Whether the error means the kernel can not copy between these files,
+ * as opposed to an actual I/O failure
+ */
+static bool IsUnsupportedCopy(int errorNumber) {
+  return errorNumber == EXDEV || errorNumber == EINVAL ||
+         errorNumber == ENOSYS || errorNumber == EOPNOTSUPP ||
+         errorNumber == EBADF;
+}
+
+Result<std::uint64_t> KernelCopy(FileDescriptor const &input,
+                                 std::uint64_t inputOffset,
+                                 FileDescriptor const &output,
+                                 std::uint64_t size) {
+  std::uint64_t copied = 0;
+
+  while (copyFileRangeAvailable && copied < size) {
+    auto offset = static_cast<loff_t>(inputOffset + copied);
+    auto count = copy_file_range(
+        input.Get(), &offset, output.Get(), nullptr,
+        std::min<std::uint64_t>(size - copied, MAX_TRANSFER_SIZE_B), 0);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0 && errno == ENOSYS)
+      copyFileRangeAvailable = false;
+    if (count < 0 && IsUnsupportedCopy(errno))
+      break;
+    if (count < 0)
+      return NewError(output.Error());
+    if (count == 0)
+      return {copied};
+    copied += static_cast<std::uint64_t>(count);
+  }
+
+  while (copied < size) {
+    auto offset = static_cast<off_t>(inputOffset + copied);
+    auto count = sendfile(
+        output.Get(), input.Get(), &offset,
+        std::min<std::uint64_t>(size - copied, MAX_TRANSFER_SIZE_B));
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0 && IsUnsupportedCopy(errno))
+      break;
+    if (count < 0)
+      return NewError(output.Error());
+    if (count == 0)
+      break;
+    copied += static_cast<std::uint64_t>(count);
+  }
+
+  return {copied};
+}
+
+} // namespace cc::tar::detail
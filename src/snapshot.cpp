@@ -0,0 +1,154 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+
+#include "error_code.hpp"
+
+namespace cc::tar::detail {
+
+static constexpr std::array<char, 8> SNAPSHOT_MAGIC = {'C', 'C', 'T', 'A',
+                                                       'R', 'S', 'N', 'P'};
+static constexpr std::uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotFileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t recordCount;
+  std::uint64_t pathsSize;
+};
+
+struct SnapshotRecord {
+  std::uint32_t pathSize;
+  std::uint32_t reserved;
+  SnapshotEntry entry;
+};
+
+SnapshotEntry SnapshotEntry::Of(struct stat const &info) {
+  return {.device = static_cast<std::uint64_t>(info.st_dev),
+          .inode = static_cast<std::uint64_t>(info.st_ino),
+          .size = static_cast<std::uint64_t>(info.st_size),
+          .modifiedSeconds = static_cast<std::uint64_t>(info.st_mtim.tv_sec),
+          .modifiedNanoseconds =
+              static_cast<std::uint64_t>(info.st_mtim.tv_nsec),
+          .fileType = static_cast<std::uint64_t>(info.st_mode & S_IFMT)};
+}
+
+void Snapshot::Add(std::string path, SnapshotEntry const &entry) {
+  mEntries.insert_or_assign(std::move(path), entry);
+}
+
+std::optional<SnapshotEntry> Snapshot::Find(std::string const &path) const {
+  auto it = mEntries.find(path);
+  if (it == mEntries.end())
+    return std::nullopt;
+  return it->second;
+}
+
+std::vector<std::string> Snapshot::RemovedFrom(Snapshot const &later) const {
+  std::vector<std::string> removed{};
+  for (auto const &[path, entry] : mEntries) {
+    // A directory that became a file or the other way round is removed
+    // before the new object is extracted in its place
+    auto it = later.mEntries.find(path);
+    if (it == later.mEntries.end() || it->second.fileType != entry.fileType)
+      removed.push_back(path);
+  }
+  std::sort(removed.begin(), removed.end());
+  return removed;
+}
+
+Status Snapshot::Save(std::string const &snapshotPath) const {
+  std::vector<SnapshotRecord> records{};
+  records.reserve(mEntries.size());
+  std::string paths{};
+  for (auto const &[path, entry] : mEntries) {
+    records.push_back({.pathSize = static_cast<std::uint32_t>(path.size()),
+                       .reserved = 0,
+                       .entry = entry});
+    paths.append(path);
+  }
+
+  SnapshotFileHeader fileHeader{.magic = SNAPSHOT_MAGIC,
+                                .version = SNAPSHOT_VERSION,
+                                .reserved = 0,
+                                .recordCount = records.size(),
+                                .pathsSize = paths.size()};
+
+  // Written next to the final path and renamed, so a failed run leaves the
+  // previous snapshot in place
+  auto temporaryPath = snapshotPath + ".tmp";
+  std::ofstream snapshotFile(temporaryPath, std::ios::binary);
+  if (!snapshotFile)
+    return NewError(
+        error::InvalidStream{temporaryPath, error::StreamType::OUTPUT});
+
+  snapshotFile.write(reinterpret_cast<const char *>(&fileHeader),
+                     sizeof(fileHeader));
+  snapshotFile.write(reinterpret_cast<const char *>(records.data()),
+                     records.size() * sizeof(SnapshotRecord));
+  snapshotFile.write(paths.data(), paths.size());
+  snapshotFile.close();
+  if (!snapshotFile ||
+      std::rename(temporaryPath.c_str(), snapshotPath.c_str()))
+    return NewError(
+        error::InvalidStream{snapshotPath, error::StreamType::OUTPUT});
+
+  return Success();
+}
+
+Result<Snapshot> Snapshot::Load(std::string const &snapshotPath) {
+  std::ifstream snapshotFile(snapshotPath, std::ios::binary);
+  if (!snapshotFile) {
+    // The first run of an incremental backup starts from an empty snapshot
+    if (errno == ENOENT)
+      return {Snapshot{}};
+    return NewError(
+        error::InvalidStream{snapshotPath, error::StreamType::INPUT});
+  }
+
+  SnapshotFileHeader fileHeader{};
+  snapshotFile.read(reinterpret_cast<char *>(&fileHeader),
+                    sizeof(fileHeader));
+  if (!snapshotFile || fileHeader.magic != SNAPSHOT_MAGIC ||
+      fileHeader.version != SNAPSHOT_VERSION)
+    return NewError(error::InvalidFile{snapshotPath});
+
+  // The sizes in the header are only trusted once they add up to the file
+  auto dataOffset = snapshotFile.tellg();
+  snapshotFile.seekg(0, std::ios::end);
+  auto dataSize = static_cast<std::uint64_t>(snapshotFile.tellg() - dataOffset);
+  snapshotFile.seekg(dataOffset);
+  if (!snapshotFile ||
+      fileHeader.recordCount > dataSize / sizeof(SnapshotRecord) ||
+      fileHeader.pathsSize !=
+          dataSize - fileHeader.recordCount * sizeof(SnapshotRecord))
+    return NewError(error::InvalidFile{snapshotPath});
+
+  std::vector<SnapshotRecord> records(fileHeader.recordCount);
+  std::string paths(fileHeader.pathsSize, '\0');
+  snapshotFile.read(reinterpret_cast<char *>(records.data()),
+                    records.size() * sizeof(SnapshotRecord));
+  snapshotFile.read(paths.data(), paths.size());
+  if (!snapshotFile)
+    return NewError(error::InvalidFile{snapshotPath});
+
+  Snapshot snapshot{};
+  snapshot.mEntries.reserve(records.size());
+  std::size_t offset = 0;
+  for (auto const &record : records) {
+    if (record.pathSize > paths.size() - offset)
+      return NewError(error::InvalidFile{snapshotPath});
+    snapshot.mEntries.emplace(paths.substr(offset, record.pathSize),
+                              record.entry);
+    offset += record.pathSize;
+  }
+
+  return {std::move(snapshot)};
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,185 @@
+#include "sparse.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <limits>
+#include <unistd.h>
+
+#include "error_code.hpp"
+#include "instrumentation.hpp"
+
+namespace cc::tar::detail {
+
+// Longest line of the map, the twenty digits of the largest 64 bit number
+static constexpr std::size_t MAX_MAP_LINE_SIZE = 20;
+
+/**
+ * @brief Parser for the map at the start of the data of a sparse member,
+ * which is fed the data in chunks of any size
+ */
+class SparseMapParser {
+public:
+  explicit SparseMapParser(std::uint64_t fileSize) : mFileSize(fileSize) {}
+
+  /**
+   * @brief Parse the next chunk of member data
+   * @returns whether the map is complete, the rest of the chunk is ignored
+   */
+  [[nodiscard]] Result<bool> Feed(std::string_view data) {
+    for (auto character : data) {
+      if (++mConsumed > mFileSize)
+        return NewError(error::InvalidConversion{});
+      if (character != '\n') {
+        if (mLine.size() == MAX_MAP_LINE_SIZE)
+          return NewError(error::InvalidConversion{});
+        mLine.push_back(character);
+        continue;
+      }
+
+      std::uint64_t number{};
+      auto [end, error] =
+          std::from_chars(mLine.data(), mLine.data() + mLine.size(), number);
+      if (error != std::errc() || end != mLine.data() + mLine.size())
+        return NewError(error::InvalidConversion{});
+      mLine.clear();
+      BOOST_LEAF_CHECK(Add(number));
+
+      if (Complete()) {
+        mMap.mapSize = PaddedSize(mConsumed);
+        if (mMap.mapSize + mMap.DataSize() != mFileSize)
+          return NewError(error::InvalidConversion{});
+        return {true};
+      }
+    }
+    return {false};
+  }
+
+  [[nodiscard]] SparseMap Take() { return std::move(mMap); }
+
+private:
+  [[nodiscard]] bool Complete() const {
+    return mCount && !mOffset && mMap.extents.size() == *mCount;
+  }
+
+  [[nodiscard]] Status Add(std::uint64_t number) {
+    if (!mCount) {
+      mCount = number;
+      return Success();
+    }
+    if (!mOffset) {
+      mOffset = number;
+      return Success();
+    }
+
+    // Extents are ordered and do not overlap
+    if (*mOffset < mMap.End() ||
+        number > std::numeric_limits<std::uint64_t>::max() - *mOffset)
+      return NewError(error::InvalidConversion{});
+    mMap.extents.push_back({.offset = *mOffset, .size = number});
+    mOffset.reset();
+    return Success();
+  }
+
+  std::uint64_t mFileSize;
+  std::uint64_t mConsumed{0};
+  std::string mLine{};
+  std::optional<std::uint64_t> mCount{};
+  // Offset of the extent whose size is read next
+  std::optional<std::uint64_t> mOffset{};
+  SparseMap mMap{};
+};
+
+std::uint64_t SparseMap::DataSize() const {
+  std::uint64_t size = 0;
+  for (auto const &extent : extents)
+    size += extent.size;
+  return size;
+}
+
+std::uint64_t SparseMap::End() const {
+  if (extents.empty())
+    return 0;
+  return extents.back().offset + extents.back().size;
+}
+
+Result<std::optional<SparseMap>> FindDataExtents(FileDescriptor const &file,
+                                                 struct stat const &info) {
+  // Files with all of their blocks allocated have no holes to look for
+  auto size = static_cast<std::uint64_t>(info.st_size);
+  if (size == 0 || static_cast<std::uint64_t>(info.st_blocks) * 512 >= size)
+    return {std::nullopt};
+
+  PhaseTimer timer(stats::Phase::METADATA);
+  SparseMap map{};
+  std::uint64_t offset = 0;
+  while (offset < size) {
+    auto data = lseek(file.Get(), static_cast<off_t>(offset), SEEK_DATA);
+    if (data < 0 && errno == ENXIO)
+      break;
+    if (data < 0 && errno == EINVAL)
+      return {std::nullopt};
+    auto hole = data < 0 ? data : lseek(file.Get(), data, SEEK_HOLE);
+    if (hole < 0)
+      return NewError(file.Error());
+
+    // The file may have grown since it was stat'ed
+    auto start = static_cast<std::uint64_t>(data);
+    auto end = std::min(static_cast<std::uint64_t>(hole), size);
+    if (start >= end)
+      break;
+    map.extents.push_back({.offset = start, .size = end - start});
+    offset = end;
+  }
+
+  if (map.DataSize() == size)
+    return {std::nullopt};
+  if (map.End() != size)
+    map.extents.push_back({.offset = size, .size = 0});
+  return {std::move(map)};
+}
+
+std::string SerialiseSparseMap(SparseMap const &map) {
+  std::string text = std::to_string(map.extents.size()) + '\n';
+  for (auto const &extent : map.extents) {
+    text += std::to_string(extent.offset) + '\n';
+    text += std::to_string(extent.size) + '\n';
+  }
+  text.resize(PaddedSize(text.size()), '\0');
+  return text;
+}
+
+Result<SparseMap> ReadSparseMap(ArchiveSource &source,
+                                std::uint64_t fileSize) {
+  SparseMapParser parser(fileSize);
+  std::uint64_t read = 0;
+  while (true) {
+    // Reads stop at block boundaries, so nothing past the map is consumed
+    BOOST_LEAF_AUTO(data, source.ReadData(BLOCK_SIZE_B - read % BLOCK_SIZE_B));
+    if (data.empty())
+      return NewError(error::InvalidConversion{});
+    read += data.size();
+    BOOST_LEAF_AUTO(complete, parser.Feed({data.data(), data.size()}));
+    if (complete)
+      break;
+  }
+
+  auto map = parser.Take();
+  BOOST_LEAF_CHECK(source.Skip(map.mapSize - read));
+  return {std::move(map)};
+}
+
+Result<SparseMap> ReadSparseMapAt(ArchiveSource const &source,
+                                  std::uint64_t dataOffset,
+                                  std::uint64_t fileSize) {
+  SparseMapParser parser(fileSize);
+  for (std::uint64_t read = 0;; read += BLOCK_SIZE_B) {
+    BOOST_LEAF_AUTO(block, source.ReadAt(dataOffset + read, BLOCK_SIZE_B));
+    if (block.empty())
+      return NewError(error::InvalidConversion{});
+    BOOST_LEAF_AUTO(complete, parser.Feed({block.data(), block.size()}));
+    if (complete)
+      return {parser.Take()};
+  }
+}
+
+} // namespace cc::tar::detail
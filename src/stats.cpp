@@ -0,0 +1,257 @@
+#include "stats.hpp"
+
+#include <atomic>
+#include <iomanip>
+#include <unordered_set>
+
+#include "instrumentation.hpp"
+
+namespace cc::tar {
+
+namespace {
+
+constexpr std::array<char const *, stats::PHASE_COUNT> PHASE_NAMES = {
+    "header_parse", "header_serialise", "checksum", "archive_io",
+    "file_io",      "file_open",        "file_close", "metadata"};
+
+constexpr std::array<char const *, stats::COUNTER_COUNT> COUNTER_NAMES = {
+    "members_read",          "members_written", "archive_bytes_read",
+    "archive_bytes_written", "file_bytes_read", "file_bytes_written"};
+
+std::uint64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Counters of one thread, only written by that thread
+ *
+ * They are atomic so they can be read while the thread runs, a relaxed load
+ * and store is enough with a single writer.
+ */
+struct ThreadCounters {
+  std::array<std::atomic<std::uint64_t>, stats::PHASE_COUNT> nanoseconds{};
+  std::array<std::atomic<std::uint64_t>, stats::PHASE_COUNT> calls{};
+  std::array<std::atomic<std::uint64_t>, stats::COUNTER_COUNT> counters{};
+
+  static void Add(std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  void AddTo(stats::Report &report) const {
+    for (std::size_t i = 0; i < stats::PHASE_COUNT; i++) {
+      report.nanoseconds[i] += nanoseconds[i].load(std::memory_order_relaxed);
+      report.calls[i] += calls[i].load(std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < stats::COUNTER_COUNT; i++)
+      report.counters[i] += counters[i].load(std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @brief Counters of the running threads and the totals of exited ones
+ */
+struct Registry {
+  std::mutex mutex{};
+  std::unordered_set<ThreadCounters const *> threads{};
+  stats::Report retired{};
+  std::atomic<std::uint64_t> start{0};
+};
+
+Registry &GetRegistry() {
+  // Never destroyed, threads may still exit after static destructors ran
+  static auto *registry = new Registry();
+  return *registry;
+}
+
+/**
+ * @brief Registers the counters of a thread on first use and merges them into
+ * the retired totals when the thread exits
+ */
+class ThreadSlot {
+public:
+  ThreadSlot() {
+    auto &registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    registry.threads.insert(&mCounters);
+  }
+  ThreadSlot(ThreadSlot const &) = delete;
+  ThreadSlot &operator=(ThreadSlot const &) = delete;
+  ~ThreadSlot() {
+    auto &registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    registry.threads.erase(&mCounters);
+    mCounters.AddTo(registry.retired);
+  }
+
+  ThreadCounters &Counters() { return mCounters; }
+
+private:
+  ThreadCounters mCounters{};
+};
+
+ThreadCounters &LocalCounters() {
+  thread_local ThreadSlot slot{};
+  return slot.Counters();
+}
+
+// Innermost running timer of this thread
+thread_local detail::PhaseTimer *currentTimer = nullptr;
+
+double Seconds(std::uint64_t nanoseconds) {
+  return static_cast<double>(nanoseconds) / 1e9;
+}
+
+double Mebibytes(std::uint64_t bytes) {
+  return static_cast<double>(bytes) / (1 << 20);
+}
+
+} // namespace
+
+namespace detail {
+
+void PhaseTimer::Start() {
+  mActive = true;
+  mOuter = currentTimer;
+  currentTimer = this;
+  mStart = Now();
+}
+
+void PhaseTimer::Stop() {
+  auto elapsed = Now() - mStart;
+  currentTimer = mOuter;
+  if (mOuter)
+    mOuter->mNested += elapsed;
+
+  auto &counters = LocalCounters();
+  auto phase = static_cast<std::size_t>(mPhase);
+  ThreadCounters::Add(counters.nanoseconds[phase],
+                      elapsed > mNested ? elapsed - mNested : 0);
+  ThreadCounters::Add(counters.calls[phase], 1);
+}
+
+void AddToCounter(stats::Counter counter, std::uint64_t value) {
+  auto &counters = LocalCounters();
+  ThreadCounters::Add(counters.counters[static_cast<std::size_t>(counter)],
+                      value);
+}
+
+} // namespace detail
+
+namespace stats {
+
+std::uint64_t Report::SystemCalls() const {
+  return Calls(Phase::ARCHIVE_IO) + Calls(Phase::FILE_IO) +
+         Calls(Phase::FILE_OPEN) + Calls(Phase::FILE_CLOSE) +
+         Calls(Phase::METADATA);
+}
+
+double Report::ArchiveThroughput() const {
+  if (elapsedNanoseconds == 0)
+    return 0;
+  return static_cast<double>(Count(Counter::ARCHIVE_BYTES_READ) +
+                             Count(Counter::ARCHIVE_BYTES_WRITTEN)) /
+         Seconds(elapsedNanoseconds);
+}
+
+void Report::WriteText(std::ostream &os) const {
+  auto flags = os.flags();
+  auto precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  os << "elapsed: " << Seconds(elapsedNanoseconds) << " s\n";
+  os << "members: " << Count(Counter::MEMBERS_READ) << " read, "
+     << Count(Counter::MEMBERS_WRITTEN) << " written\n";
+  os << "archive: " << Mebibytes(Count(Counter::ARCHIVE_BYTES_READ))
+     << " MiB read, " << Mebibytes(Count(Counter::ARCHIVE_BYTES_WRITTEN))
+     << " MiB written, " << ArchiveThroughput() / (1 << 20) << " MiB/s\n";
+  os << "files: " << Mebibytes(Count(Counter::FILE_BYTES_READ))
+     << " MiB read, " << Mebibytes(Count(Counter::FILE_BYTES_WRITTEN))
+     << " MiB written\n";
+  os << "system calls: " << SystemCalls() << "\n";
+  // Thread times are summed, so they can add up to more than the elapsed time
+  for (std::size_t i = 0; i < PHASE_COUNT; i++) {
+    os << std::left << std::setw(18) << PHASE_NAMES[i] << std::right
+       << std::setw(12) << Seconds(nanoseconds[i]) << " s" << std::setw(12)
+       << calls[i] << " calls\n";
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void Report::WriteJson(std::ostream &os) const {
+  os << "{\"elapsed_ns\":" << elapsedNanoseconds;
+  for (std::size_t i = 0; i < COUNTER_COUNT; i++)
+    os << ",\"" << COUNTER_NAMES[i] << "\":" << counters[i];
+  os << ",\"system_calls\":" << SystemCalls();
+  os << ",\"archive_bytes_per_second\":"
+     << static_cast<std::uint64_t>(ArchiveThroughput());
+  os << ",\"phases\":{";
+  for (std::size_t i = 0; i < PHASE_COUNT; i++) {
+    os << (i > 0 ? "," : "") << "\"" << PHASE_NAMES[i] << "\":{\"ns\":"
+       << nanoseconds[i] << ",\"calls\":" << calls[i] << "}";
+  }
+  os << "}}\n";
+}
+
+void Enable() {
+  auto &registry = GetRegistry();
+  std::uint64_t unset = 0;
+  registry.start.compare_exchange_strong(unset, Now());
+  detail::statsEnabled.store(true, std::memory_order_relaxed);
+}
+
+bool Enabled() {
+  return detail::statsEnabled.load(std::memory_order_relaxed);
+}
+
+Report Collect() {
+  auto &registry = GetRegistry();
+  std::lock_guard lock(registry.mutex);
+  auto report = registry.retired;
+  for (auto const *counters : registry.threads)
+    counters->AddTo(report);
+  auto start = registry.start.load();
+  if (start > 0)
+    report.elapsedNanoseconds = Now() - start;
+  return report;
+}
+
+ProgressPrinter::ProgressPrinter(std::ostream &os,
+                                 std::chrono::milliseconds interval)
+    : mStream(os), mInterval(interval) {
+  Enable();
+  mThread = std::thread([this]() { Run(); });
+}
+
+ProgressPrinter::~ProgressPrinter() {
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mStopped.notify_all();
+  mThread.join();
+}
+
+void ProgressPrinter::Run() {
+  std::unique_lock lock(mMutex);
+  while (!mStopped.wait_for(lock, mInterval, [this]() { return mStopping; })) {
+    auto report = Collect();
+    auto flags = mStream.flags();
+    auto precision = mStream.precision();
+    mStream << std::fixed << std::setprecision(1) << "progress: "
+            << report.Count(Counter::MEMBERS_READ) << " members read, "
+            << report.Count(Counter::MEMBERS_WRITTEN) << " written, "
+            << Mebibytes(report.Count(Counter::ARCHIVE_BYTES_READ))
+            << " MiB read, "
+            << Mebibytes(report.Count(Counter::ARCHIVE_BYTES_WRITTEN))
+            << " MiB written, " << report.ArchiveThroughput() / (1 << 20)
+            << " MiB/s" << std::endl;
+    mStream.flags(flags);
+    mStream.precision(precision);
+  }
+}
+
+} // namespace stats
+} // namespace cc::tar
@@ -0,0 +1,165 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace cc::tar::detail {
+
+ThreadPool::ThreadPool(std::uint32_t threadCount) {
+  mThreads.reserve(threadCount);
+  for (std::uint32_t i = 0; i < threadCount; i++)
+    mThreads.emplace_back([this]() { Run(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mTaskAvailable.notify_all();
+  for (auto &thread : mThreads)
+    thread.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard lock(mMutex);
+    mTasks.push_back(std::move(task));
+  }
+  mTaskAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock lock(mMutex);
+  mTasksDone.wait(lock, [this]() { return mTasks.empty() && !mActiveTasks; });
+}
+
+void ThreadPool::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(mMutex);
+      mTaskAvailable.wait(lock,
+                          [this]() { return mStopping || !mTasks.empty(); });
+      if (mTasks.empty())
+        return;
+
+      task = std::move(mTasks.front());
+      mTasks.pop_front();
+      mActiveTasks++;
+    }
+
+    task();
+
+    {
+      std::lock_guard lock(mMutex);
+      mActiveTasks--;
+    }
+    mTasksDone.notify_all();
+  }
+}
+
+// Pool and queue index of the worker running on this thread, if any
+static thread_local WorkStealingPool const *currentPool = nullptr;
+static thread_local std::size_t currentQueue = 0;
+
+WorkStealingPool::WorkStealingPool(std::uint32_t threadCount) {
+  threadCount = std::max<std::uint32_t>(threadCount, 1);
+  for (std::uint32_t i = 0; i < threadCount; i++)
+    mQueues.push_back(std::make_unique<Queue>());
+
+  mThreads.reserve(threadCount);
+  for (std::uint32_t i = 0; i < threadCount; i++)
+    mThreads.emplace_back([this, i]() { Run(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mTaskAvailable.notify_all();
+  for (auto &thread : mThreads)
+    thread.join();
+}
+
+void WorkStealingPool::Submit(std::function<void()> task) {
+  {
+    // Counting and queueing under the pool mutex means a queued task is
+    // always in one of the queues when a worker wakes up for it
+    std::lock_guard lock(mMutex);
+    auto &queue = *mQueues[currentPool == this ? currentQueue
+                                               : mNextQueue++ % mQueues.size()];
+    {
+      std::lock_guard queueLock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    mQueuedTasks++;
+    mPendingTasks++;
+  }
+  mTaskAvailable.notify_one();
+}
+
+void WorkStealingPool::Wait() {
+  std::unique_lock lock(mMutex);
+  mTasksDone.wait(lock, [this]() { return mPendingTasks == 0; });
+}
+
+bool WorkStealingPool::TryTake(std::size_t worker,
+                               std::function<void()> &task) {
+  {
+    auto &own = *mQueues[worker];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for (std::size_t offset = 1; offset < mQueues.size(); offset++) {
+    auto &victim = *mQueues[(worker + offset) % mQueues.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::Run(std::size_t worker) {
+  currentPool = this;
+  currentQueue = worker;
+
+  while (true) {
+    {
+      std::unique_lock lock(mMutex);
+      mTaskAvailable.wait(
+          lock, [this]() { return mStopping || mQueuedTasks > 0; });
+      if (mQueuedTasks == 0)
+        return;
+    }
+
+    // The task counted as queued may be taken by another worker first
+    std::function<void()> task;
+    if (!TryTake(worker, task))
+      continue;
+    {
+      std::lock_guard lock(mMutex);
+      mQueuedTasks--;
+    }
+
+    task();
+
+    bool done;
+    {
+      std::lock_guard lock(mMutex);
+      done = --mPendingTasks == 0;
+    }
+    if (done)
+      mTasksDone.notify_all();
+  }
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,327 @@
+#include "tree_walker.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string_view>
+#include <tuple>
+#include <unistd.h>
+
+#include "instrumentation.hpp"
+
+namespace cc::tar::detail {
+
+// Size of the buffer handed to getdents64(2), enough for about a thousand
+// entries per call
+static constexpr std::size_t DIRECTORY_BUFFER_SIZE_B = 32 << 10;
+
+// Entries listed ahead of the consumer before the listings of further
+// directories are held back, a single large directory may exceed it
+static constexpr std::size_t MAX_QUEUED_ENTRIES = 4096;
+
+static std::string JoinPath(std::string const &directory,
+                            std::string_view name) {
+  std::string path{};
+  path.reserve(directory.size() + name.size() + 1);
+  path.append(directory);
+  if (path.back() != '/')
+    path.push_back('/');
+  path.append(name);
+  return path;
+}
+
+static std::string_view BaseName(std::string const &path) {
+  return std::string_view(path).substr(path.rfind('/') + 1);
+}
+
+static bool IsListed(struct stat const &info) {
+  return S_ISREG(info.st_mode) || S_ISDIR(info.st_mode) ||
+         S_ISLNK(info.st_mode);
+}
+
+/**
+ * @brief Report an entry that was removed after its directory was read
+ */
+static void WarnVanished(std::string const &path) {
+  std::cerr << "cc-tar: " << path << ": file removed while archiving, "
+            << "skipped\n";
+}
+
+/**
+ * @brief Read the target of the symbolic link name, relative to directory
+ */
+static bool ReadLink(int directory, char const *name, std::uint64_t size,
+                     std::string &target) {
+  // The size reported by lstat(2) may be zero on some file systems
+  target.resize(std::max<std::uint64_t>(size, 64));
+  PhaseTimer timer(stats::Phase::METADATA);
+  while (true) {
+    auto count = readlinkat(directory, name, target.data(), target.size());
+    if (count < 0)
+      return false;
+    if (static_cast<std::size_t>(count) < target.size()) {
+      target.resize(count);
+      return true;
+    }
+    target.resize(2 * target.size());
+  }
+}
+
+TreeWalker::TreeWalker(std::vector<std::string> roots, std::uint32_t jobs,
+                       bool sorted)
+    : mRoots(std::move(roots)), mSorted(sorted), mPool(jobs) {}
+
+TreeWalker::~TreeWalker() { Stop(); }
+
+void TreeWalker::Stop() {
+  {
+    std::lock_guard lock(mMutex);
+    mStopping = true;
+  }
+  mListed.notify_all();
+}
+
+Status TreeWalker::ListRoots() {
+  std::vector<Child> children{};
+  children.reserve(mRoots.size());
+  for (auto &root : mRoots) {
+    // Trailing slashes would end up in the names of the members
+    while (root.size() > 1 && root.back() == '/')
+      root.pop_back();
+
+    auto &child = children.emplace_back();
+    PhaseTimer timer(stats::Phase::METADATA);
+    if (lstat(root.c_str(), &child.info) != 0 || !IsListed(child.info) ||
+        (S_ISLNK(child.info.st_mode) &&
+         !ReadLink(AT_FDCWD, root.c_str(), child.info.st_size,
+                   child.linkTarget)))
+      return NewError(error::InvalidFile{root});
+    child.path = std::move(root);
+  }
+  mRoots = {};
+
+  {
+    std::lock_guard lock(mMutex);
+    mRootsListed = true;
+    mPendingListings++;
+    if (mSorted)
+      mCursors.push_back({&mDirectories.emplace_back(), 0});
+    else
+      mDirectories.emplace_back();
+  }
+  Publish(mDirectories.front(), nullptr, std::move(children));
+  return Success();
+}
+
+Status TreeWalker::List(FileDescriptor const *parent, std::string const &path,
+                        FileDescriptor &file, std::vector<Child> &children) {
+  // Roots are opened by path, everything below is opened relative to its
+  // parent
+  auto name = parent ? std::string(BaseName(path)) : path;
+  int fd = -1;
+  int openError = 0;
+  {
+    PhaseTimer timer(stats::Phase::FILE_OPEN);
+    fd = openat(parent ? parent->Get() : AT_FDCWD, name.c_str(),
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC | (parent ? O_NOFOLLOW : 0));
+    openError = fd < 0 ? errno : 0;
+  }
+  // Directories removed since their parent was read are left empty
+  if (parent && openError == ENOENT) {
+    WarnVanished(path);
+    return Success();
+  }
+  if (fd < 0)
+    return NewError(error::InvalidFile{path});
+  file = FileDescriptor(fd, path, error::StreamType::INPUT);
+
+  alignas(struct dirent64) std::array<char, DIRECTORY_BUFFER_SIZE_B> buffer;
+  while (true) {
+    ssize_t count = 0;
+    {
+      PhaseTimer timer(stats::Phase::METADATA);
+      count = getdents64(fd, buffer.data(), buffer.size());
+    }
+    if (count < 0)
+      return NewError(error::InvalidFile{path});
+    if (count == 0)
+      break;
+
+    for (ssize_t offset = 0; offset < count;) {
+      auto const *entry =
+          reinterpret_cast<struct dirent64 const *>(buffer.data() + offset);
+      offset += entry->d_reclen;
+
+      std::string_view entryName(entry->d_name);
+      if (entryName == "." || entryName == "..")
+        continue;
+      // Entries of other types are skipped without a stat
+      if (entry->d_type != DT_REG && entry->d_type != DT_DIR &&
+          entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+        continue;
+
+      Child child{};
+      int statError = 0;
+      {
+        PhaseTimer timer(stats::Phase::METADATA);
+        if (fstatat(fd, entry->d_name, &child.info, AT_SYMLINK_NOFOLLOW) != 0)
+          statError = errno;
+      }
+      child.path = JoinPath(path, entryName);
+      // Entries removed since the directory was read are left out
+      if (statError == ENOENT) {
+        WarnVanished(child.path);
+        continue;
+      }
+      if (statError != 0)
+        return NewError(error::InvalidFile{child.path});
+      if (!IsListed(child.info))
+        continue;
+      if (S_ISLNK(child.info.st_mode) &&
+          !ReadLink(fd, entry->d_name, child.info.st_size, child.linkTarget)) {
+        if (errno != ENOENT)
+          return NewError(error::InvalidFile{child.path});
+        WarnVanished(child.path);
+        continue;
+      }
+      children.push_back(std::move(child));
+    }
+  }
+
+  if (mSorted)
+    std::sort(children.begin(), children.end(),
+              [](Child const &a, Child const &b) { return a.path < b.path; });
+  return Success();
+}
+
+void TreeWalker::Publish(Directory &directory,
+                         std::shared_ptr<FileDescriptor> file,
+                         std::vector<Child> children) {
+  std::vector<std::tuple<Directory *, std::string>> listings{};
+  {
+    std::lock_guard lock(mMutex);
+    mQueuedEntries += children.size();
+    // Nested listings are counted before this one is done, so the walk never
+    // looks complete while they are queued
+    if (!mStopping && !mErrors.Failed()) {
+      for (auto &child : children) {
+        if (!S_ISDIR(child.info.st_mode))
+          continue;
+        child.directory = &mDirectories.emplace_back();
+        mPendingListings++;
+        if (mQueuedEntries < MAX_QUEUED_ENTRIES) {
+          listings.emplace_back(child.directory, child.path);
+          continue;
+        }
+        child.directory->deferred = true;
+        child.directory->parent = file;
+        child.directory->path = child.path;
+        mDeferred.push_back(child.directory);
+      }
+    }
+
+    directory.children = std::move(children);
+    directory.listed = true;
+    mPendingListings--;
+    if (!mSorted)
+      mCursors.push_back({&directory, 0});
+  }
+  mListed.notify_all();
+
+  // The subdirectories are opened relative to this one, the descriptor stays
+  // open until the last of them was
+  for (auto &[child, path] : listings)
+    Submit(*child, file, std::move(path));
+}
+
+void TreeWalker::Submit(Directory &directory,
+                        std::shared_ptr<FileDescriptor> parent,
+                        std::string path) {
+  mPool.Submit([this, &directory, parent = std::move(parent),
+                path = std::move(path)]() {
+    FileDescriptor file{};
+    std::vector<Child> children{};
+    mErrors.Run([&]() -> Status {
+      {
+        std::lock_guard lock(mMutex);
+        if (mStopping)
+          return Success();
+      }
+      return List(parent.get(), path, file, children);
+    });
+    // Also published on failure, so the consumer wakes up to report it
+    Publish(directory, std::make_shared<FileDescriptor>(std::move(file)),
+            std::move(children));
+  });
+}
+
+void TreeWalker::Resume(Directory &directory) {
+  directory.deferred = false;
+  Submit(directory, std::move(directory.parent), std::move(directory.path));
+}
+
+void TreeWalker::ResumeNext() {
+  // Listings the sorted walk needed first are already submitted
+  while (!mDeferred.empty()) {
+    auto *directory = mDeferred.front();
+    mDeferred.pop_front();
+    if (directory->deferred) {
+      Resume(*directory);
+      return;
+    }
+  }
+}
+
+Result<std::optional<WalkEntry>> TreeWalker::Next() {
+  if (!mRootsListed)
+    BOOST_LEAF_CHECK(ListRoots());
+
+  {
+    std::unique_lock lock(mMutex);
+    while (!mStopping && !mErrors.Failed()) {
+      if (mCursors.empty()) {
+        if (mSorted || mPendingListings == 0)
+          break;
+        ResumeNext();
+        mListed.wait(lock);
+        continue;
+      }
+
+      // Sorted walks descend into a directory before going on with the
+      // rest of its parent, others take the listings as they complete
+      auto &cursor = mSorted ? mCursors.back() : mCursors.front();
+      auto &directory = *cursor.directory;
+      if (!directory.listed) {
+        if (directory.deferred)
+          Resume(directory);
+        mListed.wait(lock);
+        continue;
+      }
+      if (cursor.child == directory.children.size()) {
+        directory.children = {};
+        if (mSorted)
+          mCursors.pop_back();
+        else
+          mCursors.pop_front();
+        continue;
+      }
+
+      auto &child = directory.children[cursor.child++];
+      if (mSorted && child.directory)
+        mCursors.push_back({child.directory, 0});
+      if (--mQueuedEntries < MAX_QUEUED_ENTRIES)
+        ResumeNext();
+      return {WalkEntry{.path = std::move(child.path),
+                        .info = child.info,
+                        .linkTarget = std::move(child.linkTarget)}};
+    }
+  }
+
+  BOOST_LEAF_CHECK(mErrors.Rethrow());
+  return {std::nullopt};
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,345 @@
+#include "uring_backend.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "instrumentation.hpp"
+
+namespace cc::tar::detail {
+
+// Files with an operation in flight at any time
+static constexpr unsigned QUEUE_DEPTH = 64;
+
+// Registered area holding data assembled through UringBackend::Buffer
+static constexpr std::size_t STAGING_SIZE_B = 4 << 20;
+
+// Largest chunk handed to a single write, the length field is 32 bits wide
+static constexpr std::uint64_t MAX_WRITE_SIZE_B = 1 << 30;
+
+static int SetupRing(unsigned entries, io_uring_params &params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+static int EnterRing(int ringFd, unsigned toSubmit, unsigned minComplete,
+                     unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit,
+                                  minComplete, flags, nullptr, 0));
+}
+
+static int RegisterRing(int ringFd, unsigned opcode, void *arg,
+                        unsigned count) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+/**
+ * @brief Whether the kernel implements every operation used by the backend,
+ * which needs Linux 5.6 or newer
+ */
+static bool SupportsOperations(int ringFd) {
+  static constexpr unsigned PROBE_OPS = 256;
+  std::vector<char> storage(sizeof(io_uring_probe) +
+                            PROBE_OPS * sizeof(io_uring_probe_op));
+  auto probe = reinterpret_cast<io_uring_probe *>(storage.data());
+  if (RegisterRing(ringFd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0)
+    return false;
+
+  for (unsigned operation : {IORING_OP_OPENAT, IORING_OP_WRITE,
+                             IORING_OP_WRITE_FIXED, IORING_OP_CLOSE}) {
+    if (operation > probe->last_op ||
+        !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED))
+      return false;
+  }
+  return true;
+}
+
+template <typename T> static T *At(void *ring, std::uint32_t offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+
+std::unique_ptr<UringBackend> UringBackend::Create() {
+  io_uring_params params{};
+  int ringFd = SetupRing(QUEUE_DEPTH, params);
+  if (ringFd < 0)
+    return nullptr;
+
+  std::unique_ptr<UringBackend> backend(new UringBackend());
+  auto &ring = *backend;
+  ring.mRingFd = ringFd;
+  if (!SupportsOperations(ringFd))
+    return nullptr;
+
+  ring.mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring.mCqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMapping)
+    ring.mSqRingSize = std::max(ring.mSqRingSize, ring.mCqRingSize);
+
+  auto mapRing = [ringFd](std::size_t size, off_t offset) -> void * {
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringFd, offset);
+    return mapping == MAP_FAILED ? nullptr : mapping;
+  };
+  if (!(ring.mSqRingSize && (ring.mSqRing = mapRing(ring.mSqRingSize,
+                                                    IORING_OFF_SQ_RING))))
+    return nullptr;
+  if (!singleMapping &&
+      !(ring.mCqRing = mapRing(ring.mCqRingSize, IORING_OFF_CQ_RING)))
+    return nullptr;
+  ring.mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  auto sqes = mapRing(ring.mSqesSize, IORING_OFF_SQES);
+  if (!sqes)
+    return nullptr;
+  ring.mSqes = static_cast<io_uring_sqe *>(sqes);
+
+  auto cqRing = singleMapping ? ring.mSqRing : ring.mCqRing;
+  ring.mSqHead = At<unsigned>(ring.mSqRing, params.sq_off.head);
+  ring.mSqTail = At<unsigned>(ring.mSqRing, params.sq_off.tail);
+  ring.mSqMask = At<unsigned>(ring.mSqRing, params.sq_off.ring_mask);
+  ring.mSqArray = At<unsigned>(ring.mSqRing, params.sq_off.array);
+  ring.mCqHead = At<unsigned>(cqRing, params.cq_off.head);
+  ring.mCqTail = At<unsigned>(cqRing, params.cq_off.tail);
+  ring.mCqMask = At<unsigned>(cqRing, params.cq_off.ring_mask);
+  ring.mCqes = At<io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+  // Every file has at most one operation in flight, so the submission queue
+  // never overflows
+  ring.mRequests.resize(params.sq_entries);
+  for (std::size_t slot = ring.mRequests.size(); slot > 0; slot--)
+    ring.mFreeSlots.push_back(slot - 1);
+
+  void *staging = mmap(nullptr, STAGING_SIZE_B, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (staging == MAP_FAILED)
+    return nullptr;
+  ring.mStaging = static_cast<char *>(staging);
+  ring.mStagingSize = STAGING_SIZE_B;
+
+  // Registration may be refused, for example by a low RLIMIT_MEMLOCK, in
+  // which case the staging area is written with regular writes
+  iovec stagingVector{.iov_base = staging, .iov_len = STAGING_SIZE_B};
+  ring.mStagingRegistered =
+      RegisterRing(ringFd, IORING_REGISTER_BUFFERS, &stagingVector, 1) == 0;
+
+  return backend;
+}
+
+UringBackend::~UringBackend() {
+  // Errors of files that are still being written have no one to report to
+  if (mSqes)
+    static_cast<void>(Wait());
+
+  if (mStaging)
+    munmap(mStaging, mStagingSize);
+  if (mSqes)
+    munmap(mSqes, mSqesSize);
+  if (mCqRing)
+    munmap(mCqRing, mCqRingSize);
+  if (mSqRing)
+    munmap(mSqRing, mSqRingSize);
+  if (mRingFd >= 0)
+    close(mRingFd);
+}
+
+Status UringBackend::WriteFile(std::string const &path,
+                               std::span<const char> data) {
+  BOOST_LEAF_CHECK(Wait(path));
+  while (mFreeSlots.empty())
+    Enter(1);
+
+  auto slot = mFreeSlots.back();
+  mFreeSlots.pop_back();
+  auto &request = mRequests[slot];
+  request.path.assign(path);
+  request.data = data;
+  request.written = 0;
+  request.fd = -1;
+  request.active = true;
+  QueueOpen(slot);
+
+  // Submissions are batched, so the system call is shared by many files
+  if (mQueued >= mRequests.size() / 2)
+    Enter(0);
+
+  if (mError)
+    return NewError(*mError);
+  return Success();
+}
+
+Result<std::span<char>> UringBackend::Buffer(std::uint64_t size) {
+  if (size > mStagingSize)
+    return NewError(error::InvalidBufferSize{});
+
+  // The staging area is reused once every write from it has completed
+  if (size > mStagingSize - mStagingUsed)
+    BOOST_LEAF_CHECK(Wait());
+
+  std::span<char> buffer(mStaging + mStagingUsed, size);
+  mStagingUsed += size;
+  return {buffer};
+}
+
+Status UringBackend::Wait(std::string const &path) {
+  auto pending = [&]() {
+    return std::any_of(mRequests.begin(), mRequests.end(),
+                       [&](Request const &request) {
+                         return request.active && request.path == path;
+                       });
+  };
+  while (pending())
+    Enter(1);
+  return Success();
+}
+
+Status UringBackend::Wait() {
+  while (mFreeSlots.size() < mRequests.size())
+    Enter(1);
+  mStagingUsed = 0;
+
+  if (mError) {
+    auto failure = std::move(*mError);
+    mError.reset();
+    return NewError(std::move(failure));
+  }
+  return Success();
+}
+
+io_uring_sqe *UringBackend::NextSqe(std::size_t slot, Operation operation) {
+  auto tail = *mSqTail;
+  auto index = tail & *mSqMask;
+  auto sqe = &mSqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = slot << 2 | static_cast<std::uint64_t>(operation);
+  mSqArray[index] = index;
+
+  __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+  mQueued++;
+  return sqe;
+}
+
+void UringBackend::QueueOpen(std::size_t slot) {
+  auto sqe = NextSqe(slot, Operation::OPEN);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<std::uint64_t>(mRequests[slot].path.c_str());
+  sqe->len = 0666;
+  sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+}
+
+void UringBackend::QueueWrite(std::size_t slot) {
+  auto &request = mRequests[slot];
+  auto remaining = request.data.subspan(request.written);
+  auto size = std::min<std::uint64_t>(remaining.size(), MAX_WRITE_SIZE_B);
+  bool staged = remaining.data() >= mStaging &&
+                remaining.data() < mStaging + mStagingSize;
+
+  auto sqe = NextSqe(slot, Operation::WRITE);
+  sqe->opcode = staged && mStagingRegistered ? IORING_OP_WRITE_FIXED
+                                             : IORING_OP_WRITE;
+  sqe->fd = request.fd;
+  sqe->addr = reinterpret_cast<std::uint64_t>(remaining.data());
+  sqe->len = static_cast<std::uint32_t>(size);
+  sqe->off = request.written;
+  sqe->buf_index = 0;
+}
+
+void UringBackend::QueueClose(std::size_t slot) {
+  auto sqe = NextSqe(slot, Operation::CLOSE);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = mRequests[slot].fd;
+}
+
+void UringBackend::Enter(unsigned minComplete) {
+  auto flags = minComplete ? IORING_ENTER_GETEVENTS : 0u;
+  // Opens, writes and closes of the ring are all timed as file I/O
+  int submitted = 0;
+  {
+    PhaseTimer timer(stats::Phase::FILE_IO);
+    submitted = EnterRing(mRingFd, mQueued, minComplete, flags);
+  }
+  if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+    // The ring is unusable, files that are still open are closed here
+    for (std::size_t slot = 0; slot < mRequests.size(); slot++) {
+      auto &request = mRequests[slot];
+      if (!request.active)
+        continue;
+      if (!mError)
+        mError = error::InvalidStream{request.path, error::StreamType::OUTPUT};
+      if (request.fd >= 0)
+        close(request.fd);
+      Release(slot);
+    }
+    mQueued = 0;
+    mInFlight = 0;
+    return;
+  }
+  if (submitted > 0) {
+    mQueued -= static_cast<unsigned>(submitted);
+    mInFlight += static_cast<unsigned>(submitted);
+  }
+
+  auto head = *mCqHead;
+  while (head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE)) {
+    auto cqe = mCqes[head & *mCqMask];
+    __atomic_store_n(mCqHead, ++head, __ATOMIC_RELEASE);
+    mInFlight--;
+    Complete(cqe);
+  }
+}
+
+void UringBackend::Complete(io_uring_cqe const &cqe) {
+  auto slot = static_cast<std::size_t>(cqe.user_data >> 2);
+  auto operation = static_cast<Operation>(cqe.user_data & 3);
+  auto &request = mRequests[slot];
+
+  switch (operation) {
+  case Operation::OPEN:
+    if (cqe.res < 0)
+      return Fail(slot);
+    request.fd = cqe.res;
+    if (request.data.empty())
+      return QueueClose(slot);
+    return QueueWrite(slot);
+  case Operation::WRITE:
+    if (cqe.res <= 0)
+      return Fail(slot);
+    request.written += static_cast<std::uint64_t>(cqe.res);
+    Count(stats::Counter::FILE_BYTES_WRITTEN,
+          static_cast<std::uint64_t>(cqe.res));
+    if (request.written < request.data.size())
+      return QueueWrite(slot);
+    return QueueClose(slot);
+  case Operation::CLOSE:
+    // Write-back errors are reported on close
+    request.fd = -1;
+    if (cqe.res < 0)
+      return Fail(slot);
+    return Release(slot);
+  }
+}
+
+void UringBackend::Fail(std::size_t slot) {
+  auto &request = mRequests[slot];
+  if (!mError)
+    mError = error::InvalidStream{request.path, error::StreamType::OUTPUT};
+  if (request.fd >= 0)
+    return QueueClose(slot);
+  Release(slot);
+}
+
+void UringBackend::Release(std::size_t slot) {
+  auto &request = mRequests[slot];
+  request.active = false;
+  request.fd = -1;
+  mFreeSlots.push_back(slot);
+}
+
+} // namespace cc::tar::detail
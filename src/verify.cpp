@@ -0,0 +1,237 @@
+#include "verify.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "detail.hpp"
+#include "error_code.hpp"
+#include "error_slot.hpp"
+#include "sparse.hpp"
+#include "thread_pool.hpp"
+
+namespace cc::tar::detail {
+
+// Archive ranges handed to each verification thread, more than one per
+// thread so threads that got ranges with few headers take further ones
+static constexpr std::uint64_t RANGES_PER_JOB = 8;
+
+// Zero padding and trailing blocks are read in parts of this size
+static constexpr std::uint64_t ZERO_CHECK_SIZE_B = 1 << 20;
+
+/**
+ * @brief Headers of a member located by the scan
+ */
+struct MemberLocation {
+  // First block of the member, the first of its extension headers if any
+  std::uint64_t offset;
+  std::uint64_t headerOffset;
+  std::uint64_t fileSize;
+};
+
+static bool IsZero(std::span<const char> data) {
+  return std::all_of(data.begin(), data.end(),
+                     [](char byte) { return byte == 0x00; });
+}
+
+static Status CheckZeroAt(ArchiveSource const &tarFile, std::uint64_t offset,
+                          std::uint64_t size) {
+  while (size > 0) {
+    auto part = std::min(size, ZERO_CHECK_SIZE_B);
+    BOOST_LEAF_AUTO(data, tarFile.ReadAt(offset, part));
+    if (!IsZero(data))
+      return NewError(error::InvalidConversion{});
+    offset += part;
+    size -= part;
+  }
+  return Success();
+}
+
+/**
+ * @brief Hop from header to header up to the end-of-archive marker, without
+ * verifying checksums
+ * @param end set to the offset of the marker
+ */
+static Result<std::vector<MemberLocation>>
+LocateMembers(ArchiveSource const &tarFile, std::string const &fileName,
+              std::uint64_t archiveSize, std::uint64_t &end) {
+  std::vector<MemberLocation> members{};
+  ExtendedHeader extended{};
+  std::uint64_t first = 0;
+  std::uint64_t offset = 0;
+  while (true) {
+    if (archiveSize - offset < BLOCK_SIZE_B)
+      return NewError(error::InvalidStream{fileName, error::StreamType::INPUT});
+    BOOST_LEAF_AUTO(block, tarFile.ReadAt(offset, BLOCK_SIZE_B));
+    if (IsEndOfArchive(block)) {
+      // Extension headers have to be followed by their member
+      if (first != offset)
+        return NewError(error::InvalidConversion{});
+      end = offset;
+      return {std::move(members)};
+    }
+
+    BOOST_LEAF_AUTO(size, helpers::View<common::FILE_SIZE>(block));
+    auto type = helpers::View<common::LINK_INDICATOR>(block);
+    if (IsExtension(type)) {
+      if (size > MAX_EXTENSION_SIZE_B ||
+          archiveSize - offset - BLOCK_SIZE_B < size)
+        return NewError(error::InvalidConversion{});
+      BOOST_LEAF_AUTO(data, tarFile.ReadAt(offset + BLOCK_SIZE_B, size));
+      BOOST_LEAF_CHECK(ApplyExtension(
+          type, std::string_view(data.data(), data.size()), extended));
+    } else {
+      size = extended.fileSize.value_or(size);
+      members.push_back(
+          {.offset = first, .headerOffset = offset, .fileSize = size});
+      extended.Clear();
+    }
+
+    if (archiveSize - offset - BLOCK_SIZE_B < PaddedSize(size))
+      return NewError(error::InvalidStream{fileName, error::StreamType::INPUT});
+    offset += BLOCK_SIZE_B + PaddedSize(size);
+    if (!IsExtension(type))
+      first = offset;
+  }
+}
+
+/**
+ * @brief Check the headers, sparse map and padding of a located member
+ */
+static Status VerifyMember(ArchiveSource const &tarFile,
+                           MemberLocation const &member,
+                           ExtendedHeader &extended,
+                           common::ObjectHeader &header) {
+  extended.Clear();
+  for (auto offset = member.offset; offset < member.headerOffset;) {
+    // Blocks of a decompressing source are only valid until its next read
+    BOOST_LEAF_AUTO(block, tarFile.ReadAt(offset, BLOCK_SIZE_B));
+    BOOST_LEAF_AUTO(view, HeaderView::Open(block));
+    BOOST_LEAF_AUTO(size, view.Get<common::FILE_SIZE>());
+    auto type = view.LinkIndicator();
+    BOOST_LEAF_AUTO(data, tarFile.ReadAt(offset + BLOCK_SIZE_B, size));
+    BOOST_LEAF_CHECK(ApplyExtension(
+        type, std::string_view(data.data(), data.size()), extended));
+    BOOST_LEAF_CHECK(CheckZeroAt(tarFile, offset + BLOCK_SIZE_B + size,
+                                 PaddedSize(size) - size));
+    offset += BLOCK_SIZE_B + PaddedSize(size);
+  }
+
+  BOOST_LEAF_AUTO(block, tarFile.ReadAt(member.headerOffset, BLOCK_SIZE_B));
+  BOOST_LEAF_AUTO(view, HeaderView::Open(block, &extended));
+  BOOST_LEAF_CHECK(view.CopyTo(header));
+  if (header.fileSize != member.fileSize)
+    return NewError(error::InvalidConversion{});
+
+  auto dataOffset = member.headerOffset + BLOCK_SIZE_B;
+  if (extended.sparseSize) {
+    BOOST_LEAF_AUTO(map, ReadSparseMapAt(tarFile, dataOffset, header.fileSize));
+    if (header.sparseSize > 0 && header.sparseSize < map.End())
+      return NewError(error::InvalidConversion{});
+  }
+  return CheckZeroAt(tarFile, dataOffset + header.fileSize,
+                     PaddedSize(header.fileSize) - header.fileSize);
+}
+
+static Status VerifyRandomAccess(ArchiveSource const &tarFile,
+                                 std::string const &fileName,
+                                 std::uint64_t archiveSize,
+                                 std::uint32_t jobs) {
+  std::uint64_t end = 0;
+  BOOST_LEAF_AUTO(members,
+                  LocateMembers(tarFile, fileName, archiveSize, end));
+  if (archiveSize - end < 2 * BLOCK_SIZE_B)
+    return NewError(error::InvalidConversion{});
+  BOOST_LEAF_CHECK(CheckZeroAt(tarFile, end, archiveSize - end));
+
+  // Members are assigned to the range their first block lies in
+  auto rangeCount = std::max<std::uint64_t>(jobs * RANGES_PER_JOB, 1);
+  auto rangeSize = std::max<std::uint64_t>((end + rangeCount - 1) / rangeCount,
+                                           BLOCK_SIZE_B);
+  ErrorSlot errors{};
+  ThreadPool pool(jobs);
+  auto rangeBegin = members.begin();
+  for (std::uint64_t rangeEnd = rangeSize; rangeBegin != members.end();
+       rangeEnd += rangeSize) {
+    auto next = std::lower_bound(
+        rangeBegin, members.end(), rangeEnd,
+        [](MemberLocation const &member, std::uint64_t offset) {
+          return member.offset < offset;
+        });
+    if (next == rangeBegin)
+      continue;
+
+    pool.Submit([&tarFile, &errors, rangeBegin, next]() {
+      errors.Run([&]() -> Status {
+        ExtendedHeader extended{};
+        common::ObjectHeader header{};
+        for (auto member = rangeBegin; member != next; member++) {
+          if (errors.Failed())
+            return Success();
+          BOOST_LEAF_CHECK(VerifyMember(tarFile, *member, extended, header));
+        }
+        return Success();
+      });
+    });
+    rangeBegin = next;
+  }
+  pool.Wait();
+  return errors.Rethrow();
+}
+
+static Status ReadZeros(ArchiveSource &tarFile, std::uint64_t size) {
+  while (size > 0) {
+    BOOST_LEAF_AUTO(data, tarFile.ReadData(size));
+    if (data.empty() || !IsZero(data))
+      return NewError(error::InvalidConversion{});
+    size -= data.size();
+  }
+  return Success();
+}
+
+static Status VerifySequential(ArchiveSource &tarFile) {
+  ExtendedHeader extended{};
+  common::ObjectHeader header{};
+  while (true) {
+    auto offset = tarFile.Offset();
+    BOOST_LEAF_AUTO(next, ReadHeader(tarFile, extended));
+    if (!next) {
+      // The input ended without a marker if no zero block was read
+      if (tarFile.Offset() == offset)
+        return NewError(error::InvalidConversion{});
+      break;
+    }
+
+    BOOST_LEAF_CHECK(next->CopyTo(header));
+    auto dataSize = header.fileSize;
+    if (next->SparseSize()) {
+      BOOST_LEAF_AUTO(map, ReadSparseMap(tarFile, header.fileSize));
+      if (header.sparseSize > 0 && header.sparseSize < map.End())
+        return NewError(error::InvalidConversion{});
+      dataSize -= map.mapSize;
+    }
+    BOOST_LEAF_CHECK(tarFile.Skip(dataSize));
+    BOOST_LEAF_CHECK(
+        ReadZeros(tarFile, PaddedSize(header.fileSize) - header.fileSize));
+  }
+
+  BOOST_LEAF_AUTO(block, tarFile.ReadBlock());
+  if (block.empty() || !IsZero(block))
+    return NewError(error::InvalidConversion{});
+  while (true) {
+    BOOST_LEAF_AUTO(data, tarFile.ReadData(ZERO_CHECK_SIZE_B));
+    if (data.empty())
+      return Success();
+    if (!IsZero(data))
+      return NewError(error::InvalidConversion{});
+  }
+}
+
+Status VerifyArchive(ArchiveSource &tarFile, std::string const &fileName,
+                     std::uint32_t jobs) {
+  auto archiveSize = tarFile.Size();
+  if (tarFile.IsRandomAccess() && archiveSize)
+    return VerifyRandomAccess(tarFile, fileName, *archiveSize, jobs);
+  return VerifySequential(tarFile);
+}
+
+} // namespace cc::tar::detail
@@ -0,0 +1,500 @@
+#include "zstd.hpp"
+
+#include <algorithm>
+
+#include "detail.hpp"
+#include "error_code.hpp"
+
+namespace cc::tar::detail {
+
+// Frames are closed at the first member boundary past this size
+static constexpr std::size_t ZSTD_FRAME_SIZE_B = 1 << 20;
+
+// Members larger than this are split over several frames
+static constexpr std::size_t ZSTD_MAX_FRAME_SIZE_B = 4 << 20;
+static_assert(ZSTD_MAX_FRAME_SIZE_B % BLOCK_SIZE_B == 0);
+
+// Decompressed bytes buffered by a streaming source, a multiple of the block
+// size so headers are rarely moved to the front of the buffer
+static constexpr std::size_t ZSTD_CHUNK_SIZE_B = 1 << 20;
+static_assert(ZSTD_CHUNK_SIZE_B % BLOCK_SIZE_B == 0);
+
+// Layout of the seek table of the zstd seekable format, a skippable frame
+// with one entry per frame followed by a footer
+static constexpr std::uint32_t SKIPPABLE_FRAME_MAGIC = 0x184D2A5E;
+static constexpr std::uint32_t SEEKABLE_MAGIC = 0x8F92EAB1;
+static constexpr std::size_t SKIPPABLE_HEADER_SIZE_B = 8;
+static constexpr std::size_t SEEK_TABLE_FOOTER_SIZE_B = 9;
+static constexpr std::size_t SEEK_TABLE_ENTRY_SIZE_B = 8;
+static constexpr std::uint8_t SEEK_TABLE_CHECKSUM_FLAG = 0x80;
+static constexpr std::uint8_t SEEK_TABLE_RESERVED_BITS = 0x7C;
+
+static void AppendLittleEndian(std::vector<char> &output,
+                               std::uint32_t value) {
+  for (std::size_t i = 0; i < 4; i++)
+    output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+static std::uint32_t ReadLittleEndian(const char *input) {
+  std::uint32_t value = 0;
+  for (std::size_t i = 0; i < 4; i++)
+    value |= static_cast<std::uint32_t>(static_cast<unsigned char>(input[i]))
+             << (8 * i);
+  return value;
+}
+
+/**
+ * @brief Decompress a single frame, whose decompressed size is known from the
+ * seek table
+ */
+static bool DecompressFrame(std::span<const char> input, std::uint64_t size,
+                            std::vector<char> &output) {
+  output.resize(size);
+  auto result =
+      ZSTD_decompress(output.data(), output.size(), input.data(), input.size());
+  return !ZSTD_isError(result) && result == size;
+}
+
+ZstdSource::ZstdSource(std::string fileName,
+                       std::unique_ptr<ArchiveSource> compressed)
+    : mFileName(std::move(fileName)), mCompressed(std::move(compressed)),
+      mStream(ZSTD_createDStream()), mBuffer(ZSTD_CHUNK_SIZE_B) {}
+
+ZstdSource::~ZstdSource() { ZSTD_freeDStream(mStream); }
+
+Status ZstdSource::Fill(std::size_t minimum) {
+  if (mStream == nullptr)
+    return NewError(error::UnexpectedError{});
+
+  std::copy(mBuffer.begin() + static_cast<std::ptrdiff_t>(mPosition),
+            mBuffer.begin() + static_cast<std::ptrdiff_t>(mEnd),
+            mBuffer.begin());
+  mEnd -= mPosition;
+  mPosition = 0;
+
+  while (mEnd < minimum) {
+    if (mInput.empty()) {
+      BOOST_LEAF_ASSIGN(mInput, mCompressed->ReadData(ZSTD_DStreamInSize()));
+      if (mInput.empty()) {
+        if (!mFrameEnded)
+          return NewError(
+              error::InvalidStream{mFileName, error::StreamType::INPUT});
+        return Success();
+      }
+    }
+
+    ZSTD_inBuffer input{mInput.data(), mInput.size(), 0};
+    ZSTD_outBuffer output{mBuffer.data(), mBuffer.size(), mEnd};
+    auto result = ZSTD_decompressStream(mStream, &output, &input);
+    if (ZSTD_isError(result))
+      return NewError(error::InvalidConversion{});
+
+    // Concatenated frames are read as a single stream
+    mFrameEnded = result == 0;
+    mInput = mInput.subspan(input.pos);
+    mEnd = output.pos;
+  }
+  return Success();
+}
+
+Result<std::span<const char>> ZstdSource::ReadBlock() {
+  if (Available() < BLOCK_SIZE_B)
+    BOOST_LEAF_CHECK(Fill(BLOCK_SIZE_B));
+  if (Available() == 0)
+    return {std::span<const char>{}};
+  if (Available() < BLOCK_SIZE_B)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+
+  std::span<const char> block(mBuffer.data() + mPosition, BLOCK_SIZE_B);
+  mPosition += BLOCK_SIZE_B;
+  mOffset += BLOCK_SIZE_B;
+  return {block};
+}
+
+Result<std::span<const char>> ZstdSource::ReadData(std::uint64_t maxSize) {
+  if (Available() == 0)
+    BOOST_LEAF_CHECK(Fill(1));
+
+  auto size = static_cast<std::size_t>(
+      std::min<std::uint64_t>(maxSize, Available()));
+  std::span<const char> data(mBuffer.data() + mPosition, size);
+  mPosition += size;
+  mOffset += size;
+  return {data};
+}
+
+Status ZstdSource::Skip(std::uint64_t size) {
+  while (size > 0) {
+    BOOST_LEAF_AUTO(data, ReadData(size));
+    if (data.empty())
+      return NewError(
+          error::InvalidStream{mFileName, error::StreamType::INPUT});
+    size -= data.size();
+  }
+  return Success();
+}
+
+SeekableZstdSource::SeekableZstdSource(
+    std::string fileName, std::unique_ptr<ArchiveSource> compressed,
+    std::vector<ZstdFrame> frames)
+    : mFileName(std::move(fileName)), mCompressed(std::move(compressed)),
+      mFrames(std::move(frames)),
+      mSize(mFrames.empty() ? 0 : mFrames.back().offset + mFrames.back().size),
+      mMaxPendingFrames(
+          2 * static_cast<std::size_t>(
+                  std::max(std::thread::hardware_concurrency(), 1U))),
+      mPool(std::max(std::thread::hardware_concurrency(), 1U)) {}
+
+std::size_t SeekableZstdSource::FrameAt(std::uint64_t offset) const {
+  auto next = std::upper_bound(
+      mFrames.begin(), mFrames.end(), offset,
+      [](std::uint64_t value, ZstdFrame const &frame) {
+        return value < frame.offset;
+      });
+  return static_cast<std::size_t>(next - mFrames.begin()) - 1;
+}
+
+Status SeekableZstdSource::SubmitAhead() {
+  while (mPendingFrames.size() < mMaxPendingFrames &&
+         mNextFrame < mFrames.size()) {
+    auto const &frame = mFrames[mNextFrame];
+    BOOST_LEAF_AUTO(input, mCompressed->ReadAt(frame.compressedOffset,
+                                               frame.compressedSize));
+
+    auto decoded = std::make_shared<DecodedFrame>();
+    decoded->index = mNextFrame++;
+    mPendingFrames.push_back(decoded);
+    mPool.Submit([this, decoded, input, size = frame.size]() {
+      {
+        std::lock_guard lock(mMutex);
+        if (decoded->dropped)
+          return;
+      }
+      std::vector<char> data{};
+      auto decompressed = DecompressFrame(input, size, data);
+      {
+        std::lock_guard lock(mMutex);
+        decoded->data = std::move(data);
+        decoded->failed = !decompressed;
+        decoded->done = true;
+      }
+      mFrameDone.notify_all();
+    });
+  }
+  return Success();
+}
+
+void SeekableZstdSource::DropPendingBefore(std::size_t index) {
+  std::lock_guard lock(mMutex);
+  while (!mPendingFrames.empty() && mPendingFrames.front()->index < index) {
+    mPendingFrames.front()->dropped = true;
+    mPendingFrames.pop_front();
+  }
+
+  // The read-ahead restarts at index if it is not pending already
+  if (mPendingFrames.empty() || mPendingFrames.front()->index != index) {
+    for (auto &frame : mPendingFrames)
+      frame->dropped = true;
+    mPendingFrames.clear();
+    mNextFrame = index;
+  }
+}
+
+Result<bool> SeekableZstdSource::Load() {
+  if (mOffset >= mSize)
+    return {false};
+  auto index = FrameAt(mOffset);
+  if (mCurrent && mCurrent->index == index)
+    return {true};
+
+  DropPendingBefore(index);
+  BOOST_LEAF_CHECK(SubmitAhead());
+
+  auto frame = mPendingFrames.front();
+  {
+    std::unique_lock lock(mMutex);
+    mFrameDone.wait(lock, [&frame]() { return frame->done; });
+  }
+  mPendingFrames.pop_front();
+  if (frame->failed)
+    return NewError(error::InvalidConversion{});
+
+  mCurrent = std::move(frame);
+  BOOST_LEAF_CHECK(SubmitAhead());
+  return {true};
+}
+
+Result<std::span<const char>> SeekableZstdSource::ReadBlock() {
+  BOOST_LEAF_AUTO(available, Load());
+  if (!available)
+    return {std::span<const char>{}};
+
+  auto position = mOffset - mFrames[mCurrent->index].offset;
+  if (mCurrent->data.size() - position >= BLOCK_SIZE_B) {
+    mOffset += BLOCK_SIZE_B;
+    return {std::span<const char>(mCurrent->data.data() + position,
+                                  BLOCK_SIZE_B)};
+  }
+
+  // Blocks split between two frames are joined in a buffer
+  for (std::size_t filled = 0; filled < BLOCK_SIZE_B;) {
+    BOOST_LEAF_AUTO(data, ReadData(BLOCK_SIZE_B - filled));
+    if (data.empty())
+      return NewError(
+          error::InvalidStream{mFileName, error::StreamType::INPUT});
+    std::copy(data.begin(), data.end(), mBlock.begin() + filled);
+    filled += data.size();
+  }
+  return {std::span<const char>(mBlock)};
+}
+
+Result<std::span<const char>>
+SeekableZstdSource::ReadData(std::uint64_t maxSize) {
+  BOOST_LEAF_AUTO(available, Load());
+  if (!available)
+    return {std::span<const char>{}};
+
+  auto position = mOffset - mFrames[mCurrent->index].offset;
+  auto size = std::min<std::uint64_t>(maxSize,
+                                      mCurrent->data.size() - position);
+  mOffset += size;
+  return {std::span<const char>(mCurrent->data.data() + position, size)};
+}
+
+Status SeekableZstdSource::Skip(std::uint64_t size) {
+  if (size > mSize - std::min(mOffset, mSize))
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+  mOffset += size;
+  return Success();
+}
+
+SeekableZstdSource::FrameCache &SeekableZstdSource::ThreadCache() const {
+  std::lock_guard lock(mCacheMutex);
+  return mCaches[std::this_thread::get_id()];
+}
+
+Status SeekableZstdSource::Decode(std::size_t index, FrameCache &cache) const {
+  if (cache.index == index)
+    return Success();
+
+  auto const &frame = mFrames[index];
+  BOOST_LEAF_AUTO(input, mCompressed->ReadAt(frame.compressedOffset,
+                                             frame.compressedSize));
+  cache.index = SIZE_MAX;
+  if (!DecompressFrame(input, frame.size, cache.data))
+    return NewError(error::InvalidConversion{});
+  cache.index = index;
+  return Success();
+}
+
+Result<std::span<const char>>
+SeekableZstdSource::ReadAt(std::uint64_t offset, std::uint64_t size) const {
+  if (offset > mSize || size > mSize - offset)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+  if (size == 0)
+    return {std::span<const char>{}};
+
+  auto &cache = ThreadCache();
+  auto index = FrameAt(offset);
+  BOOST_LEAF_CHECK(Decode(index, cache));
+  auto position = offset - mFrames[index].offset;
+  if (cache.data.size() - position >= size)
+    return {std::span<const char>(cache.data.data() + position, size)};
+
+  cache.joined.clear();
+  while (cache.joined.size() < size) {
+    BOOST_LEAF_CHECK(Decode(index++, cache));
+    auto count = std::min<std::uint64_t>(size - cache.joined.size(),
+                                         cache.data.size() - position);
+    auto begin = cache.data.begin() + static_cast<std::ptrdiff_t>(position);
+    cache.joined.insert(cache.joined.end(), begin,
+                        begin + static_cast<std::ptrdiff_t>(count));
+    position = 0;
+  }
+  return {std::span<const char>(cache.joined)};
+}
+
+Status SeekableZstdSource::CopyAt(std::uint64_t offset, std::uint64_t size,
+                                  FileDescriptor const &output) const {
+  if (offset > mSize || size > mSize - offset)
+    return NewError(error::InvalidStream{mFileName, error::StreamType::INPUT});
+
+  // Large members are written a frame at a time
+  auto &cache = ThreadCache();
+  auto index = FrameAt(offset);
+  auto position = offset - mFrames[index].offset;
+  while (size > 0) {
+    BOOST_LEAF_CHECK(Decode(index++, cache));
+    auto count = std::min<std::uint64_t>(size, cache.data.size() - position);
+    BOOST_LEAF_CHECK(WriteMemberData(
+        output, std::span<const char>(cache.data.data() + position, count)));
+    size -= count;
+    position = 0;
+  }
+  return Success();
+}
+
+ZstdSink::ZstdSink(std::string fileName, std::unique_ptr<ArchiveSink> output,
+                   std::uint32_t jobs)
+    : mFileName(std::move(fileName)), mOutput(std::move(output)),
+      mMaxPendingFrames(2 * static_cast<std::size_t>(jobs)), mPool(jobs) {
+  mInput.reserve(ZSTD_MAX_FRAME_SIZE_B);
+}
+
+Status ZstdSink::Write(std::span<const char> data) {
+  while (!data.empty()) {
+    auto size = std::min(data.size(), ZSTD_MAX_FRAME_SIZE_B - mInput.size());
+    mInput.insert(mInput.end(), data.begin(), data.begin() + size);
+    data = data.subspan(size);
+    mOffset += size;
+
+    if (mInput.size() == ZSTD_MAX_FRAME_SIZE_B)
+      BOOST_LEAF_CHECK(SubmitFrame());
+  }
+  return Success();
+}
+
+Status ZstdSink::BeginMember() {
+  if (mInput.size() >= ZSTD_FRAME_SIZE_B)
+    return SubmitFrame();
+  return Success();
+}
+
+Status ZstdSink::Close() {
+  if (!mInput.empty())
+    BOOST_LEAF_CHECK(SubmitFrame());
+  while (!mPendingFrames.empty())
+    BOOST_LEAF_CHECK(WriteOldestFrame());
+  BOOST_LEAF_CHECK(WriteSeekTable());
+  return mOutput->Close();
+}
+
+Status ZstdSink::SubmitFrame() {
+  while (mPendingFrames.size() >= mMaxPendingFrames)
+    BOOST_LEAF_CHECK(WriteOldestFrame());
+
+  auto frame = std::make_shared<CompressedFrame>();
+  frame->size = mInput.size();
+  auto input = std::move(mInput);
+  mInput = {};
+  mInput.reserve(ZSTD_MAX_FRAME_SIZE_B);
+
+  mPendingFrames.push_back(frame);
+  mPool.Submit([this, frame, input = std::move(input)]() {
+    std::vector<char> data(ZSTD_compressBound(input.size()));
+    auto result = ZSTD_compress(data.data(), data.size(), input.data(),
+                                input.size(), ZSTD_CLEVEL_DEFAULT);
+    if (!ZSTD_isError(result))
+      data.resize(result);
+    {
+      std::lock_guard lock(mMutex);
+      frame->data = std::move(data);
+      frame->failed = ZSTD_isError(result);
+      frame->done = true;
+    }
+    mFrameDone.notify_all();
+  });
+  return Success();
+}
+
+Status ZstdSink::WriteOldestFrame() {
+  auto frame = mPendingFrames.front();
+  {
+    std::unique_lock lock(mMutex);
+    mFrameDone.wait(lock, [&frame]() { return frame->done; });
+  }
+  mPendingFrames.pop_front();
+
+  if (frame->failed)
+    return NewError(error::UnexpectedError{});
+  BOOST_LEAF_CHECK(mOutput->Write(frame->data));
+  mSeekTable.emplace_back(static_cast<std::uint32_t>(frame->data.size()),
+                          static_cast<std::uint32_t>(frame->size));
+  return Success();
+}
+
+Status ZstdSink::WriteSeekTable() {
+  auto tableSize = mSeekTable.size() * SEEK_TABLE_ENTRY_SIZE_B +
+                   SEEK_TABLE_FOOTER_SIZE_B;
+  std::vector<char> table{};
+  table.reserve(SKIPPABLE_HEADER_SIZE_B + tableSize);
+  AppendLittleEndian(table, SKIPPABLE_FRAME_MAGIC);
+  AppendLittleEndian(table, static_cast<std::uint32_t>(tableSize));
+  for (auto [compressedSize, size] : mSeekTable) {
+    AppendLittleEndian(table, compressedSize);
+    AppendLittleEndian(table, size);
+  }
+
+  // Footer with the number of frames and a descriptor without checksums
+  AppendLittleEndian(table, static_cast<std::uint32_t>(mSeekTable.size()));
+  table.push_back(0);
+  AppendLittleEndian(table, SEEKABLE_MAGIC);
+  return mOutput->Write(table);
+}
+
+/**
+ * @brief Read the seek table at the end of a zstd archive
+ * @returns the frames, or std::nullopt if there is no valid seek table that
+ * covers the whole archive
+ */
+static Result<std::optional<std::vector<ZstdFrame>>>
+ReadSeekTable(ArchiveSource const &compressed, std::uint64_t size) {
+  if (size < SKIPPABLE_HEADER_SIZE_B + SEEK_TABLE_FOOTER_SIZE_B)
+    return {std::nullopt};
+  BOOST_LEAF_AUTO(footer, compressed.ReadAt(size - SEEK_TABLE_FOOTER_SIZE_B,
+                                            SEEK_TABLE_FOOTER_SIZE_B));
+  auto frameCount = ReadLittleEndian(footer.data());
+  auto descriptor = static_cast<std::uint8_t>(footer[4]);
+  if (ReadLittleEndian(footer.data() + 5) != SEEKABLE_MAGIC ||
+      (descriptor & SEEK_TABLE_RESERVED_BITS) != 0)
+    return {std::nullopt};
+
+  auto entrySize = SEEK_TABLE_ENTRY_SIZE_B +
+                   ((descriptor & SEEK_TABLE_CHECKSUM_FLAG) ? 4 : 0);
+  auto tableSize =
+      std::uint64_t{frameCount} * entrySize + SEEK_TABLE_FOOTER_SIZE_B;
+  if (size < SKIPPABLE_HEADER_SIZE_B + tableSize)
+    return {std::nullopt};
+  auto tableOffset = size - tableSize - SKIPPABLE_HEADER_SIZE_B;
+  BOOST_LEAF_AUTO(table, compressed.ReadAt(tableOffset,
+                                           SKIPPABLE_HEADER_SIZE_B +
+                                               tableSize));
+  if (ReadLittleEndian(table.data()) != SKIPPABLE_FRAME_MAGIC ||
+      ReadLittleEndian(table.data() + 4) != tableSize)
+    return {std::nullopt};
+
+  // Empty frames are left out, so every offset maps to a single frame
+  std::vector<ZstdFrame> frames{};
+  frames.reserve(frameCount);
+  std::uint64_t compressedOffset = 0;
+  std::uint64_t offset = 0;
+  for (std::uint32_t i = 0; i < frameCount; i++) {
+    auto entry = table.data() + SKIPPABLE_HEADER_SIZE_B + i * entrySize;
+    ZstdFrame frame{.compressedOffset = compressedOffset,
+                    .compressedSize = ReadLittleEndian(entry),
+                    .offset = offset,
+                    .size = ReadLittleEndian(entry + 4)};
+    compressedOffset += frame.compressedSize;
+    offset += frame.size;
+    if (frame.size > 0)
+      frames.push_back(frame);
+  }
+  if (compressedOffset != tableOffset)
+    return {std::nullopt};
+  return {std::move(frames)};
+}
+
+Result<std::unique_ptr<ArchiveSource>>
+OpenZstdSource(std::string const &fileName,
+               std::unique_ptr<ArchiveSource> compressed) {
+  auto size = compressed->Size();
+  if (compressed->IsRandomAccess() && size) {
+    BOOST_LEAF_AUTO(frames, ReadSeekTable(*compressed, *size));
+    if (frames)
+      return {std::make_unique<SeekableZstdSource>(
+          fileName, std::move(compressed), std::move(*frames))};
+  }
+  return {std::make_unique<ZstdSource>(fileName, std::move(compressed))};
+}
+
+} // namespace cc::tar::detail
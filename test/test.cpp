@@ -1,9 +1,42 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <catch2/catch_test_macros.hpp>
 #include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
 
+#include "archive_index.hpp"
+#include "archive_reader.hpp"
+#include "archive_sink.hpp"
+#include "archive_source.hpp"
+#include "checksum.hpp"
 #include "common.hpp"
 #include "detail.hpp"
+#include "error_slot.hpp"
+#include "file_handler.hpp"
+#include "header_table.hpp"
+#include "instrumentation.hpp"
+#include "io_backend.hpp"
+#include "member_reader.hpp"
+#include "member_filter.hpp"
+#include "pipe.hpp"
+#include "posix_file.hpp"
+#include "snapshot.hpp"
+#include "sparse.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "tree_walker.hpp"
+#include "uring_backend.hpp"
+#include "verify.hpp"
+#include "zstd.hpp"
 #include "svgys/program_options.hpp"
 
 TEST_CASE("Program option parser", "[option-parser]") {
@@ -89,6 +122,17 @@ TEST_CASE("Field (de)serialisation", "[field-serialisation]") {
     REQUIRE(readResult.value().compare(fileName) == 0);
   }
 
+  SECTION("String_t read of field without null terminator") {
+    std::string fileName(common::FILE_NAME::size, 'a');
+    std::copy(fileName.begin(), fileName.end(), buffer.begin());
+    buffer[common::FILE_NAME::size] = 'b';
+
+    auto readResult = helpers::Read<common::FILE_NAME>(buffer);
+    REQUIRE(readResult);
+
+    REQUIRE(readResult.value().compare(fileName) == 0);
+  }
+
   SECTION("Octal_t read & write") {
     std::uint64_t fileSize = 4096;
 
@@ -166,6 +210,176 @@ TEST_CASE("Tar header (de)serialisation", "[header-serialisation]") {
     REQUIRE(newHeader.linkedFileName.compare(LINKED_FILE_NAME) == 0);
   }
 
+  SECTION("Header view decodes fields in place") {
+    std::array<char, 512> buffer{0x00};
+    REQUIRE(detail::SerialiseHeader(header, buffer));
+
+    auto view = detail::HeaderView::Open(buffer);
+    REQUIRE(view);
+    REQUIRE(view.value().FileName() == FILE_NAME);
+    REQUIRE(view.value().FileName().data() == buffer.data());
+    REQUIRE(view.value().FileSize().value() == FILE_SIZE);
+    REQUIRE(view.value().FileMode().value() == FILE_MODE);
+    REQUIRE(view.value().Get<common::USER_ID>().value() == USER_ID);
+    REQUIRE(view.value().LinkIndicator() == LINK_ID);
+    REQUIRE(view.value().LinkedFileName() == LINKED_FILE_NAME);
+
+    // Names filling the whole field are not null-terminated
+    std::fill_n(buffer.begin(), common::FILE_NAME::size, 'n');
+    auto checkSum = detail::CalculateChecksum(buffer);
+    std::fill_n(buffer.begin() + common::CHECKSUM::offset,
+                common::CHECKSUM::size, '\0');
+    REQUIRE(helpers::Write<common::CHECKSUM>(checkSum, buffer));
+    auto longView = detail::HeaderView::Open(buffer);
+    REQUIRE(longView);
+    REQUIRE(longView.value().FileName() ==
+            std::string(common::FILE_NAME::size, 'n'));
+  }
+
+  SECTION("Sizes beyond eleven octal digits are stored in base-256") {
+    std::array<char, 512> buffer{0x00};
+    std::uint64_t size = std::uint64_t{5} << 40;
+    REQUIRE(helpers::Write<common::FILE_SIZE>(size, buffer));
+    REQUIRE(static_cast<unsigned char>(buffer[common::FILE_SIZE::offset]) ==
+            0x80);
+    REQUIRE(helpers::Read<common::FILE_SIZE>(buffer).value() == size);
+
+    // Eleven digits still use octal, with room for the terminator
+    REQUIRE(helpers::Write<common::FILE_SIZE>(07777777777, buffer));
+    REQUIRE(buffer[common::FILE_SIZE::offset] == '7');
+    REQUIRE(helpers::Read<common::FILE_SIZE>(buffer).value() == 07777777777);
+
+    // Eight byte fields hold 56 bit values
+    REQUIRE(!helpers::Write<common::FILE_MODE>(std::uint64_t{1} << 60, buffer));
+
+    auto bigHeader = header;
+    bigHeader.fileSize = size;
+    std::vector<char> blocks(detail::SerialisedSize(bigHeader));
+    REQUIRE(blocks.size() > 512);
+    REQUIRE(detail::SerialiseHeader(bigHeader, blocks));
+    REQUIRE(detail::ParseHeader(blocks).value().fileSize == size);
+
+    // Readers skipping the PAX header still get the size from the field
+    auto last = std::span<const char>(blocks).last(512);
+    REQUIRE(detail::ParseHeader(last).value().fileSize == size);
+  }
+
+  SECTION("Long names are carried by a PAX extended header") {
+    auto longHeader = header;
+    longHeader.fileName = std::string(150, 'd') + "/" + std::string(120, 'f');
+    longHeader.linkedFileName = std::string(200, 'l');
+    std::vector<char> blocks(detail::SerialisedSize(longHeader));
+    REQUIRE(blocks.size() == 3 * 512);
+    REQUIRE(detail::SerialiseHeader(longHeader, blocks));
+
+    auto parsed = detail::ParseHeader(blocks);
+    REQUIRE(parsed);
+    REQUIRE(parsed.value().fileName == longHeader.fileName);
+    REQUIRE(parsed.value().linkedFileName == longHeader.linkedFileName);
+    REQUIRE(parsed.value().fileSize == FILE_SIZE);
+
+    // The member's own header holds the names cut to the fields
+    auto last = std::span<const char>(blocks).last(512);
+    REQUIRE(detail::ParseHeader(last).value().fileName ==
+            longHeader.fileName.substr(0, common::FILE_NAME::size - 1));
+
+    std::array<char, 512> small{0x00};
+    REQUIRE(!detail::SerialiseHeader(longHeader, small));
+  }
+
+  SECTION("Extension headers are applied when reading archive sources") {
+    // A GNU long name header followed by the member and the end of archive
+    auto longName = std::string(180, 'g');
+    common::ObjectHeader longLink{
+        .fileName = "././@LongLink",
+        .fileSize = longName.size() + 1,
+        .fileMode = 0644,
+        .userID = 0,
+        .groupID = 0,
+        .linkIndicator = common::LinkIndicator::GNU_LONG_NAME,
+        .linkedFileName = {}};
+    std::string contents(5 * 512, '\0');
+    REQUIRE(detail::SerialiseHeader(
+        longLink, std::span<char>(contents.data(), 512)));
+    std::copy(longName.begin(), longName.end(), contents.begin() + 512);
+    REQUIRE(detail::SerialiseHeader(
+        header, std::span<char>(contents.data() + 1024, 512)));
+
+    REQUIRE(detail::ParseHeader(std::span<const char>(contents))
+                .value()
+                .fileName == longName);
+
+    detail::StreamSource source(
+        "stream", std::make_unique<std::istringstream>(contents), 1024);
+    detail::ExtendedHeader extended{};
+    auto next = detail::ReadHeader(source, extended);
+    REQUIRE(next);
+    REQUIRE(next.value());
+    REQUIRE(next.value()->FileName() == longName);
+    REQUIRE(next.value()->FileSize().value() == FILE_SIZE);
+    REQUIRE(source.Offset() == 3 * 512);
+  }
+
+  SECTION("Modification times") {
+    auto timedHeader = header;
+    timedHeader.lastModified = 1700000000;
+    std::array<char, 512> buffer{0x00};
+    REQUIRE(detail::SerialiseHeader(timedHeader, buffer));
+    REQUIRE(detail::ParseHeader(buffer).value().lastModified == 1700000000);
+
+    // Archives that left the field empty read as zero
+    std::fill_n(buffer.begin() + common::LAST_MODIFIED::offset,
+                common::LAST_MODIFIED::size, '\0');
+    std::fill_n(buffer.begin() + common::CHECKSUM::offset,
+                common::CHECKSUM::size, '\0');
+    REQUIRE(helpers::Write<common::CHECKSUM>(detail::CalculateChecksum(buffer),
+                                             buffer));
+    REQUIRE(detail::ParseHeader(buffer).value().lastModified == 0);
+
+    // PAX mtime records keep their whole seconds
+    detail::ExtendedHeader extended{};
+    REQUIRE(detail::ApplyExtension(common::LinkIndicator::PAX_HEADER,
+                                   "30 mtime=1700000001.123456789\n",
+                                   extended));
+    REQUIRE(extended.lastModified == 1700000001);
+    REQUIRE(!detail::ApplyExtension(common::LinkIndicator::PAX_HEADER,
+                                    "16 mtime=17x0\n", extended));
+
+    // Times past eleven octal digits are written as PAX mtime records too
+    timedHeader.lastModified = std::uint64_t{1} << 34;
+    std::vector<char> blocks(detail::SerialisedSize(timedHeader));
+    REQUIRE(blocks.size() == 3 * 512);
+    REQUIRE(detail::SerialiseHeader(timedHeader, blocks));
+    std::string_view records(blocks.data() + 512, 512);
+    REQUIRE(records.find("mtime=17179869184\n") != std::string_view::npos);
+    REQUIRE(detail::ParseHeader(blocks).value().lastModified ==
+            timedHeader.lastModified);
+  }
+
+  SECTION("Headers carry the ustar magic and the standard checksum") {
+    std::array<char, 512> buffer{0x00};
+    REQUIRE(detail::SerialiseHeader(header, buffer));
+    REQUIRE(std::string_view(buffer.data() + 257, 8) ==
+            std::string_view("ustar\0" "00", 8));
+
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < buffer.size(); i++) {
+      auto inField = i >= common::CHECKSUM::offset &&
+                     i < common::CHECKSUM::offset + common::CHECKSUM::size;
+      sum += inField ? ' ' : static_cast<std::uint8_t>(buffer[i]);
+    }
+    REQUIRE(helpers::Read<common::CHECKSUM>(buffer).value() == sum);
+    REQUIRE(buffer[common::CHECKSUM::offset + 6] == '\0');
+    REQUIRE(buffer[common::CHECKSUM::offset + 7] == ' ');
+  }
+
+  SECTION("Member data is padded to the next block boundary") {
+    REQUIRE(detail::PaddedSize(0) == 0);
+    REQUIRE(detail::PaddedSize(1) == 512);
+    REQUIRE(detail::PaddedSize(512) == 512);
+    REQUIRE(detail::PaddedSize(513) == 1024);
+  }
+
   SECTION("Invalid checksum upon deserialisation of header") {
     std::array<char, 512> buffer{0x00};
     auto result = detail::SerialiseHeader(header, buffer);
@@ -179,3 +393,1692 @@ TEST_CASE("Tar header (de)serialisation", "[header-serialisation]") {
     REQUIRE(!parseResult);
   }
 }
+
+TEST_CASE("Worker thread error propagation", "[thread-pool]") {
+  using namespace cc::tar;
+
+  SECTION("All tasks succeed") {
+    detail::ErrorSlot errors{};
+    std::atomic<int> count{0};
+    {
+      detail::ThreadPool pool(4);
+      for (int i = 0; i < 64; i++)
+        pool.Submit([&]() {
+          errors.Run([&]() -> svgys::error::Status {
+            count++;
+            return svgys::error::Success();
+          });
+        });
+      pool.Wait();
+    }
+
+    REQUIRE(count.load() == 64);
+    REQUIRE(!errors.Failed());
+    REQUIRE(errors.Rethrow());
+  }
+
+  SECTION("First error is raised on the waiting thread") {
+    detail::ErrorSlot errors{};
+    detail::ThreadPool pool(4);
+    for (int i = 0; i < 8; i++)
+      pool.Submit([&]() {
+        errors.Run([&]() -> svgys::error::Status {
+          return svgys::error::NewError(error::InvalidChecksum{});
+        });
+      });
+    pool.Wait();
+
+    REQUIRE(errors.Failed());
+    auto code = boost::leaf::try_handle_all(
+        [&]() -> svgys::error::Result<int> {
+          BOOST_LEAF_CHECK(errors.Rethrow());
+          return 0;
+        },
+        [](error::InvalidChecksum) { return error::InvalidChecksum::CODE; },
+        []() { return error::UnexpectedError::CODE; });
+    REQUIRE(code == error::InvalidChecksum::CODE);
+  }
+}
+
+TEST_CASE("Sidecar archive index", "[archive-index]") {
+  using namespace cc::tar;
+
+  detail::ArchiveIndex index{};
+  index.Add({.fileName = "b.txt", .fileSize = 10, .fileMode = 0644}, 0);
+  index.Add({.fileName = "a.txt", .fileSize = 20, .fileMode = 0600}, 1024);
+  index.Add({.fileName = "b.txt", .fileSize = 30, .fileMode = 0644}, 2048);
+  index.Sort();
+
+  SECTION("Lookup by name") {
+    auto entry = index.Find("a.txt");
+    REQUIRE(entry);
+    REQUIRE(entry->headerOffset == 1024);
+    REQUIRE(entry->fileSize == 20);
+    REQUIRE(entry->fileMode == 0600);
+
+    REQUIRE(!index.Find("c.txt"));
+    REQUIRE(!index.Find("a.tx"));
+  }
+
+  SECTION("Duplicate names resolve to the last member") {
+    auto entry = index.Find("b.txt");
+    REQUIRE(entry);
+    REQUIRE(entry->headerOffset == 2048);
+  }
+
+  SECTION("Entries in archive order") {
+    auto entries = index.Entries();
+    REQUIRE(entries.size() == 3);
+    REQUIRE(entries[0].headerOffset == 0);
+    REQUIRE(entries[1].fileName == "a.txt");
+    REQUIRE(entries[2].headerOffset == 2048);
+  }
+
+  SECTION("Save and load with staleness detection") {
+    auto indexPath =
+        (std::filesystem::temp_directory_path() / "cc-tar-test.idx").string();
+    detail::ArchiveStamp stamp{.size = 4096,
+                               .modifiedSeconds = 100,
+                               .modifiedNanoseconds = 5};
+    REQUIRE(index.Save(indexPath, stamp));
+
+    auto loaded = detail::ArchiveIndex::Load(indexPath, stamp);
+    REQUIRE(loaded);
+    REQUIRE(loaded->Size() == 3);
+    REQUIRE(loaded->Find("a.txt")->headerOffset == 1024);
+
+    auto staleStamp = stamp;
+    staleStamp.modifiedNanoseconds++;
+    REQUIRE(!detail::ArchiveIndex::Load(indexPath, staleStamp));
+
+    std::filesystem::remove(indexPath);
+  }
+
+  SECTION("Damaged indexes are not loaded") {
+    auto indexPath =
+        (std::filesystem::temp_directory_path() / "cc-tar-test.idx").string();
+    detail::ArchiveStamp stamp{.size = 4096};
+    REQUIRE(index.Save(indexPath, stamp));
+    auto size = std::filesystem::file_size(indexPath);
+    std::filesystem::resize_file(indexPath, size - 1);
+    REQUIRE(!detail::ArchiveIndex::Load(indexPath, stamp));
+
+    // Names size following the magic, version, stamp and record count
+    REQUIRE(index.Save(indexPath, stamp));
+    std::fstream indexFile(indexPath,
+                           std::ios::binary | std::ios::in | std::ios::out);
+    std::uint64_t namesSize = std::uint64_t{1} << 60;
+    indexFile.seekp(48);
+    indexFile.write(reinterpret_cast<const char *>(&namesSize),
+                    sizeof(namesSize));
+    indexFile.close();
+    REQUIRE(!detail::ArchiveIndex::Load(indexPath, stamp));
+
+    std::filesystem::remove(indexPath);
+  }
+}
+
+TEST_CASE("Incremental snapshot", "[snapshot]") {
+  using namespace cc::tar;
+
+  auto snapshotPath =
+      (std::filesystem::temp_directory_path() / "cc-tar-test.snap").string();
+  std::filesystem::remove(snapshotPath);
+
+  detail::SnapshotEntry entry{.device = 1,
+                              .inode = 2,
+                              .size = 3,
+                              .modifiedSeconds = 4,
+                              .modifiedNanoseconds = 5};
+  detail::Snapshot snapshot{};
+  snapshot.Add("dir", entry);
+  snapshot.Add("dir/a.txt", entry);
+  snapshot.Add("dir/b.txt", entry);
+
+  SECTION("Missing snapshots are empty") {
+    auto loaded = detail::Snapshot::Load(snapshotPath);
+    REQUIRE(loaded);
+    REQUIRE(loaded.value().Size() == 0);
+  }
+
+  SECTION("Save and load") {
+    REQUIRE(snapshot.Save(snapshotPath));
+
+    auto loaded = detail::Snapshot::Load(snapshotPath);
+    REQUIRE(loaded);
+    REQUIRE(loaded.value().Size() == 3);
+    REQUIRE(loaded.value().Find("dir/a.txt") == entry);
+    REQUIRE(!loaded.value().Find("dir/c.txt"));
+  }
+
+  SECTION("Damaged snapshots are rejected") {
+    std::ofstream(snapshotPath) << "not a snapshot";
+    REQUIRE(!detail::Snapshot::Load(snapshotPath));
+  }
+
+  SECTION("Snapshots with sizes past their end are rejected") {
+    REQUIRE(snapshot.Save(snapshotPath));
+    auto size = std::filesystem::file_size(snapshotPath);
+    std::filesystem::resize_file(snapshotPath, size - 1);
+    REQUIRE(!detail::Snapshot::Load(snapshotPath));
+
+    // Record count following the magic and version
+    REQUIRE(snapshot.Save(snapshotPath));
+    std::fstream snapshotFile(snapshotPath, std::ios::binary | std::ios::in |
+                                                std::ios::out);
+    std::uint64_t recordCount = std::uint64_t{1} << 60;
+    snapshotFile.seekp(16);
+    snapshotFile.write(reinterpret_cast<const char *>(&recordCount),
+                       sizeof(recordCount));
+    snapshotFile.close();
+    REQUIRE(!detail::Snapshot::Load(snapshotPath));
+  }
+
+  SECTION("Removed paths are ordered by name") {
+    detail::Snapshot later{};
+    later.Add("dir", entry);
+    auto removed = snapshot.RemovedFrom(later);
+    REQUIRE(removed == std::vector<std::string>{"dir/a.txt", "dir/b.txt"});
+
+    // Paths whose type changed are replaced
+    auto file = entry;
+    file.fileType = S_IFREG;
+    later.Add("dir/a.txt", file);
+    later.Add("dir/b.txt", entry);
+    REQUIRE(snapshot.RemovedFrom(later) ==
+            std::vector<std::string>{"dir/a.txt"});
+  }
+
+  SECTION("Entries are taken from the file status") {
+    struct stat info {};
+    REQUIRE(stat(std::filesystem::temp_directory_path().c_str(), &info) == 0);
+    auto state = detail::SnapshotEntry::Of(info);
+    REQUIRE(state.inode == info.st_ino);
+    REQUIRE(state.fileType == S_IFDIR);
+    REQUIRE(state.modifiedNanoseconds ==
+            static_cast<std::uint64_t>(info.st_mtim.tv_nsec));
+  }
+
+  std::filesystem::remove(snapshotPath);
+}
+
+TEST_CASE("Member selection", "[member-filter]") {
+  using namespace cc::tar;
+
+  SECTION("No patterns select every member") {
+    detail::MemberFilter filter({});
+    REQUIRE(filter.Matches("a.txt"));
+    REQUIRE(filter.Unmatched().empty());
+  }
+
+  SECTION("Literal names keep matching once found") {
+    detail::MemberFilter filter({"a.txt", "dir/b.txt", "a.txt"});
+    REQUIRE(!filter.Matches("c.txt"));
+    REQUIRE(filter.Matches("a.txt"));
+    REQUIRE(filter.Unmatched().size() == 1);
+    REQUIRE(filter.Matches("dir/b.txt"));
+    REQUIRE(filter.Unmatched().empty());
+    // A later member with the same name replaces the earlier one
+    REQUIRE(filter.Matches("a.txt"));
+  }
+
+  SECTION("Glob patterns match by fnmatch") {
+    detail::MemberFilter filter({"dir/*.log", "a.txt"});
+    REQUIRE(filter.HasGlobs());
+    REQUIRE(filter.Matches("dir/sub/x.log"));
+    REQUIRE(!filter.Matches("dir/x.txt"));
+    REQUIRE(filter.Matches("a.txt"));
+    REQUIRE(filter.Unmatched().empty());
+  }
+}
+
+TEST_CASE("Compressed archive streams", "[compression]") {
+  using namespace cc::tar;
+
+  // Several compression blocks of loosely compressible data
+  std::vector<char> contents(3 << 20);
+  for (std::size_t i = 0; i < contents.size(); i++)
+    contents[i] = static_cast<char>((i * 7919) % 251 + (i >> 12));
+
+  auto filePath =
+      (std::filesystem::temp_directory_path() / "cc-tar-test.tar.gz").string();
+
+  SECTION("Parallel gzip compression round trip") {
+    {
+      auto sink = detail::OpenArchiveSink(filePath, 4);
+      REQUIRE(sink);
+      REQUIRE(sink.value()->Write(contents));
+      REQUIRE(sink.value()->Offset() == contents.size());
+      REQUIRE(sink.value()->Close());
+    }
+    REQUIRE(std::filesystem::file_size(filePath) < contents.size());
+
+    auto source = detail::OpenArchiveSource(filePath);
+    REQUIRE(source);
+    REQUIRE(!source.value()->IsRandomAccess());
+
+    std::vector<char> decompressed{};
+    while (true) {
+      auto data = source.value()->ReadData(contents.size());
+      REQUIRE(data);
+      if (data.value().empty())
+        break;
+      decompressed.insert(decompressed.end(), data.value().begin(),
+                          data.value().end());
+    }
+    REQUIRE(decompressed == contents);
+  }
+
+  std::filesystem::remove(filePath);
+
+  auto zstdPath =
+      (std::filesystem::temp_directory_path() / "cc-tar-test.tar.zst").string();
+
+  SECTION("Seekable zstd frames are read at any offset") {
+    {
+      auto sink = detail::OpenArchiveSink(zstdPath, 4);
+      REQUIRE(sink);
+      // Member boundaries every 64 KiB, frames are closed at the first one
+      // past their target size
+      for (std::size_t offset = 0; offset < contents.size();
+           offset += 64 << 10) {
+        REQUIRE(sink.value()->BeginMember());
+        REQUIRE(sink.value()->Write(
+            std::span<const char>(contents).subspan(offset, 64 << 10)));
+      }
+      REQUIRE(sink.value()->Close());
+    }
+
+    auto source = detail::OpenArchiveSource(zstdPath);
+    REQUIRE(source);
+    REQUIRE(source.value()->IsRandomAccess());
+
+    // Ranges within a frame and across frame boundaries
+    for (std::uint64_t offset : {std::uint64_t{0}, std::uint64_t{1000},
+                                 std::uint64_t{(1 << 20) - 100},
+                                 std::uint64_t{contents.size() - 512}}) {
+      auto data = source.value()->ReadAt(offset, 512);
+      REQUIRE(data);
+      REQUIRE(std::equal(data.value().begin(), data.value().end(),
+                         contents.begin() + offset));
+    }
+    REQUIRE(!source.value()->ReadAt(contents.size() - 10, 20));
+
+    // Skipped frames are not needed to continue reading
+    REQUIRE(source.value()->Skip(2 << 20));
+    std::vector<char> tail{};
+    while (true) {
+      auto data = source.value()->ReadData(contents.size());
+      REQUIRE(data);
+      if (data.value().empty())
+        break;
+      tail.insert(tail.end(), data.value().begin(), data.value().end());
+    }
+    REQUIRE(std::equal(tail.begin(), tail.end(), contents.begin() + (2 << 20),
+                       contents.end()));
+    REQUIRE(source.value()->Offset() == contents.size());
+  }
+
+  SECTION("Zstd streams without a seek table are read sequentially") {
+    std::vector<char> compressed(ZSTD_compressBound(contents.size()));
+    auto size = ZSTD_compress(compressed.data(), compressed.size(),
+                              contents.data(), contents.size(), 1);
+    REQUIRE(!ZSTD_isError(size));
+    std::ofstream(zstdPath, std::ios::binary)
+        .write(compressed.data(), static_cast<std::streamsize>(size));
+
+    auto source = detail::OpenArchiveSource(zstdPath);
+    REQUIRE(source);
+    REQUIRE(!source.value()->IsRandomAccess());
+
+    auto block = source.value()->ReadBlock();
+    REQUIRE(block);
+    REQUIRE(std::equal(block.value().begin(), block.value().end(),
+                       contents.begin()));
+    REQUIRE(source.value()->Skip(contents.size() - 1024));
+    auto last = source.value()->ReadData(1024);
+    REQUIRE(last);
+    REQUIRE(std::equal(last.value().begin(), last.value().end(),
+                       contents.end() - 512));
+    REQUIRE(source.value()->ReadData(1).value().empty());
+  }
+
+  std::filesystem::remove(zstdPath);
+}
+
+TEST_CASE("Kernel side file copies", "[file-copy]") {
+  using namespace cc::tar;
+
+  auto directory = std::filesystem::temp_directory_path();
+  auto inputPath = (directory / "cc-tar-test-input.bin").string();
+  auto archivePath = (directory / "cc-tar-test-copy.tar").string();
+
+  std::vector<char> contents(detail::KERNEL_COPY_THRESHOLD_B * 3 + 100);
+  for (std::size_t i = 0; i < contents.size(); i++)
+    contents[i] = static_cast<char>(i % 253);
+  {
+    auto input =
+        detail::FileDescriptor::Open(inputPath, O_WRONLY | O_CREAT | O_TRUNC);
+    REQUIRE(input);
+    REQUIRE(detail::WriteAll(input.value(), contents));
+    REQUIRE(input.value().Close());
+  }
+
+  SECTION("Archive sink copies input files after buffered data") {
+    auto input = detail::FileDescriptor::Open(inputPath, O_RDONLY);
+    REQUIRE(input);
+    {
+      auto sink = detail::OpenArchiveSink(archivePath, 1);
+      REQUIRE(sink);
+      REQUIRE(sink.value()->CopiesInKernel());
+      REQUIRE(sink.value()->Write(std::string_view("head")));
+      auto copied = sink.value()->CopyFrom(input.value(), 0, contents.size());
+      REQUIRE(copied);
+      REQUIRE(copied.value() == contents.size());
+
+      // Input files that shrank report the bytes actually copied
+      auto shortCopy =
+          sink.value()->CopyFrom(input.value(), 0, contents.size() + 7);
+      REQUIRE(shortCopy);
+      REQUIRE(shortCopy.value() == contents.size());
+      REQUIRE(sink.value()->Offset() == 4 + 2 * contents.size());
+      REQUIRE(sink.value()->Close());
+    }
+    REQUIRE(std::filesystem::file_size(archivePath) == 4 + 2 * contents.size());
+
+    auto source = detail::OpenArchiveSource(archivePath);
+    REQUIRE(source);
+    auto copy = source.value()->ReadAt(4 + contents.size(), contents.size());
+    REQUIRE(copy);
+    REQUIRE(std::equal(contents.begin(), contents.end(), copy.value().begin()));
+  }
+
+  SECTION("Sinks writing to pipes copy through whole records") {
+    auto input = detail::FileDescriptor::Open(inputPath, O_RDONLY);
+    REQUIRE(input);
+    std::array<int, 2> fds{};
+    REQUIRE(pipe(fds.data()) == 0);
+    detail::FileDescriptor readEnd(fds[0], "pipe", error::StreamType::INPUT);
+
+    std::string received{};
+    std::thread reader([&]() {
+      std::array<char, 4096> buffer{};
+      ssize_t count = 0;
+      while ((count = read(readEnd.Get(), buffer.data(), buffer.size())) > 0)
+        received.append(buffer.data(), static_cast<std::size_t>(count));
+    });
+    {
+      detail::FileSink sink(
+          detail::FileDescriptor(fds[1], "pipe", error::StreamType::OUTPUT),
+          1024);
+      REQUIRE(!sink.CopiesInKernel());
+      REQUIRE(sink.Write(std::string_view("head")));
+      auto copied = sink.CopyFrom(input.value(), 0, contents.size());
+      REQUIRE(copied);
+      REQUIRE(copied.value() == contents.size());
+      REQUIRE(sink.Close());
+    }
+    reader.join();
+
+    REQUIRE(received.size() == 4 + contents.size());
+    REQUIRE(received.substr(0, 4) == "head");
+    REQUIRE(std::equal(contents.begin(), contents.end(), received.begin() + 4));
+  }
+
+  SECTION("Appending sinks overwrite the end of an archive in place") {
+    {
+      auto sink = detail::OpenArchiveSink(archivePath, 1);
+      REQUIRE(sink);
+      REQUIRE(sink.value()->Write(std::string(2048, 'a')));
+      REQUIRE(sink.value()->Write(std::string(4096, '\0')));
+      REQUIRE(sink.value()->Close());
+    }
+    {
+      auto sink = detail::OpenArchiveSinkAt(archivePath, 2048, 512);
+      REQUIRE(sink);
+      REQUIRE(sink.value()->Offset() == 2048);
+      REQUIRE(sink.value()->Write(std::string(1024, 'b')));
+      REQUIRE(sink.value()->Close());
+    }
+
+    // The longer end marker is cut off after the new data
+    REQUIRE(std::filesystem::file_size(archivePath) == 3072);
+    auto source = detail::OpenArchiveSource(archivePath);
+    REQUIRE(source);
+    auto data = source.value()->ReadAt(2047, 2);
+    REQUIRE(data);
+    REQUIRE(std::string_view(data.value().data(), 2) == "ab");
+
+    REQUIRE(!detail::OpenArchiveSinkAt(archivePath + ".gz", 0, 512));
+  }
+
+  SECTION("Memory mapped source copies member data out") {
+    auto source = detail::OpenArchiveSource(inputPath);
+    REQUIRE(source);
+    REQUIRE(source.value()->Skip(100));
+    {
+      auto output = detail::FileDescriptor::Open(
+          archivePath, O_WRONLY | O_CREAT | O_TRUNC);
+      REQUIRE(output);
+      auto copied = source.value()->CopyData(output.value(), contents.size());
+      REQUIRE(copied);
+      REQUIRE(copied.value() == contents.size() - 100);
+      REQUIRE(source.value()->CopyAt(0, 100, output.value()));
+      REQUIRE(output.value().Close());
+    }
+
+    auto output = detail::OpenArchiveSource(archivePath);
+    REQUIRE(output);
+    auto data = output.value()->ReadAt(0, contents.size());
+    REQUIRE(data);
+    REQUIRE(std::equal(contents.begin() + 100, contents.end(),
+                       data.value().begin()));
+    REQUIRE(std::equal(contents.begin(), contents.begin() + 100,
+                       data.value().end() - 100));
+  }
+
+  std::filesystem::remove(inputPath);
+  std::filesystem::remove(archivePath);
+}
+
+TEST_CASE("Header checksums", "[checksum]") {
+  using namespace cc::tar;
+
+  // Byte by byte reference of the ustar checksum, and of the one written by
+  // earlier versions which also left out the four bytes after the field
+  auto referenceChecksum = [](std::span<const char> buffer,
+                              bool legacy = false) {
+    std::uint64_t sum = 0;
+    std::size_t end = common::CHECKSUM::offset + (legacy ? 12 : 8);
+    for (std::size_t i = 0; i < buffer.size(); i++) {
+      if (i < common::CHECKSUM::offset || i >= end)
+        sum += static_cast<std::uint8_t>(buffer[i]);
+    }
+    return sum + 8 * static_cast<std::uint8_t>(legacy ? '0' : ' ');
+  };
+
+  std::vector<char> blocks(4 * detail::BLOCK_SIZE_B);
+  for (std::size_t i = 0; i < blocks.size(); i++)
+    blocks[i] = static_cast<char>(i * 131 + 7);
+
+  SECTION("Vectorised byte sums match the byte by byte sum") {
+    std::span<const char> data(blocks);
+    for (std::size_t size : {0, 1, 15, 16, 31, 33, 100, 512, 2047}) {
+      std::uint64_t expected = 0;
+      for (std::size_t i = 0; i < size; i++)
+        expected += static_cast<std::uint8_t>(data[3 + i]);
+      REQUIRE(detail::ByteSum(data.subspan(3, size)) == expected);
+    }
+  }
+
+  SECTION("Checksums of serialised headers are verified in batches") {
+    common::ObjectHeader header{.fileName = "batch", .fileSize = 1};
+    std::span<char> data(blocks);
+    for (std::size_t index = 0; index < 4; index++) {
+      auto block = data.subspan(index * detail::BLOCK_SIZE_B,
+                                detail::BLOCK_SIZE_B);
+      header.fileSize = index * 1000;
+      REQUIRE(detail::SerialiseHeader(header, block));
+      REQUIRE(detail::CalculateChecksum(block) == referenceChecksum(block));
+      REQUIRE(detail::VerifyChecksum(block));
+    }
+    REQUIRE(detail::FindInvalidChecksum(blocks) == 4);
+
+    blocks[2 * detail::BLOCK_SIZE_B + 300] ^= 0x40;
+    REQUIRE(detail::FindInvalidChecksum(blocks) == 2);
+    REQUIRE(!detail::VerifyChecksum(data.subspan(2 * detail::BLOCK_SIZE_B,
+                                                 detail::BLOCK_SIZE_B)));
+
+    // A checksum field without octal digits is invalid as well
+    blocks[detail::BLOCK_SIZE_B + common::CHECKSUM::offset] = ' ';
+    REQUIRE(detail::FindInvalidChecksum(blocks) == 1);
+  }
+
+  SECTION("Checksums of earlier versions are still accepted") {
+    common::ObjectHeader header{
+        .fileName = "legacy",
+        .fileSize = 1,
+        .linkIndicator = common::LinkIndicator::SYMBOLIC_LINK,
+        .linkedFileName = "target"};
+    auto block = std::span<char>(blocks).first(detail::BLOCK_SIZE_B);
+    REQUIRE(detail::SerialiseHeader(header, block));
+    std::fill_n(block.begin() + common::CHECKSUM::offset,
+                common::CHECKSUM::size, '\0');
+    REQUIRE(helpers::Write<common::CHECKSUM>(referenceChecksum(block, true),
+                                             block));
+    REQUIRE(detail::VerifyChecksum(block));
+    REQUIRE(detail::FindInvalidChecksum(block) == 1);
+  }
+}
+
+TEST_CASE("Lazy archive reader", "[archive-reader]") {
+  using namespace cc::tar;
+
+  auto filePath =
+      (std::filesystem::temp_directory_path() / "cc-tar-test-reader.tar")
+          .string();
+
+  // Members of 0, 600 and 1200 bytes, optionally with a damaged last header
+  auto writeArchive = [&](bool damaged) {
+    auto sink = detail::OpenArchiveSink(filePath, 1);
+    REQUIRE(sink);
+    for (std::uint64_t index = 0; index < 3; index++) {
+      common::ObjectHeader header{.fileName = "member" + std::to_string(index),
+                                  .fileSize = index * 600};
+      std::array<char, detail::BLOCK_SIZE_B> block{0x00};
+      REQUIRE(detail::SerialiseHeader(header, block));
+      if (damaged && index == 2)
+        block[0] ^= 0x01;
+      REQUIRE(sink.value()->Write(block));
+      std::vector<char> data(detail::PaddedSize(header.fileSize), 'x');
+      REQUIRE(sink.value()->Write(data));
+    }
+    REQUIRE(sink.value()->Close());
+  };
+
+  SECTION("Headers are yielded one at a time") {
+    writeArchive(false);
+    auto reader = ArchiveReader::Open(filePath);
+    REQUIRE(reader);
+
+    std::vector<std::string> names{};
+    for (auto &member : reader.value()) {
+      REQUIRE(member);
+      REQUIRE(member.value().fileSize == names.size() * 600);
+      names.push_back(member.value().fileName);
+    }
+    REQUIRE(names ==
+            std::vector<std::string>{"member0", "member1", "member2"});
+    REQUIRE(reader.value().begin() == reader.value().end());
+  }
+
+  SECTION("A failure ends the range") {
+    writeArchive(true);
+    auto reader = ArchiveReader::Open(filePath);
+    REQUIRE(reader);
+
+    std::size_t valid = 0;
+    std::size_t failed = 0;
+    for (auto &member : reader.value()) {
+      if (member)
+        valid++;
+      else
+        failed++;
+    }
+    REQUIRE(valid == 2);
+    REQUIRE(failed == 1);
+  }
+
+  SECTION("Only archives are opened") {
+    REQUIRE(!ArchiveReader::Open(filePath + ".txt"));
+  }
+
+  SECTION("Zero blocks end the archive") {
+    writeArchive(false);
+    {
+      std::ofstream archive(filePath, std::ios::binary | std::ios::app);
+      std::string trailer(2 * detail::BLOCK_SIZE_B, '\0');
+      trailer += "trailing data that is never parsed";
+      archive << trailer;
+    }
+    auto reader = ArchiveReader::Open(filePath);
+    REQUIRE(reader);
+
+    std::size_t count = 0;
+    for (auto &member : reader.value()) {
+      REQUIRE(member);
+      count++;
+    }
+    REQUIRE(count == 3);
+  }
+
+  std::filesystem::remove(filePath);
+}
+
+TEST_CASE("Member reader", "[member-reader]") {
+  using namespace cc::tar;
+
+  auto filePath =
+      (std::filesystem::temp_directory_path() / "cc-tar-test-members.tar")
+          .string();
+  std::filesystem::remove(detail::IndexPath(filePath));
+
+  // Members of 0, 600 and 1200 bytes filled with 'a', 'b' and 'c', followed
+  // by a sparse member with five bytes at 4096 of a 1 MiB file
+  detail::SparseMap map{};
+  map.extents = {{.offset = 4096, .size = 5}, {.offset = 1 << 20, .size = 0}};
+  auto mapText = detail::SerialiseSparseMap(map);
+  {
+    auto sink = detail::OpenArchiveSink(filePath, 1);
+    REQUIRE(sink);
+    auto writeMember = [&](common::ObjectHeader const &header,
+                           std::string data) {
+      std::vector<char> buffer(detail::SerialisedSize(header));
+      REQUIRE(detail::SerialiseHeader(header, buffer));
+      REQUIRE(sink.value()->Write(buffer));
+      data.resize(detail::PaddedSize(data.size()), '\0');
+      REQUIRE(sink.value()->Write(data));
+    };
+    for (std::uint64_t index = 0; index < 3; index++) {
+      writeMember({.fileName = "member" + std::to_string(index),
+                   .fileSize = index * 600},
+                  std::string(index * 600, static_cast<char>('a' + index)));
+    }
+    writeMember({.fileName = "disk.img",
+                 .fileSize = mapText.size() + 5,
+                 .linkIndicator = common::LinkIndicator::NORMAL_FILE,
+                 .sparseSize = 1 << 20},
+                mapText + "hello");
+    REQUIRE(sink.value()->Close());
+  }
+
+  auto reader = MemberReader::Open(filePath);
+  REQUIRE(reader);
+
+  SECTION("Members are viewed in place") {
+    auto data = reader.value().View("member2");
+    REQUIRE(data);
+    REQUIRE(std::string_view(data.value().data(), data.value().size()) ==
+            std::string(1200, 'c'));
+    auto empty = reader.value().View("member0");
+    REQUIRE(empty);
+    REQUIRE(empty.value().empty());
+
+    REQUIRE(reader.value().Contains("member1"));
+    REQUIRE(!reader.value().Contains("member3"));
+    REQUIRE(!reader.value().View("member3"));
+    // Sparse members are not stored in one piece
+    REQUIRE(!reader.value().View("disk.img"));
+  }
+
+  SECTION("Streams read from any offset on many threads") {
+    std::vector<std::thread> threads{};
+    std::atomic<int> matches{0};
+    for (int thread = 0; thread < 4; thread++) {
+      threads.emplace_back([&]() {
+        auto stream = reader.value().OpenMember("member1");
+        if (!stream || stream.value().Size() != 600)
+          return;
+        std::array<char, 256> buffer{};
+        std::string contents{};
+        while (true) {
+          auto count = stream.value().Read(buffer);
+          if (!count || count.value() == 0)
+            break;
+          contents.append(buffer.data(), count.value());
+        }
+        if (contents == std::string(600, 'b'))
+          matches++;
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+    REQUIRE(matches.load() == 4);
+
+    auto stream = reader.value().OpenMember("member1");
+    REQUIRE(stream);
+    std::array<char, 100> buffer{};
+    auto count = stream.value().ReadAt(550, buffer);
+    REQUIRE(count);
+    REQUIRE(count.value() == 50);
+    REQUIRE(stream.value().Offset() == 0);
+  }
+
+  SECTION("Holes of sparse members read as zeros") {
+    auto stream = reader.value().OpenMember("disk.img");
+    REQUIRE(stream);
+    REQUIRE(stream.value().Size() == 1 << 20);
+
+    std::array<char, 16> buffer{};
+    auto count = stream.value().ReadAt(4090, buffer);
+    REQUIRE(count);
+    REQUIRE(count.value() == buffer.size());
+    REQUIRE(std::string_view(buffer.data(), buffer.size()) ==
+            std::string(6, '\0') + "hello" + std::string(5, '\0'));
+  }
+
+  SECTION("Only random access archives are opened") {
+    REQUIRE(!MemberReader::Open(filePath + ".gz"));
+    REQUIRE(!MemberReader::Open(filePath + ".txt"));
+  }
+
+  std::filesystem::remove(filePath);
+}
+
+TEST_CASE("Archive verification", "[verify]") {
+  using namespace cc::tar;
+
+  auto filePath =
+      (std::filesystem::temp_directory_path() / "cc-tar-test-verify.tar")
+          .string();
+
+  // An empty member, one of 700 bytes at offset 1024 and one whose name needs
+  // a PAX header, followed by the end-of-archive marker and two more zeros
+  std::string archive{};
+  for (auto const &name : {std::string("empty"), std::string("data"),
+                           std::string(150, 'n')}) {
+    common::ObjectHeader header{.fileName = name,
+                                .fileSize = name == "data" ? 700U : 0U};
+    std::string blocks(detail::SerialisedSize(header), '\0');
+    REQUIRE(detail::SerialiseHeader(header, blocks));
+    archive += blocks;
+    archive += std::string(header.fileSize, 'x');
+    archive.resize(detail::PaddedSize(archive.size()), '\0');
+  }
+  archive.resize(archive.size() + 4 * detail::BLOCK_SIZE_B, '\0');
+
+  // Checks both the parallel path on the mapped file and the sequential one
+  auto verify = [&](std::string const &contents) -> bool {
+    {
+      std::ofstream archiveFile(filePath, std::ios::binary | std::ios::trunc);
+      archiveFile << contents;
+    }
+    std::vector<bool> results{};
+    for (std::uint32_t jobs : {1U, 4U}) {
+      auto source = detail::OpenArchiveSource(filePath);
+      REQUIRE(source);
+      REQUIRE(source.value()->IsRandomAccess());
+      results.push_back(
+          bool(detail::VerifyArchive(*source.value(), filePath, jobs)));
+    }
+    detail::StreamSource stream(
+        "stream", std::make_unique<std::istringstream>(contents),
+        3 * detail::BLOCK_SIZE_B);
+    results.push_back(bool(detail::VerifyArchive(stream, "stream", 1)));
+
+    REQUIRE(std::adjacent_find(results.begin(), results.end(),
+                               std::not_equal_to<>()) == results.end());
+    return results.front();
+  };
+
+  SECTION("Intact archives pass") { REQUIRE(verify(archive)); }
+
+  SECTION("Damaged headers fail") {
+    archive[detail::BLOCK_SIZE_B + 1] ^= 0x01;
+    REQUIRE(!verify(archive));
+  }
+
+  SECTION("Padding behind member data has to be zero") {
+    archive[2 * detail::BLOCK_SIZE_B + 700] = 'y';
+    REQUIRE(!verify(archive));
+  }
+
+  SECTION("Truncated archives fail") {
+    REQUIRE(!verify(archive.substr(0, 2 * detail::BLOCK_SIZE_B + 300)));
+    REQUIRE(!verify(
+        archive.substr(0, archive.size() - 3 * detail::BLOCK_SIZE_B)));
+  }
+
+  SECTION("Only zeros may follow the end-of-archive marker") {
+    archive.back() = 'z';
+    REQUIRE(!verify(archive));
+  }
+
+  std::filesystem::remove(filePath);
+}
+
+TEST_CASE("Header table", "[header-table]") {
+  using namespace cc::tar;
+
+  common::HeaderTable table{};
+  table.Add(
+      common::ObjectHeader{.fileName = "b", .fileSize = 1, .fileMode = 0644});
+  table.Add(common::ObjectHeader{.fileName = "a", .fileSize = 2});
+  table.Add(common::ObjectHeader{.fileName = "b",
+                                 .fileSize = 3,
+                                 .linkIndicator =
+                                     common::LinkIndicator::SYMBOLIC_LINK,
+                                 .linkedFileName = "a"});
+
+  SECTION("Rows are returned in insertion order") {
+    REQUIRE(table.Size() == 3);
+    REQUIRE(table[0].fileName == "b");
+    REQUIRE(table[0].fileMode == 0644);
+    REQUIRE(table[2].linkedFileName == "a");
+    REQUIRE(table[2].ToHeader().linkedFileName == "a");
+
+    std::uint64_t totalSize = 0;
+    for (auto row : table)
+      totalSize += row.fileSize;
+    REQUIRE(totalSize == 6);
+  }
+
+  SECTION("Sorting by name keeps the order of duplicates") {
+    table.SortByName();
+    REQUIRE(table[0].fileName == "a");
+    REQUIRE(table[1].fileSize == 1);
+    REQUIRE(table[2].fileSize == 3);
+    REQUIRE(table[2].linkIndicator == common::LinkIndicator::SYMBOLIC_LINK);
+    REQUIRE(std::is_sorted(table.begin(), table.end(),
+                           [](auto const &a, auto const &b) {
+                             return a.fileName < b.fileName;
+                           }));
+  }
+}
+
+TEST_CASE("Extracted file writes", "[io-backend]") {
+  using namespace cc::tar;
+
+  auto directory =
+      std::filesystem::temp_directory_path() / "cc-tar-test-io-backend";
+  std::filesystem::create_directories(directory);
+
+  auto readFile = [](std::filesystem::path const &path) {
+    std::string contents(std::filesystem::file_size(path), '\0');
+    auto input = detail::FileDescriptor::Open(path.string(), O_RDONLY);
+    REQUIRE(input);
+    auto count = detail::ReadAt(input.value(), contents, 0);
+    REQUIRE(count);
+    REQUIRE(count.value() == contents.size());
+    return contents;
+  };
+
+  auto writeFiles = [&](detail::IoBackend &io) {
+    std::vector<std::string> contents{};
+    for (std::size_t index = 0; index < 200; index++)
+      contents.emplace_back(index * 7, static_cast<char>('a' + index % 26));
+
+    for (std::size_t index = 0; index < contents.size(); index++) {
+      auto path = (directory / ("file" + std::to_string(index))).string();
+      REQUIRE(io.WriteFile(path, contents[index]));
+    }
+
+    // Later writes to the same path win, also from the backend's buffer
+    auto duplicate = (directory / "duplicate").string();
+    REQUIRE(io.WriteFile(duplicate, std::string_view("first")));
+    auto buffer = io.Buffer(6);
+    REQUIRE(buffer);
+    std::copy_n("second", 6, buffer.value().begin());
+    REQUIRE(io.WriteFile(duplicate, buffer.value()));
+    REQUIRE(io.Wait());
+
+    for (std::size_t index = 0; index < contents.size(); index++)
+      REQUIRE(readFile(directory / ("file" + std::to_string(index))) ==
+              contents[index]);
+    REQUIRE(readFile(duplicate) == "second");
+
+    // Failures are reported by the write or once the writes complete
+    auto status = io.WriteFile((directory / "missing/file").string(),
+                               std::string_view("x"));
+    REQUIRE(!(status && io.Wait()));
+  };
+
+  SECTION("Blocking backend") {
+    detail::BlockingBackend io{};
+    writeFiles(io);
+  }
+
+  SECTION("io_uring backend, when the kernel supports it") {
+    if (auto io = detail::UringBackend::Create())
+      writeFiles(*io);
+  }
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Buffered stream source", "[archive-source]") {
+  using namespace cc::tar;
+
+  // Blocks numbered in their first byte, read through a buffer of a few blocks
+  std::string contents(20 * detail::BLOCK_SIZE_B, '\0');
+  for (std::size_t index = 0; index < 20; index++)
+    contents[index * detail::BLOCK_SIZE_B] = static_cast<char>(index);
+  detail::StreamSource source("stream",
+                              std::make_unique<std::istringstream>(contents),
+                              3 * detail::BLOCK_SIZE_B);
+
+  auto block = source.ReadBlock();
+  REQUIRE(block);
+  REQUIRE(block.value()[0] == 0);
+
+  REQUIRE(source.Skip(5 * detail::BLOCK_SIZE_B));
+  block = source.ReadBlock();
+  REQUIRE(block);
+  REQUIRE(block.value()[0] == 6);
+
+  auto data = source.ReadData(10 * detail::BLOCK_SIZE_B);
+  REQUIRE(data);
+  REQUIRE(!data.value().empty());
+  REQUIRE(data.value()[0] == 7);
+  auto consumed = data.value().size();
+  REQUIRE(source.Skip(13 * detail::BLOCK_SIZE_B - consumed));
+
+  REQUIRE(source.Offset() == 20 * detail::BLOCK_SIZE_B);
+  block = source.ReadBlock();
+  REQUIRE(block);
+  REQUIRE(block.value().empty());
+}
+
+TEST_CASE("Pipe streams", "[pipe]") {
+  using namespace cc::tar;
+
+  // Blocks numbered in their first bytes, spanning several pipe buffers
+  std::size_t blockCount = (9 << 20) / detail::BLOCK_SIZE_B + 3;
+  std::string contents(blockCount * detail::BLOCK_SIZE_B, '\0');
+  for (std::size_t index = 0; index < blockCount; index++) {
+    contents[index * detail::BLOCK_SIZE_B] = static_cast<char>(index);
+    contents[index * detail::BLOCK_SIZE_B + 1] = static_cast<char>(index >> 8);
+  }
+
+  std::array<int, 2> fds{};
+  REQUIRE(pipe(fds.data()) == 0);
+  detail::FileDescriptor readEnd(fds[0], "pipe", error::StreamType::INPUT);
+  detail::FileDescriptor writeEnd(fds[1], "pipe", error::StreamType::OUTPUT);
+
+  // The pipe holds far less than a buffer, so both ends run at once
+  std::string received{};
+  bool firstBlock = false;
+  bool skipped = false;
+  bool ended = false;
+  std::uint64_t offset = 0;
+  std::thread reader([&]() {
+    detail::PipeSource source("pipe", std::move(readEnd));
+    auto block = source.ReadBlock();
+    firstBlock = block && block.value().size() == detail::BLOCK_SIZE_B &&
+                 block.value()[0] == 0;
+    skipped = static_cast<bool>(source.Skip(9 * detail::BLOCK_SIZE_B));
+    while (true) {
+      auto data = source.ReadData(3 << 20);
+      if (!data || data.value().empty()) {
+        ended = static_cast<bool>(data);
+        break;
+      }
+      received.append(data.value().data(), data.value().size());
+    }
+    offset = source.Offset();
+  });
+
+  {
+    detail::PipeSink sink("pipe", std::move(writeEnd), 20 * 512);
+    // Uneven writes cross the buffer boundaries at arbitrary offsets
+    std::string_view remaining = contents;
+    for (std::size_t size = 1000; !remaining.empty(); size = size * 3 + 1) {
+      auto part = remaining.substr(0, size);
+      REQUIRE(sink.Write(part));
+      remaining.remove_prefix(part.size());
+    }
+    REQUIRE(sink.Offset() == contents.size());
+    REQUIRE(sink.Close());
+  }
+  reader.join();
+
+  REQUIRE(firstBlock);
+  REQUIRE(skipped);
+  REQUIRE(ended);
+  REQUIRE(offset == contents.size());
+  REQUIRE(received == contents.substr(10 * detail::BLOCK_SIZE_B));
+}
+
+TEST_CASE("Sparse files", "[sparse]") {
+  using namespace cc::tar;
+
+  detail::SparseMap map{};
+  map.extents = {{.offset = 4096, .size = 5}, {.offset = 1 << 20, .size = 0}};
+  auto text = detail::SerialiseSparseMap(map);
+  REQUIRE(text.size() == detail::BLOCK_SIZE_B);
+  REQUIRE(text.starts_with("2\n4096\n5\n1048576\n0\n"));
+
+  SECTION("Maps are read back in front of the extents") {
+    auto contents = text + "hello" + std::string(507, '\0');
+    detail::StreamSource source("stream",
+                                std::make_unique<std::istringstream>(contents),
+                                detail::BLOCK_SIZE_B);
+    auto read = detail::ReadSparseMap(source, text.size() + 5);
+    REQUIRE(read);
+    REQUIRE(read.value().extents == map.extents);
+    REQUIRE(read.value().mapSize == detail::BLOCK_SIZE_B);
+    REQUIRE(read.value().End() == 1 << 20);
+    REQUIRE(source.Offset() == detail::BLOCK_SIZE_B);
+
+    // The map has to account for the member data exactly
+    detail::StreamSource shortSource(
+        "stream", std::make_unique<std::istringstream>(contents),
+        detail::BLOCK_SIZE_B);
+    REQUIRE(!detail::ReadSparseMap(shortSource, text.size() + 4));
+  }
+
+  SECTION("Overlapping extents are rejected") {
+    std::string overlapping = "2\n0\n10\n5\n10\n";
+    overlapping.resize(detail::BLOCK_SIZE_B, '\0');
+    detail::StreamSource source(
+        "stream", std::make_unique<std::istringstream>(overlapping),
+        detail::BLOCK_SIZE_B);
+    REQUIRE(!detail::ReadSparseMap(source, detail::BLOCK_SIZE_B + 20));
+  }
+
+  SECTION("Headers of sparse members carry the real name and size") {
+    common::ObjectHeader header{.fileName = "images/disk.img",
+                                .fileSize = text.size() + 5,
+                                .fileMode = 0644,
+                                .linkIndicator =
+                                    common::LinkIndicator::NORMAL_FILE,
+                                .sparseSize = 1 << 20};
+    std::vector<char> buffer(detail::SerialisedSize(header));
+    REQUIRE(detail::SerialiseHeader(header, buffer));
+
+    auto last = std::span<const char>(buffer).last(detail::BLOCK_SIZE_B);
+    auto view = detail::HeaderView::Open(last);
+    REQUIRE(view);
+    REQUIRE(view.value().FileName() == "images/GNUSparseFile.0/disk.img");
+
+    auto parsed = detail::ParseHeader(buffer);
+    REQUIRE(parsed);
+    REQUIRE(parsed.value().fileName == "images/disk.img");
+    REQUIRE(parsed.value().fileSize == text.size() + 5);
+    REQUIRE(parsed.value().sparseSize == 1 << 20);
+  }
+
+  SECTION("Holes are found in files") {
+    auto path =
+        (std::filesystem::temp_directory_path() / "cc-tar-test-sparse")
+            .string();
+    std::filesystem::remove(path);
+    {
+      std::ofstream file(path);
+      file.seekp(8 << 20);
+      file << "data";
+    }
+    auto file = detail::FileDescriptor::Open(path, O_RDONLY);
+    REQUIRE(file);
+    struct stat info {};
+    REQUIRE(fstat(file.value().Get(), &info) == 0);
+
+    auto found = detail::FindDataExtents(file.value(), info);
+    REQUIRE(found);
+    // Not every file system reports holes
+    if (found.value()) {
+      REQUIRE(found.value()->End() == (8 << 20) + 4);
+      REQUIRE(found.value()->DataSize() < (8 << 20));
+    }
+
+    std::filesystem::resize_file(path, 0);
+    REQUIRE(fstat(file.value().Get(), &info) == 0);
+    found = detail::FindDataExtents(file.value(), info);
+    REQUIRE(found);
+    REQUIRE(!found.value());
+    std::filesystem::remove(path);
+  }
+}
+
+TEST_CASE("Work stealing pool", "[thread-pool]") {
+  using namespace cc::tar;
+
+  // Every task below depth 10 submits two more, from the worker running it
+  std::atomic<int> count{0};
+  detail::WorkStealingPool pool(4);
+  std::function<void(int)> spawn = [&](int depth) {
+    count++;
+    if (depth < 10) {
+      pool.Submit([&, depth]() { spawn(depth + 1); });
+      pool.Submit([&, depth]() { spawn(depth + 1); });
+    }
+  };
+  pool.Submit([&]() { spawn(0); });
+  pool.Wait();
+
+  REQUIRE(count.load() == (1 << 11) - 1);
+}
+
+TEST_CASE("Operation statistics", "[stats]") {
+  using namespace cc::tar;
+  stats::Enable();
+
+  SECTION("Counters of exited threads are merged") {
+    auto before = stats::Collect();
+    std::vector<std::thread> threads{};
+    for (int i = 0; i < 4; i++) {
+      threads.emplace_back([]() {
+        detail::Count(stats::Counter::MEMBERS_READ, 10);
+        detail::PhaseTimer timer(stats::Phase::METADATA);
+      });
+    }
+    for (auto &thread : threads)
+      thread.join();
+
+    auto after = stats::Collect();
+    REQUIRE(after.Count(stats::Counter::MEMBERS_READ) -
+                before.Count(stats::Counter::MEMBERS_READ) ==
+            40);
+    REQUIRE(after.Calls(stats::Phase::METADATA) -
+                before.Calls(stats::Phase::METADATA) ==
+            4);
+    REQUIRE(after.elapsedNanoseconds >= before.elapsedNanoseconds);
+  }
+
+  SECTION("Nested timers exclude the time of the inner phase") {
+    auto before = stats::Collect();
+    {
+      detail::PhaseTimer outer(stats::Phase::HEADER_PARSE);
+      detail::PhaseTimer inner(stats::Phase::ARCHIVE_IO);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    auto after = stats::Collect();
+    auto parse = after.Time(stats::Phase::HEADER_PARSE) -
+                 before.Time(stats::Phase::HEADER_PARSE);
+    auto io = after.Time(stats::Phase::ARCHIVE_IO) -
+              before.Time(stats::Phase::ARCHIVE_IO);
+    REQUIRE(io >= 20'000'000);
+    REQUIRE(parse < 20'000'000);
+  }
+
+  SECTION("Reports are written as text and JSON") {
+    stats::Report report{};
+    report.counters[static_cast<std::size_t>(stats::Counter::MEMBERS_READ)] = 3;
+    report.counters[static_cast<std::size_t>(stats::Counter::MEMBERS_WRITTEN)] =
+        4;
+    report.calls[static_cast<std::size_t>(stats::Phase::FILE_OPEN)] = 2;
+    report.calls[static_cast<std::size_t>(stats::Phase::CHECKSUM)] = 5;
+    REQUIRE(report.SystemCalls() == 2);
+
+    std::ostringstream json{};
+    report.WriteJson(json);
+    REQUIRE(json.str().find("\"members_read\":3,\"members_written\":4") !=
+            std::string::npos);
+    REQUIRE(json.str().find("\"file_open\":{\"ns\":0,\"calls\":2}") !=
+            std::string::npos);
+
+    std::ostringstream text{};
+    report.WriteText(text);
+    REQUIRE(text.str().find("members: 3 read, 4 written") !=
+            std::string::npos);
+  }
+}
+
+TEST_CASE("Directory tree walk", "[tree-walker]") {
+  using namespace cc::tar;
+
+  auto root = std::filesystem::temp_directory_path() / "cc-tar-test-walk";
+  std::filesystem::remove_all(root);
+  for (auto const *directory : {"b/y", "a/z", "a/x/deep"})
+    std::filesystem::create_directories(root / directory);
+  for (auto const *file : {"b/2", "b/y/1", "a/3", "a/x/deep/4", "c"})
+    std::ofstream(root / file) << file;
+  std::filesystem::create_symlink(root / "c", root / "a/link");
+
+  auto walk = [&](bool sorted) {
+    std::vector<std::string> paths{};
+    detail::TreeWalker walker({root.string() + "/"}, 4, sorted);
+    while (true) {
+      auto entry = walker.Next();
+      REQUIRE(entry);
+      if (!entry.value())
+        break;
+      auto const &path = entry.value()->path;
+      paths.push_back(path.substr(std::min(path.size(),
+                                           root.string().size() + 1)));
+    }
+    return paths;
+  };
+
+  SECTION("Sorted walks are depth first and ordered by name") {
+    std::vector<std::string> expected{
+        "",    "a",   "a/3", "a/link", "a/x",   "a/x/deep", "a/x/deep/4",
+        "a/z", "b",   "b/2", "b/y",    "b/y/1", "c"};
+    REQUIRE(walk(true) == expected);
+    REQUIRE(walk(true) == expected);
+  }
+
+  SECTION("Directories come before their contents") {
+    auto paths = walk(false);
+    REQUIRE(paths.size() == 13);
+    for (std::size_t index = 0; index < paths.size(); index++) {
+      auto slash = paths[index].rfind('/');
+      if (slash == std::string::npos)
+        continue;
+      auto parent = std::find(paths.begin(), paths.end(),
+                              paths[index].substr(0, slash));
+      REQUIRE(parent < paths.begin() + static_cast<std::ptrdiff_t>(index));
+    }
+  }
+
+  SECTION("Walks ahead of a slow consumer are complete") {
+    // More entries than are listed ahead, with subdirectories whose listings
+    // are held back until the consumer catches up
+    for (int index = 0; index < 40; index++) {
+      auto path = root / "big" / std::to_string(index);
+      std::filesystem::create_directories(path / "s");
+      for (int file = 0; file < 120; file++)
+        std::ofstream(path / std::to_string(file));
+      for (int file = 0; file < 5; file++)
+        std::ofstream(path / "s" / std::to_string(file));
+    }
+
+    for (auto sorted : {false, true}) {
+      auto paths = walk(sorted);
+      REQUIRE(paths.size() == 13 + 1 + 40 * (1 + 120 + 1 + 5));
+      std::sort(paths.begin(), paths.end());
+      REQUIRE(std::adjacent_find(paths.begin(), paths.end()) == paths.end());
+      REQUIRE(std::binary_search(paths.begin(), paths.end(),
+                                 std::string("big/39/s/4")));
+    }
+  }
+
+  SECTION("Symbolic links are listed with their target, not followed") {
+    detail::TreeWalker walker({(root / "a/link").string()}, 1, false);
+    auto entry = walker.Next();
+    REQUIRE(entry);
+    REQUIRE(entry.value());
+    REQUIRE(S_ISLNK(entry.value()->info.st_mode));
+    REQUIRE(entry.value()->linkTarget == (root / "c").string());
+    REQUIRE(!walker.Next().value());
+  }
+
+  SECTION("Missing roots are reported") {
+    detail::TreeWalker walker({(root / "missing").string()}, 1, false);
+    REQUIRE(!walker.Next());
+  }
+
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Archive operations", "[file-handler]") {
+  using namespace cc::tar;
+  namespace fs = std::filesystem;
+
+  // Member paths are relative to the current directory, as for the program
+  auto root = fs::temp_directory_path() / "cc-tar-test-handler";
+  fs::remove_all(root);
+  fs::create_directories(root / "tree/nested");
+  struct WorkingDirectory {
+    fs::path previous = fs::current_path();
+    explicit WorkingDirectory(fs::path const &path) { fs::current_path(path); }
+    ~WorkingDirectory() { fs::current_path(previous); }
+  } workingDirectory(root);
+
+  auto writeFile = [](fs::path const &path, std::string const &contents) {
+    std::ofstream(path, std::ios::binary) << contents;
+  };
+  auto readFile = [](fs::path const &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+  };
+  writeFile("tree/a.txt", "alpha");
+  writeFile("tree/nested/b.txt", std::string(3000, 'b'));
+
+  SECTION("Created archives extract to the same tree") {
+    for (std::uint32_t jobs : {1u, 4u}) {
+      FileHandler handler("tree.tar", {.jobs = jobs});
+      REQUIRE(handler.Compress({"tree"}));
+      fs::rename("tree", "original");
+      REQUIRE(handler.Extract());
+      REQUIRE(readFile("tree/a.txt") == "alpha");
+      REQUIRE(readFile("tree/nested/b.txt") == std::string(3000, 'b'));
+      fs::remove_all("tree");
+      fs::rename("original", "tree");
+    }
+  }
+
+  SECTION("Appended members follow the existing ones") {
+    FileHandler handler("tree.tar");
+    REQUIRE(handler.Compress({"tree/a.txt"}));
+    REQUIRE(handler.Append({"tree/nested"}));
+
+    auto contents = handler.ListContents();
+    REQUIRE(contents);
+    std::vector<std::string> names{};
+    for (auto const &header : contents.value())
+      names.emplace_back(header.fileName);
+    REQUIRE(names == std::vector<std::string>{"tree/a.txt", "tree/nested/",
+                                              "tree/nested/b.txt"});
+  }
+
+  SECTION("Statistics count read and written members apart") {
+    stats::Enable();
+    auto counted = [](stats::Report const &before, stats::Counter counter) {
+      return stats::Collect().Count(counter) - before.Count(counter);
+    };
+
+    auto before = stats::Collect();
+    FileHandler handler("tree.tar");
+    REQUIRE(handler.Compress({"tree/a.txt"}));
+    REQUIRE(handler.Append({"tree/nested"}));
+    REQUIRE(counted(before, stats::Counter::MEMBERS_WRITTEN) == 3);
+
+    before = stats::Collect();
+    REQUIRE(handler.ListContents());
+    REQUIRE(counted(before, stats::Counter::MEMBERS_READ) == 3);
+    REQUIRE(counted(before, stats::Counter::MEMBERS_WRITTEN) == 0);
+  }
+
+  SECTION("Named members extract the last copy") {
+    writeFile("f.txt", "v1");
+    FileHandler handler("updates.tar", {.buildIndex = true});
+    REQUIRE(handler.Compress({"f.txt", "tree/a.txt"}));
+    writeFile("f.txt", "v2-newer");
+    REQUIRE(handler.Append({"f.txt"}));
+
+    for (std::uint32_t jobs : {1u, 4u}) {
+      for (bool indexed : {true, false}) {
+        if (!indexed)
+          fs::remove(detail::IndexPath("updates.tar"));
+        fs::remove("f.txt");
+        FileHandler extractor("updates.tar", {.jobs = jobs});
+        REQUIRE(extractor.Extract({"f.txt"}));
+        REQUIRE(readFile("f.txt") == "v2-newer");
+        fs::remove("f.txt");
+        REQUIRE(extractor.Extract({"f*"}));
+        REQUIRE(readFile("f.txt") == "v2-newer");
+      }
+    }
+  }
+
+  SECTION("Deletion markers only remove paths inside the directory") {
+    auto outside = fs::temp_directory_path() / "cc-tar-test-outside";
+    fs::create_directories(outside);
+    writeFile(outside / "victim", "kept");
+    fs::create_directory_symlink(outside, "link");
+
+    auto writeMarker = [](std::string const &fileName) {
+      auto sink = detail::OpenArchiveSink("markers.tar", 1);
+      REQUIRE(sink);
+      common::ObjectHeader header{
+          .fileName = fileName,
+          .linkIndicator = common::LinkIndicator::DELETED};
+      std::vector<char> buffer(detail::SerialisedSize(header));
+      REQUIRE(detail::SerialiseHeader(header, buffer));
+      REQUIRE(sink.value()->Write(buffer));
+      REQUIRE(sink.value()->Write(std::vector<char>(1024, '\0')));
+      REQUIRE(sink.value()->Close());
+    };
+
+    for (auto const *name : {".", "./", "..", "tree/..", "tree/../..", "/",
+                             "/tmp", "./tree", "link/victim", "link/../tree"}) {
+      writeMarker(name);
+      for (std::uint32_t jobs : {1u, 4u}) {
+        FileHandler handler("markers.tar", {.jobs = jobs});
+        REQUIRE(!handler.Extract());
+        REQUIRE(readFile("tree/a.txt") == "alpha");
+        REQUIRE(readFile(outside / "victim") == "kept");
+      }
+    }
+
+    writeMarker("tree/nested/");
+    FileHandler handler("markers.tar");
+    REQUIRE(handler.Extract());
+    REQUIRE(!fs::exists("tree/nested"));
+    REQUIRE(fs::exists("tree/a.txt"));
+    fs::remove_all(outside);
+  }
+
+  SECTION("Sparse members list with their restored size") {
+    writeFile("sp", "x");
+    fs::resize_file("sp", 10 << 20);
+    REQUIRE(FileHandler("sparse.tar", {.buildIndex = true}).Compress({"sp"}));
+
+    auto list = []() {
+      auto reader = ArchiveReader::Open("sparse.tar");
+      REQUIRE(reader);
+      std::vector<common::ObjectHeader> members{};
+      for (auto &member : reader.value()) {
+        REQUIRE(member);
+        members.push_back(member.value());
+      }
+      REQUIRE(members.size() == 1);
+      return members[0];
+    };
+    REQUIRE(fs::exists(detail::IndexPath("sparse.tar")));
+    auto indexed = list();
+    fs::remove(detail::IndexPath("sparse.tar"));
+    auto scanned = list();
+    REQUIRE(indexed.fileSize == scanned.fileSize);
+    REQUIRE(indexed.sparseSize == scanned.sparseSize);
+    // Not every file system reports holes
+    if (scanned.fileSize < (10 << 20))
+      REQUIRE(scanned.sparseSize == 10 << 20);
+  }
+
+  SECTION("Incremental archives replace files and directories") {
+    fs::create_directories("inc/d");
+    writeFile("inc/d/f1", "one");
+    HandlerOptions options{.snapshotPath = "inc.snap"};
+    REQUIRE(FileHandler("inc0.tar", options).Compress({"inc"}));
+
+    // Directory replaced by a file, then by a directory again
+    fs::remove_all("inc/d");
+    writeFile("inc/d", "file");
+    REQUIRE(FileHandler("inc1.tar", options).Compress({"inc"}));
+    fs::remove("inc/d");
+    fs::create_directories("inc/d");
+    writeFile("inc/d/f2", "two");
+    REQUIRE(FileHandler("inc2.tar", options).Compress({"inc"}));
+
+    // Deletion markers come before the members
+    auto contents = FileHandler("inc1.tar").ListContents();
+    REQUIRE(contents);
+    std::vector<std::string> names{};
+    for (auto const &header : contents.value())
+      names.emplace_back(header.fileName);
+    REQUIRE(names ==
+            std::vector<std::string>{"inc/d", "inc/d/f1", "inc/", "inc/d"});
+
+    fs::remove_all("inc");
+    for (std::uint32_t jobs : {1u, 4u}) {
+      REQUIRE(FileHandler("inc0.tar", {.jobs = jobs}).Extract());
+      REQUIRE(FileHandler("inc1.tar", {.jobs = jobs}).Extract());
+      REQUIRE(readFile("inc/d") == "file");
+      REQUIRE(FileHandler("inc2.tar", {.jobs = jobs}).Extract());
+      REQUIRE(readFile("inc/d/f2") == "two");
+      REQUIRE(!fs::exists("inc/d/f1"));
+      fs::remove_all("inc");
+    }
+  }
+
+  SECTION("Deletion markers drop the members queued below them") {
+    using common::LinkIndicator;
+    auto member = [](std::string fileName, LinkIndicator type,
+                     std::string data = {}, std::string target = {}) {
+      common::ObjectHeader header{.fileName = std::move(fileName),
+                                  .fileSize = data.size(),
+                                  .fileMode = 0644,
+                                  .linkIndicator = type,
+                                  .linkedFileName = std::move(target)};
+      return std::pair(std::move(header), std::move(data));
+    };
+    std::vector members{
+        member("del/", LinkIndicator::DIRECTORY),
+        member("del/a/", LinkIndicator::DIRECTORY),
+        member("del/a/f", LinkIndicator::NORMAL_FILE, "f"),
+        member("del/ab", LinkIndicator::NORMAL_FILE, "ab"),
+        member("del/a/l", LinkIndicator::HARD_LINK, "", "del/ab"),
+        member("del/s", LinkIndicator::SYMBOLIC_LINK, "", "a/f"),
+        member("del/a/", LinkIndicator::DELETED),
+        member("del/b", LinkIndicator::NORMAL_FILE, "b")};
+    {
+      auto sink = detail::OpenArchiveSink("deleted.tar", 1);
+      REQUIRE(sink);
+      for (auto const &[header, data] : members) {
+        auto headerSize = detail::SerialisedSize(header);
+        std::vector<char> buffer(headerSize + detail::PaddedSize(data.size()));
+        REQUIRE(detail::SerialiseHeader(header, buffer));
+        std::copy(data.begin(), data.end(), buffer.begin() + headerSize);
+        REQUIRE(sink.value()->Write(buffer));
+      }
+      REQUIRE(sink.value()->Write(std::vector<char>(1024, '\0')));
+      REQUIRE(sink.value()->Close());
+    }
+
+    // Parallel extraction leaves the same tree as the sequential one
+    for (std::uint32_t jobs : {1u, 4u}) {
+      REQUIRE(FileHandler("deleted.tar", {.jobs = jobs}).Extract());
+      REQUIRE(!fs::exists("del/a"));
+      REQUIRE(readFile("del/ab") == "ab");
+      REQUIRE(readFile("del/b") == "b");
+      REQUIRE(fs::is_symlink("del/s"));
+      REQUIRE(fs::hard_link_count("del/ab") == 1);
+      fs::remove_all("del");
+    }
+  }
+
+  SECTION("Hard links stay inside the directory") {
+    auto outside = fs::temp_directory_path() / "cc-tar-test-outside";
+    fs::create_directories(outside);
+    writeFile(outside / "s", "secret");
+
+    auto writeLinks = [](std::vector<common::ObjectHeader> const &headers) {
+      auto sink = detail::OpenArchiveSink("links.tar", 1);
+      REQUIRE(sink);
+      for (auto const &header : headers) {
+        std::vector<char> buffer(detail::SerialisedSize(header));
+        REQUIRE(detail::SerialiseHeader(header, buffer));
+        REQUIRE(sink.value()->Write(buffer));
+      }
+      REQUIRE(sink.value()->Write(std::vector<char>(1024, '\0')));
+      REQUIRE(sink.value()->Close());
+    };
+    auto symbolicLink = [](std::string fileName, std::string target) {
+      return common::ObjectHeader{
+          .fileName = std::move(fileName),
+          .linkIndicator = common::LinkIndicator::SYMBOLIC_LINK,
+          .linkedFileName = std::move(target)};
+    };
+    auto hardLink = [](std::string fileName, std::string target) {
+      return common::ObjectHeader{
+          .fileName = std::move(fileName),
+          .linkIndicator = common::LinkIndicator::HARD_LINK,
+          .linkedFileName = std::move(target)};
+    };
+
+    // A symbolic link of the same archive, or one on disk from an earlier
+    // extraction
+    writeLinks(
+        {symbolicLink("evil", outside.string()), hardLink("x", "evil/s")});
+    for (std::uint32_t jobs : {1u, 4u}) {
+      FileHandler handler("links.tar", {.jobs = jobs});
+      REQUIRE(!handler.Extract());
+      REQUIRE(!fs::exists(fs::symlink_status("x")));
+      REQUIRE(fs::hard_link_count(outside / "s") == 1);
+      fs::remove("evil");
+    }
+    fs::create_directory_symlink(outside, "evil");
+    writeLinks({hardLink("x", "evil/s")});
+    REQUIRE(!FileHandler("links.tar").Extract());
+    REQUIRE(fs::hard_link_count(outside / "s") == 1);
+    fs::remove("evil");
+
+    // Links are not placed through a symbolic link either
+    fs::create_directory_symlink(outside, "evil");
+    writeLinks({hardLink("evil/x", "tree/a.txt")});
+    REQUIRE(!FileHandler("links.tar").Extract());
+    REQUIRE(!fs::exists(outside / "x"));
+    fs::remove("evil");
+
+    writeLinks({symbolicLink("l", "tree/a.txt"), hardLink("h", "tree/a.txt")});
+    REQUIRE(FileHandler("links.tar").Extract());
+    REQUIRE(readFile("l") == "alpha");
+    REQUIRE(fs::hard_link_count("tree/a.txt") == 2);
+    fs::remove_all(outside);
+  }
+
+  SECTION("Archives written by GNU tar are read") {
+    // Header blocks of archives written by GNU tar 1.34, as the runs of bytes
+    // that are not zero
+    auto block = [](std::vector<std::pair<std::size_t, std::string>> runs) {
+      std::string contents(512, '\0');
+      for (auto const &[offset, bytes] : runs)
+        std::copy(bytes.begin(), bytes.end(), contents.begin() + offset);
+      return contents;
+    };
+    auto longName = "d/" + std::string(110, 'x') + ".txt";
+    auto cutName = longName.substr(0, 100);
+    std::string end(1024, '\0');
+
+    // GNU format, with a long name header
+    writeFile(
+        "gnu.tar",
+        block({{0, "d/"},
+               {100, "0000755"},
+               {108, "0000000"},
+               {116, "0000000"},
+               {124, "00000000000"},
+               {136, "14524770400"},
+               {148, "006172"},
+               {155, " 5"},
+               {257, "ustar  "}}) +
+            block({{0, "d/short.txt"},
+                   {100, "0000644"},
+                   {108, "0000000"},
+                   {116, "0000000"},
+                   {124, "00000000006"},
+                   {136, "14524770400"},
+                   {148, "010066"},
+                   {155, " 0"},
+                   {257, "ustar  "}}) +
+            block({{0, "hello\n"}}) +
+            block({{0, "././@LongLink"},
+                   {100, "0000644"},
+                   {108, "0000000"},
+                   {116, "0000000"},
+                   {124, "00000000165"},
+                   {136, "00000000000"},
+                   {148, "007775"},
+                   {155, " L"},
+                   {257, "ustar  "}}) +
+            block({{0, longName}}) +
+            block({{0, cutName},
+                   {100, "0000644"},
+                   {108, "0000000"},
+                   {116, "0000000"},
+                   {124, "00000000005"},
+                   {136, "14524770400"},
+                   {148, "035147"},
+                   {155, " 0"},
+                   {257, "ustar  "}}) +
+            block({{0, "long\n"}}) + end);
+
+    // POSIX format, with a PAX header holding the path and a fractional time
+    writeFile(
+        "pax.tar",
+        block({{0, "d/PaxHeaders/" + std::string(87, 'x')},
+               {100, "0000644"},
+               {108, "0000000"},
+               {116, "0000000"},
+               {124, "00000000224"},
+               {136, "14524770400"},
+               {148, "034676"},
+               {155, " x"},
+               {257, "ustar"},
+               {263, "00"}}) +
+            block({{0, "126 path=" + longName + "\n22 mtime=1700000123.5\n"}}) +
+            block({{0, cutName},
+                   {100, "0000644"},
+                   {108, "0000000"},
+                   {116, "0000000"},
+                   {124, "00000000005"},
+                   {136, "14524770400"},
+                   {148, "036447"},
+                   {155, " 0"},
+                   {257, "ustar"},
+                   {263, "00"},
+                   {329, "0000000"},
+                   {337, "0000000"}}) +
+            block({{0, "long\n"}}) + end);
+
+    FileHandler gnu("gnu.tar");
+    REQUIRE(gnu.Extract());
+    REQUIRE(readFile("d/short.txt") == "hello\n");
+    REQUIRE(readFile(longName) == "long\n");
+
+    auto reader = ArchiveReader::Open("pax.tar");
+    REQUIRE(reader);
+    std::vector<common::ObjectHeader> members{};
+    for (auto &member : reader.value()) {
+      REQUIRE(member);
+      members.push_back(member.value());
+    }
+    REQUIRE(members.size() == 1);
+    REQUIRE(members[0].fileName == longName);
+    REQUIRE(members[0].fileSize == 5);
+    REQUIRE(members[0].lastModified == 1700000123);
+  }
+
+  SECTION("Compressed archives round trip") {
+    for (auto const *name : {"tree.tar.gz", "tree.tar.zst"}) {
+      FileHandler handler(name);
+      REQUIRE(handler.Compress({"tree"}));
+      fs::remove_all("tree");
+      REQUIRE(handler.Extract());
+      REQUIRE(readFile("tree/a.txt") == "alpha");
+      REQUIRE(readFile("tree/nested/b.txt") == std::string(3000, 'b'));
+    }
+  }
+}